@@ -0,0 +1,21 @@
+/* bre2_shim.c - the older bre2.c interpreter, renamed for side-by-side benchmarks
+ *
+ * bre2.c defines bre_match() and friends with signatures that predate the
+ * current bre.h, so it cannot be linked next to bre.c as is. Including it
+ * here under bre2_* names lets bre_bench time both engines in one binary.
+ * The depth hooks count how deep its match_here() recursion goes.
+ */
+
+#include "bre.h"
+#include "bre2_shim.h"
+
+int bre2_depth;
+int bre2_peak_depth;
+
+#define BRE2_ENTER() (++bre2_depth > bre2_peak_depth ? (void)(bre2_peak_depth = bre2_depth) : (void)0)
+#define BRE2_LEAVE() ((void)--bre2_depth)
+
+#define bre_match bre2_match
+#define bre_substitute bre2_substitute
+#define parse_bre_repetition bre2_parse_bre_repetition
+#include "bre2.c"
@@ -0,0 +1,14 @@
+#ifndef BRE2_SHIM_H
+#define BRE2_SHIM_H
+
+#include "bre.h"
+#include <stdbool.h>
+
+/* bre2.c's bre_match(): true on a match, filling 'match' like bre_match() */
+bool bre2_match(const char *text, const char *pattern, BreMatch *match);
+
+/* Current and deepest match_here() recursion since the last reset */
+extern int bre2_depth;
+extern int bre2_peak_depth;
+
+#endif /* BRE2_SHIM_H */
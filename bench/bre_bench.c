@@ -0,0 +1,360 @@
+/* bre_bench.c - throughput benchmark for the BRE engines
+ *
+ * Runs a table of patterns over generated corpora (log lines, C source and
+ * pathological inputs) and reports, for each case and engine, the time per
+ * byte of text, matching lines per second and the peak recursion depth:
+ * the backtrack stack of bre.c (0 when a linear-time engine runs the
+ * pattern) or the match_here() nesting of the older bre2.c interpreter.
+ *
+ * Usage: bre_bench [--tsv] [--quick] [--engine bre|bre2] [--case NAME]
+ *
+ *   --tsv     tab-separated output with a header line, for scripts
+ *   --quick   small corpora and short runs (smoke test)
+ *   --engine  run only one engine
+ *   --case    run only the cases whose name contains NAME
+ */
+
+#include "bre.h"
+#include "bre_impl.h"
+#include "bre2_shim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum
+{
+    CORPUS_LOG,
+    CORPUS_SOURCE,
+    CORPUS_REPEAT,   /* lines of 'a', without the [bc] the patterns ask for */
+    CORPUS_BACKREF,  /* "xx" followed by a long run of 'a' */
+    NCORPORA
+} CorpusId;
+
+static const char *corpus_names[NCORPORA] = {"log", "source", "aaaa", "xxaaaa"};
+
+typedef struct
+{
+    char **lines; /* NUL-terminated, without the newline */
+    size_t nlines;
+    size_t bytes;
+} Corpus;
+
+typedef struct
+{
+    const char *name;
+    const char *pattern;
+    CorpusId corpus;
+    bool bre2; /* bre2.c can run it in reasonable time and supports the syntax */
+} BenchCase;
+
+static const BenchCase cases[] = {
+    {"literal", "ERROR", CORPUS_LOG, true},
+    {"literal-long", "connection reset by peer", CORPUS_LOG, true},
+    {"literal-absent", "segfault", CORPUS_LOG, true},
+    {"class", "[[:digit:]][[:digit:]]*ms", CORPUS_LOG, false},
+    {"class-range", "[0-9][0-9]*ms", CORPUS_LOG, true},
+    {"anchor-start", "^2024-03-0[12]", CORPUS_LOG, true},
+    {"anchor-end", "timeout$", CORPUS_LOG, true},
+    {"anchor-end-fixed", "id=[0-9]\\{5\\}$", CORPUS_LOG, true},
+    {"anchor-end-range", "=[0-9]\\{1,5\\}$", CORPUS_LOG, true},
+    {"dot-star", "ERROR.*timeout", CORPUS_LOG, true},
+    {"bounded", "[0-9]\\{1,3\\}\\.[0-9]\\{1,3\\}\\.[0-9]\\{1,3\\}\\.[0-9]\\{1,3\\}", CORPUS_LOG, true},
+    {"nested-groups", "\\(\\(worker\\)-\\([0-9]*\\)\\)\\]", CORPUS_LOG, true},
+    {"backref", "\\(worker-[0-9]*\\).*\\1", CORPUS_LOG, true},
+    {"src-include", "^#include <[a-z]*\\.h>", CORPUS_SOURCE, true},
+    {"src-call", "\\([a-z_][a-z_0-9]*\\)(\\([a-z_]*\\))", CORPUS_SOURCE, true},
+    {"src-ident", "[A-Za-z_][A-Za-z_0-9]*_count", CORPUS_SOURCE, true},
+    {"path-star", "a*a*a*a*a*[bc]", CORPUS_REPEAT, true},
+    {"path-group", "\\(a*\\)*[bc]", CORPUS_REPEAT, true},
+    {"path-bounded", "\\(a\\{1,5\\}\\)\\{1,5\\}[bc]", CORPUS_REPEAT, true},
+    {"path-backref", "\\(.\\)\\1.*a.*a.*a.*b", CORPUS_BACKREF, false},
+    {"path-limit", "\\(a*a*\\)*\\1[bc]", CORPUS_BACKREF, false},
+};
+
+#define NCASES (sizeof(cases) / sizeof(cases[0]))
+
+static char *dup_line(const char *s)
+{
+    size_t n = strlen(s);
+    char *p = malloc(n + 1);
+    if (!p)
+    {
+        fprintf(stderr, "bre_bench: out of memory\n");
+        exit(2);
+    }
+    memcpy(p, s, n + 1);
+    return p;
+}
+
+static void corpus_add(Corpus *c, const char *line)
+{
+    if ((c->nlines & (c->nlines - 1)) == 0)
+    {
+        char **nl = realloc(c->lines, (c->nlines ? 2 * c->nlines : 1) * sizeof(char *));
+        if (!nl)
+        {
+            fprintf(stderr, "bre_bench: out of memory\n");
+            exit(2);
+        }
+        c->lines = nl;
+    }
+    c->lines[c->nlines++] = dup_line(line);
+    c->bytes += strlen(line) + 1;
+}
+
+/* Deterministic pseudo-random numbers, so every run sees the same corpus */
+static unsigned long rng_state = 12345;
+static unsigned rng(unsigned n)
+{
+    rng_state = rng_state * 1103515245UL + 12345UL;
+    return (unsigned)((rng_state >> 16) & 0x7fff) % n;
+}
+
+static void build_log(Corpus *c, size_t nlines)
+{
+    static const char *levels[] = {"INFO ", "INFO ", "INFO ", "DEBUG", "WARN ", "ERROR"};
+    static const char *msgs[] = {"request served", "cache miss for key user:%u", "connection reset by peer",
+                                 "upstream 10.0.%u.17 responded", "retrying after timeout",
+                                 "queue depth %u above threshold", "timeout"};
+    char line[256];
+    char msg[96];
+    for (size_t i = 0; i < nlines; i++)
+    {
+        snprintf(msg, sizeof msg, msgs[rng(7)], rng(300));
+        unsigned w = rng(16);
+        snprintf(line, sizeof line, "2024-03-0%u %02u:%02u:%02u %s [worker-%u] %s took %ums%s%u", 1 + rng(4), rng(24),
+                 rng(60), rng(60), levels[rng(6)], w, msg, rng(2000), rng(8) == 0 ? " handed to worker-" : " id=",
+                 rng(8) == 0 ? w : rng(100000));
+        corpus_add(c, line);
+    }
+}
+
+static void build_source(Corpus *c, size_t nlines)
+{
+    static const char *tmpl[] = {"#include <stdio.h>",
+                                 "#include \"bre.h\"",
+                                 "static int item_count = 0;",
+                                 "    for (size_t i = 0; i < n; i++)",
+                                 "    {",
+                                 "        total += compute_sum(values);",
+                                 "        if (node->left_count > limit_%u)",
+                                 "            return lookup(table);",
+                                 "    }",
+                                 "/* Release the buffer once %u entries are done */",
+                                 "    printf(\"%%d\\n\", counter_%u);",
+                                 ""};
+    char line[256];
+    for (size_t i = 0; i < nlines; i++)
+    {
+        snprintf(line, sizeof line, tmpl[rng(12)], rng(50));
+        corpus_add(c, line);
+    }
+}
+
+static void build_repeat(Corpus *c, size_t nlines, size_t width, const char *prefix)
+{
+    char *line = malloc(width + 8);
+    if (!line)
+        exit(2);
+    for (size_t i = 0; i < nlines; i++)
+    {
+        size_t plen = strlen(prefix);
+        memcpy(line, prefix, plen);
+        memset(line + plen, 'a', width);
+        line[plen + width] = '\0';
+        corpus_add(c, line);
+    }
+    free(line);
+}
+
+static void corpus_free(Corpus *c)
+{
+    for (size_t i = 0; i < c->nlines; i++)
+        free(c->lines[i]);
+    free(c->lines);
+}
+
+typedef struct
+{
+    double seconds;
+    size_t passes;
+    size_t matches; /* matching lines in one pass */
+    int peak_depth;
+    BreResult result; /* BRE_OK, or the first BRE_LIMIT/BRE_ERROR seen */
+} BenchResult;
+
+static double now(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static BenchResult run_bre(const BenchCase *bc, const Corpus *c, double min_time)
+{
+    BenchResult res = {0};
+    res.result = BRE_OK;
+    BreProgram *prog = bre_compile(bc->pattern);
+    if (!prog)
+    {
+        res.result = BRE_ERROR;
+        return res;
+    }
+
+    /* Depth is measured in a separate pass so it does not cost time */
+    if (prog->has_backrefs)
+    {
+        int *slots = malloc((size_t)prog->nslots * sizeof(int));
+        for (size_t i = 0; slots && i < c->nlines; i++)
+        {
+            int peak = 0;
+            bre_backtrack_search(prog, c->lines[i], (int)strlen(c->lines[i]), 0, slots, &peak);
+            if (peak > res.peak_depth)
+                res.peak_depth = peak;
+        }
+        free(slots);
+    }
+
+    double start = now();
+    do
+    {
+        size_t matches = 0;
+        for (size_t i = 0; i < c->nlines; i++)
+        {
+            BreMatch m;
+            BreResult r = bre_exec(prog, c->lines[i], &m);
+            if (r == BRE_OK)
+                matches++;
+            else if (r != BRE_NOMATCH && res.result == BRE_OK)
+                res.result = r;
+        }
+        res.matches = matches;
+        res.passes++;
+        res.seconds = now() - start;
+    } while (res.seconds < min_time);
+
+    bre_free(prog);
+    return res;
+}
+
+static BenchResult run_bre2(const BenchCase *bc, const Corpus *c, double min_time)
+{
+    BenchResult res = {0};
+    res.result = BRE_OK;
+    bre2_peak_depth = 0;
+    double start = now();
+    do
+    {
+        size_t matches = 0;
+        for (size_t i = 0; i < c->nlines; i++)
+        {
+            BreMatch m;
+            if (bre2_match(c->lines[i], bc->pattern, &m))
+                matches++;
+        }
+        res.matches = matches;
+        res.passes++;
+        res.seconds = now() - start;
+    } while (res.seconds < min_time);
+    res.peak_depth = bre2_peak_depth;
+    return res;
+}
+
+static const char *result_name(BreResult r)
+{
+    switch (r)
+    {
+    case BRE_OK:
+        return "ok";
+    case BRE_LIMIT:
+        return "limit";
+    default:
+        return "error";
+    }
+}
+
+static void report(bool tsv, const BenchCase *bc, const char *engine, const Corpus *c, const BenchResult *res)
+{
+    double bytes = (double)c->bytes * (double)res->passes;
+    double ns_per_byte = res->seconds > 0 ? res->seconds * 1e9 / bytes : 0.0;
+    double matches_per_s = res->seconds > 0 ? (double)res->matches * (double)res->passes / res->seconds : 0.0;
+    if (tsv)
+    {
+        printf("%s\t%s\t%s\t%zu\t%.3f\t%.0f\t%d\t%zu\t%s\n", bc->name, engine, corpus_names[bc->corpus], c->bytes,
+               ns_per_byte, matches_per_s, res->peak_depth, res->matches, result_name(res->result));
+    }
+    else
+    {
+        printf("%-16s %-5s %-7s %10.2f %14.0f %10d %9zu  %s\n", bc->name, engine, corpus_names[bc->corpus],
+               ns_per_byte, matches_per_s, res->peak_depth, res->matches, result_name(res->result));
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    bool tsv = false;
+    bool quick = false;
+    const char *only_engine = NULL;
+    const char *only_case = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--tsv") == 0)
+            tsv = true;
+        else if (strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+            only_engine = argv[++i];
+        else if (strcmp(argv[i], "--case") == 0 && i + 1 < argc)
+            only_case = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: bre_bench [--tsv] [--quick] [--engine bre|bre2] [--case NAME]\n");
+            return 2;
+        }
+    }
+
+    size_t scale = quick ? 1 : 20;
+    double min_time = quick ? 0.0 : 0.3;
+    Corpus corpora[NCORPORA] = {{0}};
+    build_log(&corpora[CORPUS_LOG], 1000 * scale);
+    build_source(&corpora[CORPUS_SOURCE], 1000 * scale);
+    build_repeat(&corpora[CORPUS_REPEAT], 10 * scale, 24, "");
+    build_repeat(&corpora[CORPUS_BACKREF], quick ? 1 : 4, 2000, "xx");
+
+    if (tsv)
+        printf("case\tengine\tcorpus\tbytes\tns_per_byte\tmatches_per_s\tpeak_depth\tmatches\tresult\n");
+    else
+        printf("%-16s %-5s %-7s %10s %14s %10s %9s  %s\n", "case", "eng", "corpus", "ns/byte", "matches/s",
+               "peak-depth", "matches", "result");
+
+    int disagree = 0;
+    for (size_t k = 0; k < NCASES; k++)
+    {
+        const BenchCase *bc = &cases[k];
+        const Corpus *c = &corpora[bc->corpus];
+        if (only_case && !strstr(bc->name, only_case))
+            continue;
+        BenchResult a = {0};
+        bool ran_bre = !only_engine || strcmp(only_engine, "bre") == 0;
+        bool ran_bre2 = bc->bre2 && (!only_engine || strcmp(only_engine, "bre2") == 0);
+        if (ran_bre)
+        {
+            a = run_bre(bc, c, min_time);
+            report(tsv, bc, "bre", c, &a);
+        }
+        if (ran_bre2)
+        {
+            BenchResult b = run_bre2(bc, c, min_time);
+            report(tsv, bc, "bre2", c, &b);
+            if (ran_bre && a.result == BRE_OK && a.matches != b.matches)
+                disagree++;
+        }
+    }
+    if (disagree && !tsv)
+        printf("note: bre2 disagreed with bre on %d case(s); it only accepts matches that end at the end of the line\n",
+               disagree);
+
+    for (int i = 0; i < NCORPORA; i++)
+        corpus_free(&corpora[i]);
+    return 0;
+}
@@ -0,0 +1,140 @@
+/* bre_class_bench.c - bracket expression lookup: re-parsing vs. bitmap
+ *
+ * Compares the cost of testing bytes against a bracket expression by
+ * walking its source text for every byte (what the matcher used to do) with
+ * a lookup in the 256-bit map the compiler now builds, and times a whole
+ * search for a pattern dominated by a bracket expression.
+ *
+ * Usage: bre_class_bench [megabytes]
+ */
+
+#include "bre.h"
+#include "bre_impl.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *class_names[] = {"alnum", "alpha", "blank", "cntrl", "digit", "graph",
+                                    "lower", "print", "punct", "space", "upper", "xdigit"};
+static int (*class_tests[])(int) = {isalnum, isalpha, isblank, iscntrl, isdigit, isgraph,
+                                    islower, isprint, ispunct, isspace, isupper, isxdigit};
+
+/* Membership by scanning the bracket text, as done before compilation to bitmaps */
+static int reparse_contains(unsigned char c, const char *pat)
+{
+    const char *p = pat + 1;
+    int invert = *p == '^';
+    if (invert)
+        p++;
+    int matched = 0;
+    int first = 1;
+    while (*p && (*p != ']' || first))
+    {
+        first = 0;
+        if (p[0] == '[' && p[1] == ':')
+        {
+            const char *end = strstr(p + 2, ":]");
+            if (!end)
+                return 0;
+            for (size_t k = 0; k < sizeof(class_names) / sizeof(class_names[0]); k++)
+            {
+                size_t n = strlen(class_names[k]);
+                if ((size_t)(end - (p + 2)) == n && memcmp(p + 2, class_names[k], n) == 0 && class_tests[k](c))
+                    matched = 1;
+            }
+            p = end + 2;
+            continue;
+        }
+        if (p[1] == '-' && p[2] && p[2] != ']')
+        {
+            if ((unsigned char)p[0] <= c && c <= (unsigned char)p[2])
+                matched = 1;
+            p += 3;
+            continue;
+        }
+        if ((unsigned char)*p == c)
+            matched = 1;
+        p++;
+    }
+    return invert ? !matched : matched;
+}
+
+static double seconds_since(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv)
+{
+    const char *bracket = "[[:alnum:]_-]";
+    const char *pattern = "[[:alnum:]_-]*;";
+    size_t size = (size_t)(argc > 1 ? atoi(argv[1]) : 16) << 20;
+    if (size == 0)
+        size = 1 << 20;
+
+    /* Identifier-like text with a ';' now and then, split into lines */
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_- .,;";
+    char *text = malloc(size + 1);
+    if (!text)
+    {
+        fprintf(stderr, "bre_class_bench: out of memory\n");
+        return 1;
+    }
+    srand(1);
+    for (size_t i = 0; i < size; i++)
+        text[i] = (i % 80 == 79) ? '\n' : alphabet[rand() % (int)(sizeof(alphabet) - 1)];
+    text[size] = '\0';
+
+    BreProgram *prog = bre_compile(pattern);
+    if (!prog || prog->nclasses != 1)
+    {
+        fprintf(stderr, "bre_class_bench: cannot compile %s\n", pattern);
+        return 1;
+    }
+
+    size_t hits = 0;
+    clock_t t0 = clock();
+    for (size_t i = 0; i < size; i++)
+        hits += (size_t)reparse_contains((unsigned char)text[i], bracket);
+    double reparse = seconds_since(t0);
+
+    size_t hits2 = 0;
+    t0 = clock();
+    for (size_t i = 0; i < size; i++)
+        hits2 += bre_class_contains(prog, 0, (unsigned char)text[i]);
+    double bitmap = seconds_since(t0);
+
+    if (hits != hits2)
+    {
+        fprintf(stderr, "bre_class_bench: lookups disagree (%zu vs %zu)\n", hits, hits2);
+        return 1;
+    }
+
+    size_t lines = 0;
+    size_t matched = 0;
+    t0 = clock();
+    for (char *line = text; *line; )
+    {
+        char *nl = strchr(line, '\n');
+        size_t len = nl ? (size_t)(nl - line) : strlen(line);
+        BreMatch m;
+        if (bre_match_at(prog, line, len, 0, &m) == BRE_OK)
+            matched++;
+        lines++;
+        line += len + (nl != NULL);
+    }
+    double search = seconds_since(t0);
+
+    double ns = 1e9 / (double)size;
+    printf("bracket %s over %zu bytes (%zu members)\n", bracket, size, hits);
+    printf("  re-parse per byte: %8.2f ns/byte\n", reparse * ns);
+    printf("  bitmap lookup:     %8.2f ns/byte  (%.1fx)\n", bitmap * ns,
+           bitmap > 0 ? reparse / bitmap : 0.0);
+    printf("search %s: %zu of %zu lines, %.2f ns/byte\n", pattern, matched, lines, search * ns);
+
+    bre_free(prog);
+    free(text);
+    return 0;
+}
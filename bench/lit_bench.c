@@ -0,0 +1,189 @@
+/* lit_bench.c - fixed-string search: nested loop vs. Horspool
+ *
+ * Searches every line of a large generated log for fixed strings of
+ * several lengths, with and without case folding, the way grep -F does:
+ * once with the nested-loop search grep used before and once with the
+ * skip-table search of litsearch.c. The text is a 1 MB block of log lines
+ * searched over and over until the requested total size is reached, so
+ * multi-gigabyte runs need no more memory than that block.
+ *
+ * Usage: lit_bench [--quick] [--gb N] [--case NAME]
+ *
+ *   --quick   64 MB per case instead of 2 GB (smoke test)
+ *   --gb      gigabytes of text per case and searcher
+ *   --case    run only the cases whose name contains NAME
+ */
+
+#include "litsearch.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BLOCK_SIZE (1 << 20)
+
+typedef struct
+{
+    const char *name;
+    const char *needle;
+    bool icase;
+} BenchCase;
+
+static const BenchCase cases[] = {
+    {"short", "ERROR", false},
+    {"short-absent", "fatal", false},
+    {"medium", "segfault", false},
+    {"long", "connection reset by peer", false},
+    {"long-absent", "connection refused by remote peer", false},
+    {"very-long", "worker-17 request id=00421 finished with status 503 after", false},
+    {"short-i", "error", true},
+    {"long-i", "CONNECTION RESET BY PEER", true},
+};
+
+#define NCASES (sizeof(cases) / sizeof(cases[0]))
+
+typedef struct
+{
+    char *text;
+    size_t *starts; /* line i is text[starts[i]..starts[i+1]-1), without the newline */
+    size_t nlines;
+} Block;
+
+static void build_block(Block *b)
+{
+    static const char *levels[] = {"INFO", "DEBUG", "WARN", "ERROR"};
+    static const char *messages[] = {"request finished", "cache miss for key", "connection reset by peer",
+                                     "retrying after timeout", "worker started", "segfault in handler"};
+    b->text = malloc(BLOCK_SIZE);
+    b->starts = malloc((BLOCK_SIZE / 16 + 1) * sizeof(size_t));
+    if (!b->text || !b->starts)
+    {
+        fprintf(stderr, "lit_bench: out of memory\n");
+        exit(1);
+    }
+    srand(1);
+    size_t len = 0;
+    b->nlines = 0;
+    for (;;)
+    {
+        char line[160];
+        int n = snprintf(line, sizeof(line), "2024-03-%02d 12:%02d:%02d %s worker-%d request id=%05d %s\n",
+                         1 + rand() % 28, rand() % 60, rand() % 60, levels[rand() % 4 == 0 ? 3 : rand() % 3],
+                         rand() % 64, rand() % 100000, messages[rand() % 6]);
+        if (len + (size_t)n > BLOCK_SIZE)
+            break;
+        memcpy(b->text + len, line, (size_t)n);
+        b->starts[b->nlines++] = len;
+        len += (size_t)n;
+    }
+    b->starts[b->nlines] = len;
+}
+
+/* The search grep -F used before: try every position, compare byte by byte */
+static long naive_find(const char *hay, size_t hlen, const char *ndl, size_t nlen, bool icase)
+{
+    if (nlen > hlen)
+        return -1;
+    for (size_t i = 0; i + nlen <= hlen; ++i)
+    {
+        if (!icase)
+        {
+            if (memcmp(hay + i, ndl, nlen) == 0)
+                return (long)i;
+        }
+        else
+        {
+            size_t j = 0;
+            for (; j < nlen; ++j)
+            {
+                if (tolower((unsigned char)hay[i + j]) != tolower((unsigned char)ndl[j]))
+                    break;
+            }
+            if (j == nlen)
+                return (long)i;
+        }
+    }
+    return -1;
+}
+
+static double now(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+/* Matching lines over 'passes' searches of the block; time in *seconds */
+static size_t run(const Block *b, const BenchCase *bc, size_t passes, bool horspool, double *seconds)
+{
+    size_t nlen = strlen(bc->needle);
+    LitSearch *ls = lit_compile(bc->needle, nlen, bc->icase);
+    size_t matches = 0;
+    double start = now();
+    for (size_t p = 0; p < passes; p++)
+    {
+        for (size_t i = 0; i < b->nlines; i++)
+        {
+            const char *line = b->text + b->starts[i];
+            size_t len = b->starts[i + 1] - b->starts[i] - 1;
+            bool hit = horspool ? lit_find(ls, line, len) != NULL : naive_find(line, len, bc->needle, nlen, bc->icase) >= 0;
+            matches += hit;
+        }
+    }
+    *seconds = now() - start;
+    lit_free(ls);
+    return matches;
+}
+
+int main(int argc, char **argv)
+{
+    double gb = 2.0;
+    const char *only_case = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quick") == 0)
+            gb = 1.0 / 16;
+        else if (strcmp(argv[i], "--gb") == 0 && i + 1 < argc)
+            gb = atof(argv[++i]);
+        else if (strcmp(argv[i], "--case") == 0 && i + 1 < argc)
+            only_case = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: lit_bench [--quick] [--gb N] [--case NAME]\n");
+            return 2;
+        }
+    }
+
+    Block b;
+    build_block(&b);
+    size_t block_bytes = b.starts[b.nlines];
+    size_t passes = (size_t)(gb * 1024.0 * 1024.0 * 1024.0 / (double)block_bytes);
+    if (passes == 0)
+        passes = 1;
+    double total = (double)block_bytes * (double)passes;
+    printf("%zu lines, %.2f GB per run\n", b.nlines * passes, total / (1024.0 * 1024.0 * 1024.0));
+    printf("%-14s %4s %3s %12s %12s %9s %8s %12s\n", "case", "len", "-i", "naive ns/B", "bmh ns/B", "bmh GB/s",
+           "speedup", "matches");
+
+    int disagree = 0;
+    for (size_t k = 0; k < NCASES; k++)
+    {
+        const BenchCase *bc = &cases[k];
+        if (only_case && !strstr(bc->name, only_case))
+            continue;
+        double t_naive, t_bmh;
+        size_t m_naive = run(&b, bc, passes, false, &t_naive);
+        size_t m_bmh = run(&b, bc, passes, true, &t_bmh);
+        if (m_naive != m_bmh)
+            disagree++;
+        printf("%-14s %4zu %3s %12.3f %12.3f %9.2f %7.1fx %12zu%s\n", bc->name, strlen(bc->needle),
+               bc->icase ? "yes" : "no", t_naive * 1e9 / total, t_bmh * 1e9 / total,
+               t_bmh > 0 ? total / t_bmh / 1e9 : 0.0, t_bmh > 0 ? t_naive / t_bmh : 0.0, m_bmh,
+               m_naive != m_bmh ? "  MISMATCH" : "");
+        fflush(stdout);
+    }
+
+    free(b.text);
+    free(b.starts);
+    return disagree ? 1 : 0;
+}
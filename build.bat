@@ -4,6 +4,9 @@
 var CC=gcc
 var CFLAGS=-std=c23
 
+; Regex library sources: add each new one here for every tool that links bre.c
+var BRE_SRC=bre.c bre_cache.c bre_dfa.c bre_pike.c bre_set.c litsearch.c
+
 ; Update hash database to remove stale entries
 ; fnvupdate
 ; echo Updated file_hash.dat
@@ -44,7 +47,7 @@ echo ifc build status: {{?}}
 
 ; Build sed
 fnvtest sed.c
-ifc {{?}} == 1 {{CC}} {{CFLAGS}} -o sed sed.c bre.c
+ifc {{?}} == 1 {{CC}} {{CFLAGS}} -o sed sed.c {{BRE_SRC}}
 echo sed build status: {{?}}
 
 ; Build checkenc
@@ -0,0 +1,92 @@
+# cmake/run_grep_parity_test.cmake
+# grep -j splits a file of 32 MB or more into parts searched at once. Its
+# output must be the serial search's, whatever the options and line ends.
+
+cmake_minimum_required(VERSION 3.16)
+
+if(NOT DEFINED GREP_BINARY OR NOT DEFINED WORK_DIR)
+    message(FATAL_ERROR "GREP_BINARY or WORK_DIR not defined")
+endif()
+
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+# ------------------------------------------------------------------
+# 1. Inputs of 34 MB: one with \n line ends, one with \r\n
+# ------------------------------------------------------------------
+foreach(eol IN ITEMS lf crlf)
+    set(input "${WORK_DIR}/parity_${eol}.txt")
+    if(EXISTS "${input}")
+        continue()
+    endif()
+    if(eol STREQUAL "crlf")
+        set(nl "\r\n")
+    else()
+        set(nl "\n")
+    endif()
+    # 64 KB block of varied lines, written 544 times
+    set(block "")
+    foreach(i RANGE 1 1000)
+        math(EXPR kind "${i} % 7")
+        if(kind EQUAL 0)
+            string(APPEND block "ERROR worker-${i} connection reset by peer${nl}")
+        elseif(kind EQUAL 3)
+            string(APPEND block "error${nl}")
+        elseif(kind EQUAL 5)
+            string(APPEND block "${nl}")
+        else()
+            string(APPEND block "INFO worker-${i} request finished${nl}")
+        endif()
+    endforeach()
+    string(LENGTH "${block}" block_len)
+    math(EXPR copies "34 * 1024 * 1024 / ${block_len} + 1")
+    string(REPEAT "${block}" 16 chunk)
+    math(EXPR chunks "${copies} / 16 + 1")
+    file(WRITE "${input}.tmp" "")
+    foreach(i RANGE 1 ${chunks})
+        file(APPEND "${input}.tmp" "${chunk}")
+    endforeach()
+    file(RENAME "${input}.tmp" "${input}")
+endforeach()
+
+# ------------------------------------------------------------------
+# 2. Each option set, serial and with -j 4
+# ------------------------------------------------------------------
+set(cases
+    "-n ERROR"
+    "-c error"
+    "-ci error"
+    "-x error"
+    "-c -x error"
+    "-n error$"
+    "-c -v ."
+    "-n -m 5 reset"
+    "-l reset"
+    "-q reset"
+    "-F -n peer"
+)
+
+set(failed 0)
+foreach(eol IN ITEMS lf crlf)
+    set(input "${WORK_DIR}/parity_${eol}.txt")
+    foreach(args IN LISTS cases)
+        separate_arguments(argv UNIX_COMMAND "${args}")
+        # Outputs run to megabytes: compare them as files
+        execute_process(COMMAND ${GREP_BINARY} ${argv} "${input}"
+            OUTPUT_FILE "${WORK_DIR}/serial.out" RESULT_VARIABLE serial_rc)
+        execute_process(COMMAND ${GREP_BINARY} -j 4 ${argv} "${input}"
+            OUTPUT_FILE "${WORK_DIR}/parallel.out" RESULT_VARIABLE parallel_rc)
+        execute_process(
+            COMMAND ${CMAKE_COMMAND} -E compare_files "${WORK_DIR}/serial.out" "${WORK_DIR}/parallel.out"
+            RESULT_VARIABLE diff
+        )
+        if(NOT diff EQUAL 0 OR NOT serial_rc EQUAL parallel_rc)
+            message("grep -j 4 ${args} differs from grep ${args} on ${eol} input")
+            set(failed 1)
+        endif()
+    endforeach()
+endforeach()
+
+if(failed)
+    message(FATAL_ERROR "TEST FAILED")
+endif()
+message("grep -j parity: PASSED")
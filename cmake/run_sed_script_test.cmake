@@ -0,0 +1,37 @@
+# cmake/run_sed_script_test.cmake
+# Runs sed -f NAME.sed on NAME_in.txt and compares what it prints with
+# NAME_expected.txt. Options such as -n go one per line in NAME.args.
+
+cmake_minimum_required(VERSION 3.16)
+
+if(NOT DEFINED TEST_NAME OR NOT DEFINED TEST_DIR OR NOT DEFINED SED_BINARY)
+    message(FATAL_ERROR "TEST_NAME, TEST_DIR, or SED_BINARY not defined")
+endif()
+
+set(sed_cmd ${SED_BINARY})
+if(EXISTS "${TEST_DIR}/${TEST_NAME}.args")
+    file(STRINGS "${TEST_DIR}/${TEST_NAME}.args" sed_args)
+    list(APPEND sed_cmd ${sed_args})
+endif()
+list(APPEND sed_cmd -f "${TEST_DIR}/${TEST_NAME}.sed" "${TEST_DIR}/${TEST_NAME}_in.txt")
+
+execute_process(
+    COMMAND ${sed_cmd}
+    RESULT_VARIABLE sed_result
+    OUTPUT_VARIABLE sed_out
+    ERROR_VARIABLE sed_err
+)
+
+if(NOT sed_result EQUAL 0)
+    message("=== sed STDERR ===\n${sed_err}")
+    message(FATAL_ERROR "TEST FAILED: sed exited with status ${sed_result}")
+endif()
+
+file(READ "${TEST_DIR}/${TEST_NAME}_expected.txt" expected)
+if(NOT sed_out STREQUAL expected)
+    message("=== expected ===\n${expected}")
+    message("=== got ===\n${sed_out}")
+    message(FATAL_ERROR "TEST FAILED: sed output differs")
+endif()
+
+message("sed ${TEST_NAME}: PASSED")
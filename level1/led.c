@@ -52,18 +52,22 @@ static int parse_address(Editor *ed, const char *addr) {
         strncpy(pattern, addr + 1, strlen(addr) - 2);
         pattern[strlen(addr) - 2] = '\0';
 
-        BreMatch match;
-        for (int i = ed->current_line - 1; i < ed->num_lines; i++) {
-            if (bre_match(ed->lines[i], pattern, &match)) {
-                return i;
+        BreProgram *prog = bre_compile(pattern);
+        if (!prog) return -1;
+
+        int found = -1;
+        for (int i = ed->current_line - 1; i < ed->num_lines && found < 0; i++) {
+            if (bre_test(prog, ed->lines[i]) == BRE_OK) {
+                found = i;
             }
         }
-        for (int i = 0; i < ed->current_line - 1; i++) {
-            if (bre_match(ed->lines[i], pattern, &match)) {
-                return i;
+        for (int i = 0; i < ed->current_line - 1 && found < 0; i++) {
+            if (bre_test(prog, ed->lines[i]) == BRE_OK) {
+                found = i;
             }
         }
-        return -1; // No match
+        bre_free(prog);
+        return found; // -1 if no match
     }
 
     int line = atoi(addr);
@@ -210,15 +214,22 @@ static void substitute_line(Editor *ed, int start, int end, const char *cmd) {
     }
     replacement[i] = '\0';
 
+    BreProgram *prog = bre_compile(pattern);
+    if (!prog) {
+        printf("?\n");
+        return;
+    }
     for (int j = start; j <= end; j++) {
-        char *new_line = bre_substitute(ed->lines[j], pattern, replacement);
+        char *new_line = bre_substitute_prog(prog, ed->lines[j], replacement);
         if (!new_line) {
+            bre_free(prog);
             printf("?\n");
             return;
         }
         free(ed->lines[j]);
         ed->lines[j] = new_line;
     }
+    bre_free(prog);
     ed->dirty = 1;
     ed->current_line = end + 1;
 }
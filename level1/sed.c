@@ -10,7 +10,7 @@
 // Supported commands: p d q n = s y w r a i c N D P h H g G x l
 // Not implemented: b, t, : (labels), { } groupings
 // Addresses: line number, $, /re/, and ranges addr1,addr2
-// Options: -n, -e script, -f scriptfile
+// Options: -n, -E (extended regular expressions), -e script, -f scriptfile
 
 #define MAX_CMDS 512
 #define MAX_FILES 128
@@ -23,6 +23,7 @@ typedef struct {
     AddrType type;
     long line;        // for ADDR_LINE
     char *regex;      // for ADDR_REGEX
+    const BreProgram *prog; // compiled regex from g_re_cache, built once at parse time
 } Address;
 
 typedef enum {
@@ -51,6 +52,7 @@ typedef struct SedCmd {
 
     // s command
     char *s_pat;          // pattern
+    const BreProgram *s_prog; // compiled pattern from g_re_cache
     char *s_repl;         // replacement
     int s_occurrence;     // 0 = first (default), >0 specific occurrence, -1 = g (all)
     bool s_print;         // p flag
@@ -77,17 +79,21 @@ static WriteFile g_wfiles[MAX_FILES];
 static int g_nwfiles = 0;
 
 static bool g_auto_print = true;
+static int g_re_flags = 0; /* BRE_EXTENDED with -E; applies to every address and s command */
 static bool is_last_line_in_file = false;
 static FILE *g_out = NULL; /* non-POSIX: redirected output (defaults to stdout) */
+static BreCache *g_re_cache = NULL; /* /re/ and s/re/ often repeat a pattern; compile each once */
 
 static void free_address(Address *a) {
     if (a->type == ADDR_REGEX && a->regex) { free(a->regex); a->regex = NULL; }
+    if (a->prog) { bre_cache_release(g_re_cache, a->prog); a->prog = NULL; }
 }
 
 static void free_cmd(SedCmd *c) {
     free_address(&c->a1);
     free_address(&c->a2);
     if (c->s_pat) free(c->s_pat);
+    if (c->s_prog) bre_cache_release(g_re_cache, c->s_prog);
     if (c->s_repl) free(c->s_repl);
     if (c->s_wfile) free(c->s_wfile);
     if (c->y_src) free(c->y_src);
@@ -99,12 +105,19 @@ static void free_cmd(SedCmd *c) {
 
 static void cleanup_all(void) {
     for (int i = 0; i < g_ncmds; i++) free_cmd(&g_cmds[i]);
+    bre_cache_free(g_re_cache);
+    g_re_cache = NULL;
     for (int i = 0; i < g_nwfiles; i++) {
         if (g_wfiles[i].fp) fclose(g_wfiles[i].fp);
         if (g_wfiles[i].name) free(g_wfiles[i].name);
     }
 }
 
+static const BreProgram *compile_re(const char *re, int flags) {
+    if (!g_re_cache && !(g_re_cache = bre_cache_new(0))) return NULL;
+    return bre_cache_get(g_re_cache, re, flags);
+}
+
 static char *xstrdup(const char *s) {
     if (!s) return NULL;
     size_t n = strlen(s) + 1;
@@ -121,12 +134,6 @@ static char *substr_dup(const char *s, size_t len) {
     return p;
 }
 
-// Trim trailing newline from a buffer (if present)
-static void chomp(char *s) {
-    size_t n = strlen(s);
-    if (n && s[n-1] == '\n') s[n-1] = '\0';
-}
-
 // Read entire file to string (for -f scripts)
 static char *read_file_to_string(const char *path) {
     FILE *fp = fopen(path, "rb");
@@ -134,10 +141,7 @@ static char *read_file_to_string(const char *path) {
     char *buf = NULL; size_t cap = 0, len = 0;
     // Plain text read; treat input as UTF-8. If an UTF-8 BOM is present, skip it.
     unsigned char bom[3]; size_t b = fread(bom, 1, 3, fp);
-    size_t start = 0;
-    if (b == 3 && bom[0] == 0xEF && bom[1] == 0xBB && bom[2] == 0xBF) {
-        start = 3;
-    } else {
+    if (!(b == 3 && bom[0] == 0xEF && bom[1] == 0xBB && bom[2] == 0xBF)) {
         if (b > 0) fseek(fp, 0, SEEK_SET);
     }
     char chunk[4096]; size_t nr;
@@ -150,6 +154,15 @@ static char *read_file_to_string(const char *path) {
     return buf;
 }
 
+// A back-reference pattern that runs out of match budget (BRE_LIMIT) stops the
+// job with an error rather than letting it hang or quietly skip the line.
+static void check_regex_limit(BreResult r) {
+    if (r == BRE_LIMIT) {
+        fprintf(stderr, "sed: regular expression too complex for input (match budget exhausted)\n");
+        exit(1);
+    }
+}
+
 // --- Address matching ---
 static bool addr_matches(Address *a, const char *ps, long lineno) {
     switch (a->type) {
@@ -157,8 +170,11 @@ static bool addr_matches(Address *a, const char *ps, long lineno) {
         case ADDR_LINE: return a->line == lineno;
         case ADDR_LAST: return is_last_line_in_file;
         case ADDR_REGEX: {
-            BreMatch m;
-            return bre_match(ps, a->regex, &m);
+            size_t len = strlen(ps);
+            if (len > 0 && ps[len - 1] == '\n') len--; // $ matches before the newline
+            BreResult r = bre_test_n(a->prog, ps, len);
+            check_regex_limit(r);
+            return r == BRE_OK;
         }
         default: return false;
     }
@@ -200,95 +216,26 @@ static FILE *get_wfile(const char *name, bool truncate_now) {
 }
 
 // --- Substitute helper supporting g / Nth occurrence / p / w ---
-static char *do_substitute(const char *text, const char *pattern, const char *replacement, int occurrence, bool *did_any, int *num_subs) {
-    // occurrence: -1 = global, 0 = first only, >0 = that specific occurrence
+static BreBuffer g_sub_buf; // output of the last substitution, reused across lines
+
+// occurrence: -1 = global, 0 = first only, >0 = that specific occurrence
+// Returns the new pattern space, or NULL if nothing was replaced (or out of memory).
+static char *do_substitute(const char *text, const BreProgram *prog, const char *replacement, int occurrence, int *num_subs) {
     size_t tlen = strlen(text);
-    size_t cap = tlen + 1;
-    char *out = (char*)malloc(cap);
+    // The trailing newline is not part of the line, so that $ matches before it
+    size_t nl = (tlen > 0 && text[tlen - 1] == '\n') ? 1 : 0;
+    int which = occurrence < 0 ? 0 : (occurrence == 0 ? 1 : occurrence);
+    size_t count = 0;
+    *num_subs = 0;
+    BreResult r = bre_substitute_into(prog, text, tlen - nl, replacement, which, &g_sub_buf, &count);
+    check_regex_limit(r);
+    if (r != BRE_OK || count == 0)
+        return NULL;
+    char *out = (char*)malloc(g_sub_buf.len + nl + 1);
     if (!out) return NULL;
-    size_t olen = 0;
-    size_t pos = 0;
-    int match_count = 0;
-    *did_any = false;
-    if (num_subs) *num_subs = 0;
-
-    while (pos <= tlen) {
-        BreMatch m;
-        if (!bre_match(text + pos, pattern, &m) || m.start < 0) {
-            // copy rest
-            size_t rest = tlen - pos;
-            if (olen + rest + 1 > cap) { cap = (olen + rest + 1) * 2; out = (char*)realloc(out, cap); if (!out) return NULL; }
-            memcpy(out + olen, text + pos, rest);
-            olen += rest;
-            break;
-        }
-        size_t mstart = pos + (size_t)m.start;
-        size_t mlen = (size_t)m.length;
-        // copy prefix
-        size_t prefix = mstart - pos;
-        if (olen + prefix + 1 > cap) { cap = (olen + prefix + 1) * 2; out = (char*)realloc(out, cap); if (!out) return NULL; }
-        memcpy(out + olen, text + pos, prefix);
-        olen += prefix;
-
-        match_count++;
-        bool replace_this = false;
-        if (occurrence == -1) replace_this = true;             // global
-        else if (occurrence == 0 && match_count == 1) replace_this = true; // first only
-        else if (occurrence > 0 && match_count == occurrence) replace_this = true;
-
-        if (replace_this) {
-            // expand replacement with \1..\9 from m relative to whole text
-            // m.groups hold absolute positions relative to text+pos; fix up
-            if (olen + 1 > cap) { cap *= 2; out = (char*)realloc(out, cap); if (!out) return NULL; }
-            for (const char *r = replacement; *r; r++) {
-                if (*r == '\\' && r[1] >= '1' && r[1] <= '9') {
-                    int g = r[1] - '1';
-                    if (g >= 0 && g < m.num_groups && m.groups[g].start >= 0) {
-                        size_t gs = (size_t)m.groups[g].start; // relative to (text+pos)
-                        size_t gl = (size_t)m.groups[g].length;
-                        // Convert to absolute in original text
-                        if (olen + gl + 1 > cap) { cap = (olen + gl + 1) * 2; out = (char*)realloc(out, cap); if (!out) return NULL; }
-                        memcpy(out + olen, (text + pos) + gs, gl);
-                        olen += gl;
-                    }
-                    r++;
-                } else {
-                    if (olen + 1 > cap) { cap *= 2; out = (char*)realloc(out, cap); if (!out) return NULL; }
-                    out[olen++] = *r;
-                }
-            }
-            *did_any = true;
-            if (num_subs) (*num_subs)++;
-        } else {
-            // keep original match
-            if (olen + mlen + 1 > cap) { cap = (olen + mlen + 1) * 2; out = (char*)realloc(out, cap); if (!out) return NULL; }
-            memcpy(out + olen, text + mstart, mlen);
-            olen += mlen;
-        }
-
-        // advance position
-        pos = mstart + (mlen > 0 ? mlen : 1);
-
-        if (occurrence > 0 && match_count >= occurrence) {
-            // copy rest and finish
-            size_t rest = tlen - pos;
-            if (olen + rest + 1 > cap) { cap = (olen + rest + 1) * 2; out = (char*)realloc(out, cap); if (!out) return NULL; }
-            memcpy(out + olen, text + pos, rest);
-            olen += rest;
-            break;
-        }
-
-        if (occurrence == 0) {
-            // first only: copy rest and finish
-            size_t rest = tlen - pos;
-            if (olen + rest + 1 > cap) { cap = (olen + rest + 1) * 2; out = (char*)realloc(out, cap); if (!out) return NULL; }
-            memcpy(out + olen, text + pos, rest);
-            olen += rest;
-            break;
-        }
-    }
-
-    out[olen] = '\0';
+    memcpy(out, g_sub_buf.data, g_sub_buf.len);
+    memcpy(out + g_sub_buf.len, text + tlen - nl, nl + 1);
+    *num_subs = (int)count;
     return out;
 }
 
@@ -318,21 +265,18 @@ static void ps_skip_ws(Parser *p) {
     }
 }
 
-static bool ps_expect(Parser *p, char ch) {
-    int c = ps_get(p);
-    return c == ch;
-}
-
-static char *parse_delimited(Parser *p, char delim, bool allow_esc) {
-    size_t start = p->i;
+// keep_esc: leave escapes other than \delim and \n in place for the regex
+// compiler or the replacement expander (\( \1 \& ...)
+static char *parse_delimited(Parser *p, char delim, bool allow_esc, bool keep_esc) {
     char *buf = NULL; size_t cap = 0, len = 0;
     while (p->i < p->n) {
         char c = p->s[p->i++];
         if (allow_esc && c == '\\' && p->i < p->n) {
             char next = p->s[p->i++];
-            // store literally next
-            if (len + 2 > cap) { size_t nc = cap ? cap * 2 : 64; while (nc < len + 2) nc *= 2; char *nb = (char*)realloc(buf, nc); if (!nb) { free(buf); return NULL; } buf = nb; cap = nc; }
-            buf[len++] = next;
+            bool keep = keep_esc && next != delim && next != 'n';
+            if (len + 3 > cap) { size_t nc = cap ? cap * 2 : 64; while (nc < len + 3) nc *= 2; char *nb = (char*)realloc(buf, nc); if (!nb) { free(buf); return NULL; } buf = nb; cap = nc; }
+            if (keep) buf[len++] = '\\';
+            buf[len++] = (keep_esc && next == 'n') ? '\n' : next;
             continue;
         }
         if (c == delim) break;
@@ -356,9 +300,14 @@ static bool parse_address(Parser *p, Address *out) {
     }
     if (c == '/') {
         ps_get(p);
-        char *re = parse_delimited(p, '/', true);
+        char *re = parse_delimited(p, '/', true, true);
         if (!re) return false;
-        out->type = ADDR_REGEX; out->regex = re; out->line = -1; return true;
+        out->type = ADDR_REGEX; out->regex = re; out->line = -1;
+        int flags = g_re_flags;
+        if (ps_peek(p) == 'I') { ps_get(p); flags |= BRE_ICASE; } // non-POSIX: /re/I ignores case
+        out->prog = compile_re(re, flags);
+        if (!out->prog) { free(re); out->regex = NULL; return false; }
+        return true;
     }
     return false;
 }
@@ -487,10 +436,10 @@ static bool parse_one_command(Parser *p, SedCmd *cmd) {
             cmd->type = CMD_Y;
             int delim = ps_get(p);
             if (delim <= 0 || delim == '\n') return false;
-            cmd->y_src = parse_delimited(p, (char)delim, true);
+            cmd->y_src = parse_delimited(p, (char)delim, true, false);
             if (!cmd->y_src) return false;
             // Parse dst
-            cmd->y_dst = parse_delimited(p, (char)delim, true);
+            cmd->y_dst = parse_delimited(p, (char)delim, true, false);
             if (!cmd->y_dst) return false;
             // lengths must be equal
             if (strlen(cmd->y_src) != strlen(cmd->y_dst)) return false;
@@ -500,18 +449,20 @@ static bool parse_one_command(Parser *p, SedCmd *cmd) {
             cmd->type = CMD_S;
             int delim = ps_get(p);
             if (delim <= 0 || delim == '\n') return false;
-            cmd->s_pat = parse_delimited(p, (char)delim, true);
+            cmd->s_pat = parse_delimited(p, (char)delim, true, true);
             if (!cmd->s_pat) return false;
-            cmd->s_repl = parse_delimited(p, (char)delim, true);
+            cmd->s_repl = parse_delimited(p, (char)delim, true, true);
             if (!cmd->s_repl) return false;
             // flags
             cmd->s_occurrence = 0; // first only by default
             cmd->s_print = false;
             cmd->s_wfile = NULL;
+            int re_flags = g_re_flags;
             ps_skip_ws(p);
             while (p->i < p->n) {
                 int f = ps_peek(p);
                 if (f == 'g') { cmd->s_occurrence = -1; ps_get(p); }
+                else if (f == 'I') { re_flags |= BRE_ICASE; ps_get(p); } // non-POSIX: ignore case
                 else if (f == 'p') { cmd->s_print = true; ps_get(p); }
                 else if (isdigit(f)) {
                     int num = 0;
@@ -529,6 +480,8 @@ static bool parse_one_command(Parser *p, SedCmd *cmd) {
                     break;
                 }
             }
+            cmd->s_prog = compile_re(cmd->s_pat, re_flags);
+            if (!cmd->s_prog) return false;
             break;
         }
         default:
@@ -702,8 +655,9 @@ static bool exec_cmds_on_line(ExecState *st) {
                 break;
             }
             case CMD_S: {
-                bool did_any = false; int subs = 0;
-                char *res = do_substitute(st->ps, c->s_pat, c->s_repl, c->s_occurrence, &did_any, &subs);
+                int subs = 0;
+                char *res = do_substitute(st->ps, c->s_prog, c->s_repl, c->s_occurrence, &subs);
+                bool did_any = subs > 0;
                 if (res) { free(st->ps); st->ps = res; }
                 if (did_any && c->s_print) { fputs(st->ps, g_out ? g_out : stdout); printed_now = true; }
                 if (did_any && c->s_wfile) {
@@ -825,7 +779,6 @@ static bool process_files(char **files, int nfiles) {
             st.ps = xstrdup(line);
 
             // Determine if this is the last line in file by peeking
-            long pos_before = ftell(fp);
             int nextc = fgetc(fp);
             if (nextc == EOF) is_last_line_in_file = true; else { is_last_line_in_file = false; ungetc(nextc, fp); }
 
@@ -850,7 +803,6 @@ static bool process_files(char **files, int nfiles) {
                 // But we need to ensure we don't auto-print again; continue to top
                 // rely on continue
                 // Mark last-line flag again
-                long pos_b = ftell(fp);
                 int c2 = fgetc(fp);
                 if (c2 == EOF) is_last_line_in_file = true; else { is_last_line_in_file = false; ungetc(c2, fp); }
 
@@ -892,7 +844,7 @@ static bool process_files(char **files, int nfiles) {
 }
 
 static void print_usage(void) {
-    printf("Usage: sed [-n] [-o outfile] [-e script]... [-f scriptfile]... [scriptfile] [infile] [outfile]\n");
+    printf("Usage: sed [-n] [-E] [-o outfile] [-e script]... [-f scriptfile]... [scriptfile] [infile] [outfile]\n");
     printf("Non-POSIX additions: -o outfile for redirect; positional script file + input + output when no -e/-f used.\n");
 }
 
@@ -900,8 +852,7 @@ int main(int argc, char *argv[]) {
     atexit(cleanup_all);
 
     char *script_acc = NULL; size_t acc_cap = 0, acc_len = 0;
-    char *inline_script = NULL; // if provided inline (fallback when file not readable)
-    const char *pos_script_file = NULL; /* positional script file */
+    const char *inline_script = NULL; // if provided inline (fallback when file not readable)
     const char *pos_in_file = NULL;     /* positional input file  */
     const char *pos_out_file = NULL;    /* positional output file */
 
@@ -909,6 +860,7 @@ int main(int argc, char *argv[]) {
     int i = 1;
     for (; i < argc; i++) {
         if (strcmp(argv[i], "-n") == 0) { g_auto_print = false; continue; }
+        else if (strcmp(argv[i], "-E") == 0) { g_re_flags |= BRE_EXTENDED; continue; }
         else if (strcmp(argv[i], "-e") == 0) {
             if (i + 1 >= argc) { fprintf(stderr, "sed: -e requires argument\n"); return 1; }
             const char *s = argv[++i];
@@ -941,7 +893,6 @@ int main(int argc, char *argv[]) {
         const char *candidate = argv[i++];
         char *file_script = read_file_to_string(candidate);
         if (file_script) {
-            pos_script_file = candidate;
             size_t L = strlen(file_script);
             script_acc = (char*)malloc(L + 1);
             if (!script_acc) { free(file_script); return 1; }
@@ -54,36 +54,373 @@ static void set_error(Editor *ed, const char *msg);
 static void update_marks_after_delete(Editor *ed, int start_line, int num_deleted);
 static void update_marks_after_insert(Editor *ed, int insert_line, int num_inserted);
 
-// Undo support
-static void prepare_undo(Editor *ed)
+// Line store. ed->lines is a gap buffer of line pointers: line i is at
+// lines[i] before the gap and at lines[i + gap_len] after it. Lines are
+// inserted and removed at the gap, which is first moved to the address
+// edited, so a run of edits near one address costs O(1) each instead of
+// shifting every line after it.
+
+// Undo journal. Instead of copying the buffer before each command, the
+// store records what it changes while a step is open: the range of each
+// insert, the pointers of deleted lines and the old pointer of a replaced
+// line. Undoing a step replays its records backwards, so it costs as much
+// as the change did. Steps are kept oldest first until the lines they hold
+// pass UNDO_MEMORY_LIMIT bytes (see ed.h); the latest step is always kept.
+
+enum
+{
+    UNDO_INSERT,  // n lines were inserted at 'at'
+    UNDO_DELETE,  // lines[0..n) were removed from 'at'
+    UNDO_REPLACE, // line 'at' replaced lines[0]
+};
+
+typedef struct
+{
+    int kind;
+    int at;
+    int n;
+    char **lines; // Lines owned by the record, NULL for UNDO_INSERT
+} UndoRecord;
+
+typedef struct
+{
+    UndoRecord *recs;
+    int num_recs;
+    int cap;
+    size_t bytes;     // Memory held by the step
+    int current_line; // Editor state when the step was opened
+    int marks[26];
+} UndoStep;
+
+typedef struct UndoJournal
+{
+    UndoStep *steps; // Oldest first
+    int num_steps;
+    int cap;
+    int open;        // steps[num_steps - 1] is recording changes
+    size_t bytes;    // Memory held by all steps
+} UndoJournal;
+
+char *ed_line(const Editor *ed, int i)
+{
+    return i < ed->gap ? ed->lines[i] : ed->lines[i + ed->gap_len];
+}
+
+static void store_set(Editor *ed, int i, char *line)
 {
-    if (ed->undo_lines)
+    if (i < ed->gap)
+        ed->lines[i] = line;
+    else
+        ed->lines[i + ed->gap_len] = line;
+}
+
+static void move_gap(Editor *ed, int pos)
+{
+    if (ed->gap_len > 0 && pos < ed->gap)
+        memmove(ed->lines + pos + ed->gap_len, ed->lines + pos, (ed->gap - pos) * sizeof(char *));
+    else if (ed->gap_len > 0 && pos > ed->gap)
+        memmove(ed->lines + ed->gap, ed->lines + ed->gap + ed->gap_len, (pos - ed->gap) * sizeof(char *));
+    ed->gap = pos;
+}
+
+// Resize the store to 'size' slots, keeping the gap where it is
+static void resize_store(Editor *ed, int size)
+{
+    int after = ed->num_lines - ed->gap;
+    if (size < ed->num_lines + ed->gap_len)
+        memmove(ed->lines + size - after, ed->lines + ed->gap + ed->gap_len, after * sizeof(char *));
+    char **new_lines = realloc(ed->lines, size * sizeof(char *));
+    if (new_lines == NULL)
+        critical_error(ed);
+    if (size > ed->num_lines + ed->gap_len)
+        memmove(new_lines + size - after, new_lines + ed->gap + ed->gap_len, after * sizeof(char *));
+    ed->lines = new_lines;
+    ed->gap_len = size - ed->num_lines;
+}
+
+static void store_insert(Editor *ed, int at, char *const *src, int n)
+{
+    move_gap(ed, at);
+    if (ed->gap_len < n)
+    {
+        // Grow geometrically so appending line by line stays amortized O(1)
+        int size = 2 * (ed->num_lines + ed->gap_len);
+        if (size < ed->num_lines + n)
+            size = ed->num_lines + n;
+        if (size < 16)
+            size = 16;
+        resize_store(ed, size);
+    }
+    memcpy(ed->lines + ed->gap, src, n * sizeof(char *));
+    ed->gap += n;
+    ed->gap_len -= n;
+    ed->num_lines += n;
+}
+
+// Take n lines from line 'at' on out of the store into out[0..n), or drop them if it is NULL
+static void store_remove(Editor *ed, int at, int n, char **out)
+{
+    move_gap(ed, at);
+    if (out)
+        memcpy(out, ed->lines + ed->gap + ed->gap_len, n * sizeof(char *));
+    ed->gap_len += n;
+    ed->num_lines -= n;
+    if (ed->num_lines == 0)
+    {
+        free(ed->lines);
+        ed->lines = NULL;
+        ed->gap = 0;
+        ed->gap_len = 0;
+    }
+    else if (ed->gap_len > 3 * ed->num_lines && ed->num_lines + ed->gap_len > 64)
     {
-        for (int i = 0; i < ed->undo_num_lines; i++)
-            free(ed->undo_lines[i]);
-        free(ed->undo_lines);
-        ed->undo_lines = NULL;
+        // Mostly gap after a large delete: give the memory back
+        resize_store(ed, 2 * ed->num_lines);
     }
-    ed->undo_num_lines = 0;
-    ed->undo_current_line = ed->current_line;
-    // Only allocate/copy when there are lines to snapshot
-    if (ed->num_lines > 0)
+}
+
+// The step recording changes, or NULL if none is open
+static UndoStep *undo_step(Editor *ed)
+{
+    UndoJournal *j = ed->undo;
+    return j && j->open ? &j->steps[j->num_steps - 1] : NULL;
+}
+
+static size_t lines_bytes(char *const *lines, int n)
+{
+    size_t bytes = n * sizeof(char *);
+    for (int i = 0; i < n; i++)
+        bytes += strlen(lines[i]) + 1;
+    return bytes;
+}
+
+// Add a record to the open step; 'lines' is copied and owned by the record
+static void undo_record(Editor *ed, UndoStep *step, int kind, int at, char *const *lines, int n)
+{
+    UndoRecord *last = step->num_recs > 0 ? &step->recs[step->num_recs - 1] : NULL;
+    if (kind == UNDO_INSERT && last && last->kind == UNDO_INSERT && at == last->at + last->n)
     {
-        ed->undo_lines = (char **)malloc(ed->num_lines * sizeof(char *));
-        if (!ed->undo_lines)
+        // Text entered line by line is one record
+        last->n += n;
+        return;
+    }
+    if (step->num_recs == step->cap)
+    {
+        int cap = step->cap ? 2 * step->cap : 4;
+        UndoRecord *recs = realloc(step->recs, cap * sizeof(UndoRecord));
+        if (!recs)
+            critical_error(ed);
+        step->recs = recs;
+        step->cap = cap;
+    }
+    UndoRecord *rec = &step->recs[step->num_recs++];
+    rec->kind = kind;
+    rec->at = at;
+    rec->n = n;
+    rec->lines = NULL;
+    size_t bytes = sizeof(UndoRecord);
+    if (lines)
+    {
+        rec->lines = malloc(n * sizeof(char *));
+        if (!rec->lines)
+            critical_error(ed);
+        memcpy(rec->lines, lines, n * sizeof(char *));
+        bytes += lines_bytes(lines, n);
+    }
+    step->bytes += bytes;
+    ed->undo->bytes += bytes;
+}
+
+// Replace line i, freeing the old line
+void ed_set_line(Editor *ed, int i, char *line)
+{
+    char *old = ed_line(ed, i);
+    UndoStep *step = undo_step(ed);
+    if (step)
+        undo_record(ed, step, UNDO_REPLACE, i, &old, 1);
+    else
+        free(old);
+    store_set(ed, i, line);
+}
+
+// Insert n lines before line 'at', taking ownership of them
+void ed_insert_lines(Editor *ed, int at, char *const *src, int n)
+{
+    if (n <= 0)
+        return;
+    UndoStep *step = undo_step(ed);
+    if (step)
+        undo_record(ed, step, UNDO_INSERT, at, NULL, n);
+    store_insert(ed, at, src, n);
+}
+
+// Remove n lines from line 'at' on, handing them to 'out' or freeing them if it is NULL
+void ed_remove_lines(Editor *ed, int at, int n, char **out)
+{
+    if (n <= 0)
+        return;
+    char **removed = out ? out : malloc(n * sizeof(char *));
+    if (!removed)
+        critical_error(ed);
+    store_remove(ed, at, n, removed);
+    UndoStep *step = undo_step(ed);
+    if (step && out)
+    {
+        // The caller keeps the lines, the journal gets copies of them
+        char **copies = malloc(n * sizeof(char *));
+        if (!copies)
             critical_error(ed);
-        for (int i = 0; i < ed->num_lines; i++)
+        for (int i = 0; i < n; i++)
         {
-            ed->undo_lines[i] = my_strdup(ed->lines[i]);
-            if (!ed->undo_lines[i])
+            copies[i] = my_strdup(out[i]);
+            if (!copies[i])
                 critical_error(ed);
         }
-        ed->undo_num_lines = ed->num_lines;
+        undo_record(ed, step, UNDO_DELETE, at, copies, n);
+        free(copies);
+    }
+    else if (step)
+        undo_record(ed, step, UNDO_DELETE, at, removed, n);
+    else if (!out)
+    {
+        for (int i = 0; i < n; i++)
+            free(removed[i]);
+    }
+    if (!out)
+        free(removed);
+}
+
+static void free_step(UndoStep *step)
+{
+    for (int r = 0; r < step->num_recs; r++)
+    {
+        UndoRecord *rec = &step->recs[r];
+        if (rec->lines)
+        {
+            for (int i = 0; i < rec->n; i++)
+                free(rec->lines[i]);
+            free(rec->lines);
+        }
     }
+    free(step->recs);
+}
+
+static void free_undo(Editor *ed)
+{
+    UndoJournal *j = ed->undo;
+    if (!j)
+        return;
+    for (int s = 0; s < j->num_steps; s++)
+        free_step(&j->steps[s]);
+    free(j->steps);
+    free(j);
+    ed->undo = NULL;
+}
+
+// Close the open step, dropping it if nothing changed
+static void close_undo_step(Editor *ed)
+{
+    UndoJournal *j = ed->undo;
+    if (!j || !j->open)
+        return;
+    j->open = 0;
+    if (j->steps[j->num_steps - 1].num_recs == 0)
+    {
+        free_step(&j->steps[j->num_steps - 1]);
+        j->num_steps--;
+    }
+}
+
+// Start an undo step for a command about to change the buffer. Commands run
+// while undo_hold is set (the lines of c, the commands of g) join the step
+// of the command holding it.
+static void prepare_undo(Editor *ed)
+{
     ed->undo_valid = 1;
+    if (ed->undo_hold > 0 && undo_step(ed))
+        return;
+    close_undo_step(ed);
+    UndoJournal *j = ed->undo;
+    if (!j)
+    {
+        j = calloc(1, sizeof(UndoJournal));
+        if (!j)
+            critical_error(ed);
+        ed->undo = j;
+    }
+    // Forget the oldest steps once the journal holds too much
+    int drop = 0;
+    while (drop < j->num_steps - 1 && j->bytes > UNDO_MEMORY_LIMIT)
+    {
+        j->bytes -= j->steps[drop].bytes;
+        free_step(&j->steps[drop++]);
+    }
+    if (drop > 0)
+    {
+        j->num_steps -= drop;
+        memmove(j->steps, j->steps + drop, j->num_steps * sizeof(UndoStep));
+    }
+    if (j->num_steps == j->cap)
+    {
+        int cap = j->cap ? 2 * j->cap : 8;
+        UndoStep *steps = realloc(j->steps, cap * sizeof(UndoStep));
+        if (!steps)
+            critical_error(ed);
+        j->steps = steps;
+        j->cap = cap;
+    }
+    UndoStep *step = &j->steps[j->num_steps++];
+    memset(step, 0, sizeof(*step));
+    step->current_line = ed->current_line;
+    memcpy(step->marks, ed->marks, sizeof(step->marks));
+    j->open = 1;
+}
+
+// Revert the latest step that changed the buffer; returns 0 if there is none
+int ed_undo(Editor *ed)
+{
+    close_undo_step(ed);
+    UndoJournal *j = ed->undo;
+    if (!j || j->num_steps == 0)
+    {
+        ed->undo_valid = 0;
+        return 0;
+    }
+    UndoStep *step = &j->steps[--j->num_steps];
+    for (int r = step->num_recs - 1; r >= 0; r--)
+    {
+        UndoRecord *rec = &step->recs[r];
+        if (rec->kind == UNDO_INSERT)
+        {
+            for (int i = 0; i < rec->n; i++)
+                free(ed_line(ed, rec->at + i));
+            store_remove(ed, rec->at, rec->n, NULL);
+        }
+        else if (rec->kind == UNDO_DELETE)
+        {
+            // The lines go back into the store
+            store_insert(ed, rec->at, rec->lines, rec->n);
+            free(rec->lines);
+            rec->lines = NULL;
+        }
+        else
+        {
+            free(ed_line(ed, rec->at));
+            store_set(ed, rec->at, rec->lines[0]);
+            free(rec->lines);
+            rec->lines = NULL;
+        }
+    }
+    ed->current_line = step->current_line;
+    memcpy(ed->marks, step->marks, sizeof(ed->marks));
+    j->bytes -= step->bytes;
+    free_step(step);
+    ed->undo_valid = j->num_steps > 0;
+    ed->dirty = 1;
+    return 1;
 }
 // Exposed in header as well
-void substitute_range(Editor *ed, AddressRange range, const char *pattern, const char *replacement, int global);
+void substitute_range(Editor *ed, AddressRange range, const char *pattern, const char *replacement, int flags);
 void set_verbose(Editor *ed, int on)
 {
     ed->verbose = on ? 1 : 0;
@@ -179,8 +516,22 @@ char *my_strdup(const char *s)
     return dup;
 }
 
+// Compiled program for a pattern from the editor's cache, NULL if the pattern is invalid.
+// Give it back with bre_cache_release(ed->re_cache, prog) when done.
+static const BreProgram *get_regex(Editor *ed, const char *pattern, int flags)
+{
+    if (!ed->re_cache)
+    {
+        ed->re_cache = bre_cache_new(0);
+        if (!ed->re_cache)
+            critical_error(ed);
+    }
+    return bre_cache_get(ed->re_cache, pattern, flags);
+}
+
 // Search helper for regex addresses: returns 1-based line number or 0 if not found
-static int search_pattern(Editor *ed, const char *pattern, size_t pat_len, bool forward)
+// flags: BRE_* compile flags (BRE_ICASE for /re/I)
+static int search_pattern(Editor *ed, const char *pattern, size_t pat_len, bool forward, int flags)
 {
     if (ed->num_lines == 0)
         return 0;
@@ -192,50 +543,151 @@ static int search_pattern(Editor *ed, const char *pattern, size_t pat_len, bool
     strncpy(pat, pattern, pat_len);
     pat[pat_len] = '\0';
 
-    BreMatch m;
+    // Compile once for the whole scan (and once per session for a repeated search)
+    const BreProgram *prog = get_regex(ed, pat, flags);
+    if (!prog)
+        return 0;
+
     int start = (ed->current_line >= 0) ? ed->current_line : 0;
+    int found = 0;
 
     if (forward)
     {
         // Search forward from current+1, wrapping
-        for (int idx = start + 1; idx < ed->num_lines; idx++)
+        for (int idx = start + 1; idx < ed->num_lines && !found; idx++)
         {
-            if (bre_match(ed->lines[idx], pat, &m) == BRE_OK)
-            {
-                return idx + 1; // Return 1-based
-            }
+            if (bre_test(prog, ed_line(ed, idx)) == BRE_OK)
+                found = idx + 1; // Return 1-based
         }
         // Wrap to beginning
-        for (int idx = 0; idx <= start; idx++)
+        for (int idx = 0; idx <= start && !found; idx++)
         {
-            if (bre_match(ed->lines[idx], pat, &m) == BRE_OK)
-            {
-                return idx + 1; // Return 1-based
-            }
+            if (bre_test(prog, ed_line(ed, idx)) == BRE_OK)
+                found = idx + 1; // Return 1-based
         }
     }
     else
     {
         // Search backward from current-1, wrapping
-        for (int idx = start - 1; idx >= 0; idx--)
+        for (int idx = start - 1; idx >= 0 && !found; idx--)
         {
-            if (bre_match(ed->lines[idx], pat, &m) == BRE_OK)
-            {
-                return idx + 1; // Return 1-based
-            }
+            if (bre_test(prog, ed_line(ed, idx)) == BRE_OK)
+                found = idx + 1; // Return 1-based
         }
         // Wrap to end
-        for (int idx = ed->num_lines - 1; idx >= start; idx--)
+        for (int idx = ed->num_lines - 1; idx >= start && !found; idx--)
+        {
+            if (bre_test(prog, ed_line(ed, idx)) == BRE_OK)
+                found = idx + 1; // Return 1-based
+        }
+    }
+
+    bre_cache_release(ed->re_cache, prog);
+    return found; // 0 if not found
+}
+
+// An empty pattern stands for the previous one, as in // or s//x/. Fills in an
+// empty 'pat' of 'size' bytes and adds its BRE_* flags to *flags, or remembers
+// a non-empty one. Returns false if there is no previous pattern yet.
+static bool previous_pattern(Editor *ed, char *pat, size_t size, int *flags)
+{
+    if (pat[0] == '\0')
+    {
+        if (!ed->last_pattern)
+            return false;
+        snprintf(pat, size, "%s", ed->last_pattern);
+        *flags |= ed->last_pattern_flags;
+        return true;
+    }
+    char *copy = my_strdup(pat);
+    if (!copy)
+        critical_error(ed);
+    free(ed->last_pattern);
+    ed->last_pattern = copy;
+    ed->last_pattern_flags = *flags;
+    return true;
+}
+
+// Regex address /re/ or ?re? at *pp, with the optional I suffix (non-POSIX) to
+// match ignoring case. Returns the 1-based line found, 0 if none matched or -1
+// if the pattern is unterminated or empty with no previous one, and moves *pp
+// past the address.
+static int regex_address(Editor *ed, const char **pp)
+{
+    const char *p = *pp;
+    char delim = *p++;
+    char pattern[MAX_LINE];
+    size_t i = 0;
+    while (*p && *p != delim && i < sizeof(pattern) - 1)
+        pattern[i++] = *p++;
+    if (*p != delim)
+        return -1;
+    pattern[i] = '\0';
+    p++; // Skip closing delimiter
+    int flags = 0;
+    if (*p == 'I')
+    {
+        flags |= BRE_ICASE;
+        p++;
+    }
+    if (!previous_pattern(ed, pattern, sizeof(pattern), &flags))
+        return -1;
+    *pp = p;
+    return search_pattern(ed, pattern, strlen(pattern), delim == '/', flags);
+}
+
+#ifndef LED_TEST
+// parse_ed_address() has no editor to search with: replace each regex address
+// in the address part of buf with the number of the line it finds. In a;b the
+// first address becomes the current line before b is searched for. Returns
+// false, with the error set, if a search fails.
+static bool resolve_regex_addresses(Editor *ed, char *buf, size_t size)
+{
+    char *p = buf;
+    for (int n = 0; n < 2; n++)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        char *addr = p;
+        if (*p == '/' || *p == '?')
         {
-            if (bre_match(ed->lines[idx], pat, &m) == BRE_OK)
+            const char *end = p;
+            int found = regex_address(ed, &end);
+            if (found <= 0)
             {
-                return idx + 1; // Return 1-based
+                set_error(ed, found < 0 ? "Invalid address" : "No match");
+                return false;
             }
+            char num[16];
+            size_t len = (size_t)snprintf(num, sizeof(num), "%d", found);
+            size_t rest = strlen(end) + 1;
+            if ((size_t)(p - buf) + len + rest > size)
+            {
+                set_error(ed, "Line too long");
+                return false;
+            }
+            memmove(p + len, end, rest);
+            memcpy(p, num, len);
+        }
+        // Rest of this address (a number, offsets, a mark), then a second one after ',' or ';'
+        while (isdigit((unsigned char)*p) || *p == '+' || *p == '-' || *p == '.' || *p == '$' || *p == ' ' ||
+               *p == '\t' || (*p == '\'' && p[1]))
+            p += (*p == '\'') ? 2 : 1;
+        if (*p != ',' && *p != ';')
+            break;
+        if (*p == ';' && p > addr)
+        {
+            // An invalid first address is left for parse_ed_address() to report
+            const char *q = addr;
+            int line = parse_one_address(&q, ed->current_line + 1, ed->num_lines, ed->marks);
+            if (line > 0 && line <= ed->num_lines)
+                ed->current_line = line - 1;
         }
+        p++;
     }
-
-    return 0; // Not found
+    return true;
 }
+#endif
 
 /* Parse a single address component.
  * Returns:
@@ -371,7 +823,7 @@ apply_offset:
  * Sets:
  *   addr1 → first address  (1-based, or 0 if none)
  *   addr2 → second address (1-based, or 0 if none)
- *   have_comma → true if range like "1,10" was seen
+ *   have_comma → true if range like "1,10" or "1;10" was seen
  */
 const char *parse_ed_address(const char *line, int *addr1, int *addr2, bool *have_comma, int current_line,
                              int last_line, const int marks[26])
@@ -398,7 +850,7 @@ const char *parse_ed_address(const char *line, int *addr1, int *addr2, bool *hav
         // No first address - check if there's a comma
         // If no comma, we're done (addr1 remains 0)
         // If comma, continue to parse range
-        if (*p != ',')
+        if (*p != ',' && *p != ';')
         {
             return p;
         }
@@ -438,6 +890,22 @@ const char *parse_ed_address(const char *line, int *addr1, int *addr2, bool *hav
             *addr2 = a2;
         }
     }
+    else if (*p == ';')
+    {
+        // Like ',', but the second address counts from the first: ";" is ".,$"
+        p++;
+        *have_comma = true;
+        if (*addr1 == 0)
+            *addr1 = current_line;
+
+        while (*p == ' ' || *p == '\t')
+            p++;
+
+        int a2 = parse_one_address(&p, *addr1, last_line, marks);
+        if (a2 == ADDR_ERROR)
+            return NULL;
+        *addr2 = (a2 == ADDR_NONE) ? last_line : a2;
+    }
     else
     {
         // No comma → if there was a first address, default second = first
@@ -556,8 +1024,8 @@ static void emergency_save(Editor *ed)
     int bytes = 0;
     for (int i = 0; i < ed->num_lines; i++)
     {
-        fprintf(fp, "%s\n", ed->lines[i]);
-        bytes += strlen(ed->lines[i]) + 1;
+        fprintf(fp, "%s\n", ed_line(ed, i));
+        bytes += strlen(ed_line(ed, i)) + 1;
     }
     fclose(fp);
     PRINTF("Saved %d bytes.\n", bytes);
@@ -584,6 +1052,8 @@ void init_editor(Editor *ed)
 {
     ed->lines = NULL;
     ed->num_lines = 0;
+    ed->gap = 0;
+    ed->gap_len = 0;
     ed->current_line = -1; // 0-indexed: -1 means before first line
     ed->dirty = 0;
     ed->filename = NULL;
@@ -592,10 +1062,12 @@ void init_editor(Editor *ed)
     for (int i = 0; i < 26; i++)
         ed->marks[i] = -1;
     ed->prompt = 0;
-    ed->undo_lines = NULL;
-    ed->undo_num_lines = 0;
-    ed->undo_current_line = 0;
+    ed->undo = NULL;
+    ed->undo_hold = 0;
     ed->undo_valid = 0;
+    ed->re_cache = NULL;
+    ed->last_pattern = NULL;
+    ed->last_pattern_flags = 0;
 }
 
 // Legacy parse_address function - kept for backward compatibility
@@ -614,25 +1086,10 @@ int parse_address(Editor *ed, const char *addr)
     // Special case: handle regex addresses /pattern/ or ?pattern?
     if (*addr == '/' || *addr == '?')
     {
-        char delim = *addr;
-        const char *p = addr + 1;
-        char pattern[MAX_LINE];
-        size_t i = 0;
-
-        // Extract pattern
-        while (*p && *p != delim && i < sizeof(pattern) - 1)
-        {
-            pattern[i++] = *p++;
-        }
-        if (*p != delim)
-            return -1; // Unterminated pattern
-        pattern[i] = '\0';
-        p++; // Skip closing delimiter
-
-        // Search for pattern
-        int found = search_pattern(ed, pattern, i, delim == '/');
-        if (found == 0)
-            return -1; // Not found
+        const char *p = addr;
+        int found = regex_address(ed, &p);
+        if (found <= 0)
+            return -1; // Not found or unterminated
 
         // Handle optional offset after closing delimiter
         if (*p)
@@ -753,6 +1210,11 @@ AddressRange parse_address_range(Editor *ed, const char *range_str)
 void append_line(Editor *ed, int addr)
 {
     prepare_undo(ed);
+    if (addr < -1 || addr >= ed->num_lines)
+    {
+        set_error(ed, "Invalid address");
+        return;
+    }
     int original_num_lines = ed->num_lines;
     int first_insert_pos = addr + 1; // Where first line will be inserted (0-indexed)
     int last_inserted_index = -1;
@@ -771,19 +1233,7 @@ void append_line(Editor *ed, int addr)
             break;
         }
         // Insert after addr: result position is addr+1
-        char **new_lines = realloc(ed->lines, (ed->num_lines + 1) * sizeof(char *));
-        if (new_lines == NULL)
-        {
-            free(line);
-            critical_error(ed);
-        }
-        ed->lines = new_lines;
-        for (int i = ed->num_lines; i > addr + 1; i--)
-        {
-            ed->lines[i] = ed->lines[i - 1];
-        }
-        ed->lines[addr + 1] = line; // already allocated
-        ed->num_lines++;
+        ed_insert_lines(ed, addr + 1, &line, 1); // already allocated
         addr++;
         last_inserted_index = addr;
         num_inserted++;
@@ -819,6 +1269,11 @@ void append_line(Editor *ed, int addr)
 void insert_line(Editor *ed, int addr)
 {
     prepare_undo(ed);
+    if (addr < 0 || addr > ed->num_lines)
+    {
+        set_error(ed, "Invalid address");
+        return;
+    }
     int original_num_lines = ed->num_lines;
     int first_insert_pos = addr; // Where first line will be inserted (0-indexed)
     int last_inserted_index = -1;
@@ -836,19 +1291,7 @@ void insert_line(Editor *ed, int addr)
             free(line);
             break;
         }
-        char **new_lines = realloc(ed->lines, (ed->num_lines + 1) * sizeof(char *));
-        if (new_lines == NULL)
-        {
-            free(line);
-            critical_error(ed);
-        }
-        ed->lines = new_lines;
-        for (int i = ed->num_lines; i > addr; i--)
-        {
-            ed->lines[i] = ed->lines[i - 1];
-        }
-        ed->lines[addr] = line;
-        ed->num_lines++;
+        ed_insert_lines(ed, addr, &line, 1);
         last_inserted_index = addr;
         addr++;
         num_inserted++;
@@ -879,7 +1322,7 @@ void print_line(Editor *ed, int addr)
         set_error(ed, "Invalid address");
         return;
     }
-    PRINTF("%s\n", ed->lines[addr]);
+    PRINTF("%s\n", ed_line(ed, addr));
     ed->current_line = addr; // 0-indexed
 }
 
@@ -898,7 +1341,7 @@ void print_range(Editor *ed, AddressRange range)
     }
     for (int i = range.start; i <= range.end; i++)
     {
-        PRINTF("%s\n", ed->lines[i]);
+        PRINTF("%s\n", ed_line(ed, i));
     }
     ed->current_line = range.end; // 0-indexed
 }
@@ -918,7 +1361,7 @@ void print_numbered_range(Editor *ed, AddressRange range)
     }
     for (int i = range.start; i <= range.end; i++)
     {
-        PRINTF("%d\t%s\n", i + 1, ed->lines[i]); // Display 1-based to user
+        PRINTF("%d\t%s\n", i + 1, ed_line(ed, i)); // Display 1-based to user
     }
     ed->current_line = range.end; // 0-indexed
 }
@@ -938,7 +1381,7 @@ void print_list_range(Editor *ed, AddressRange range)
     }
     for (int i = range.start; i <= range.end; i++)
     {
-        const char *line = ed->lines[i];
+        const char *line = ed_line(ed, i);
         for (size_t j = 0; j < strlen(line); j++)
         {
             unsigned char c = (unsigned char)line[j];
@@ -972,26 +1415,7 @@ void delete_line(Editor *ed, int addr)
         set_error(ed, "Invalid address");
         return;
     }
-    free(ed->lines[addr]);
-    for (int i = addr; i < ed->num_lines - 1; i++)
-    {
-        ed->lines[i] = ed->lines[i + 1];
-    }
-    ed->num_lines--;
-    if (ed->num_lines == 0)
-    {
-        free(ed->lines);
-        ed->lines = NULL;
-    }
-    else
-    {
-        char **new_lines = realloc(ed->lines, ed->num_lines * sizeof(char *));
-        if (new_lines == NULL)
-        {
-            critical_error(ed);
-        }
-        ed->lines = new_lines;
-    }
+    ed_remove_lines(ed, addr, 1, NULL);
     // Set current to next line, or last line if at end (0-indexed)
     ed->current_line = (addr < ed->num_lines) ? addr : ed->num_lines - 1;
     if (ed->current_line < 0)
@@ -1017,35 +1441,16 @@ void delete_range(Editor *ed, AddressRange range)
         return;
     }
 
-    // Free lines in range
-    for (int i = range.start; i <= range.end; i++)
-    {
-        free(ed->lines[i]);
-    }
-
-    // Shift remaining lines down
+    // Free the lines in range
     int num_deleted = range.end - range.start + 1;
-    for (int i = range.start; i < ed->num_lines - num_deleted; i++)
-    {
-        ed->lines[i] = ed->lines[i + num_deleted];
-    }
-
-    ed->num_lines -= num_deleted;
+    ed_remove_lines(ed, range.start, num_deleted, NULL);
 
     if (ed->num_lines == 0)
     {
-        free(ed->lines);
-        ed->lines = NULL;
         ed->current_line = -1; // Empty buffer (0-indexed)
     }
     else
     {
-        char **new_lines = realloc(ed->lines, ed->num_lines * sizeof(char *));
-        if (new_lines == NULL)
-        {
-            critical_error(ed);
-        }
-        ed->lines = new_lines;
         // Set current line to line after deleted range, or last line if at end (0-indexed)
         ed->current_line = (range.start < ed->num_lines) ? range.start : ed->num_lines - 1;
     }
@@ -1077,8 +1482,8 @@ void write_file(Editor *ed, const char *filename)
     int bytes = 0;
     for (int i = 0; i < ed->num_lines; i++)
     {
-        fprintf(fp, "%s\n", ed->lines[i]);
-        bytes += strlen(ed->lines[i]) + 1; // Include newline
+        fprintf(fp, "%s\n", ed_line(ed, i));
+        bytes += strlen(ed_line(ed, i)) + 1; // Include newline
     }
     fclose(fp);
     PRINTF("%d\n", bytes);
@@ -1105,28 +1510,26 @@ void free_editor(Editor *ed)
         return;
     for (int i = 0; i < ed->num_lines; i++)
     {
-        free(ed->lines[i]);
+        free(ed_line(ed, i));
     }
     free(ed->lines);
     ed->lines = NULL;
+    ed->gap = 0;
+    ed->gap_len = 0;
     free(ed->filename);
     ed->filename = NULL;
     if (ed->last_error)
         free(ed->last_error);
     ed->last_error = NULL;
-    if (ed->undo_lines)
-    {
-        for (int i = 0; i < ed->undo_num_lines; i++)
-            free(ed->undo_lines[i]);
-        free(ed->undo_lines);
-        ed->undo_lines = NULL;
-    }
+    free_undo(ed);
+    bre_cache_free(ed->re_cache);
+    ed->re_cache = NULL;
+    free(ed->last_pattern);
+    ed->last_pattern = NULL;
     ed->num_lines = 0;
     ed->current_line = 0;
     ed->dirty = 0;
     ed->verbose = 0;
-    ed->undo_num_lines = 0;
-    ed->undo_current_line = 0;
     ed->undo_valid = 0;
     for (int i = 0; i < 26; i++)
         ed->marks[i] = -1;
@@ -1145,6 +1548,9 @@ static void execute_command(Editor *ed, const char *cmd)
     if (cmd_buf[0] == '\0')
         return;
 
+    if (!resolve_regex_addresses(ed, cmd_buf, sizeof(cmd_buf)))
+        return;
+
     // Use the new parser to find where the address portion ends
     int addr1 = 0, addr2 = 0;
     bool have_comma = false;
@@ -1219,6 +1625,13 @@ static void execute_command(Editor *ed, const char *cmd)
         }
         pat[i] = '\0';
         p++; // skip closing '/'
+        // Optional I suffix (non-POSIX): match ignoring case
+        int re_flags = 0;
+        if (*p == 'I')
+        {
+            re_flags |= BRE_ICASE;
+            p++;
+        }
         // Skip leading spaces before inner command
         while (*p == ' ')
             p++;
@@ -1249,19 +1662,34 @@ static void execute_command(Editor *ed, const char *cmd)
             set_error(ed, "Invalid address");
             return;
         }
+        if (!previous_pattern(ed, pat, sizeof(pat), &re_flags))
+        {
+            set_error(ed, "No previous pattern");
+            return;
+        }
+        const BreProgram *prog = get_regex(ed, pat, re_flags);
+        if (!prog)
+        {
+            set_error(ed, "Invalid regular expression");
+            return;
+        }
         // Collect target line indices first
         int cap = (r.end - r.start + 1);
         int *idxs = (int *)malloc(cap * sizeof(int));
         if (!idxs)
             critical_error(ed);
         int n = 0;
-        BreMatch m;
         for (int i2 = r.start; i2 <= r.end; i2++)
         {
-            bool matched = bre_match(ed->lines[i2], pat, &m) == BRE_OK;
+            bool matched = bre_test(prog, ed_line(ed, i2)) == BRE_OK;
             if ((is_g && matched) || (!is_g && !matched))
                 idxs[n++] = i2;
         }
+        bre_cache_release(ed->re_cache, prog);
+        // The commands run on the matching lines are undone as one step
+        prepare_undo(ed);
+        int hold = ed->undo_hold;
+        ed->undo_hold = hold + 1;
         // If inner begins a brace-enclosed list, read commands until a line with only '}'
         if (inner[0] == '{' && inner[1] == '\0')
         {
@@ -1420,6 +1848,7 @@ static void execute_command(Editor *ed, const char *cmd)
                 free(list[qi]);
             free(list);
             free(idxs);
+            ed->undo_hold = hold;
             return;
         }
         else
@@ -1459,6 +1888,7 @@ static void execute_command(Editor *ed, const char *cmd)
                 }
             }
             free(idxs);
+            ed->undo_hold = hold;
             return;
         }
     }
@@ -1493,11 +1923,13 @@ static void execute_command(Editor *ed, const char *cmd)
         }
         replacement[i] = '\0';
         p++; // skip '/'
-        int global = 0;
+        int flags = 0;
         while (*p)
         {
             if (*p == 'g')
-                global = 1;
+                flags |= SUB_GLOBAL;
+            else if (*p == 'I')
+                flags |= SUB_ICASE;
             else
             {
                 set_error(ed, "Invalid flag");
@@ -1505,6 +1937,14 @@ static void execute_command(Editor *ed, const char *cmd)
             }
             p++;
         }
+        int re_flags = (flags & SUB_ICASE) ? BRE_ICASE : 0;
+        if (!previous_pattern(ed, pattern, sizeof(pattern), &re_flags))
+        {
+            set_error(ed, "No previous pattern");
+            return;
+        }
+        if (re_flags & BRE_ICASE)
+            flags |= SUB_ICASE;
 
         // Build range from parsed addresses
         AddressRange range;
@@ -1533,7 +1973,7 @@ static void execute_command(Editor *ed, const char *cmd)
             set_error(ed, "Invalid address");
             return;
         }
-        substitute_range(ed, range, pattern, replacement, global);
+        substitute_range(ed, range, pattern, replacement, flags);
         return;
     }
 
@@ -1884,7 +2324,7 @@ static void execute_command(Editor *ed, const char *cmd)
         addr = addr1 - 1; // Convert from 1-based to 0-based
     }
 
-    if (addr < 0 && op != 'a' && op != 'i' && op != 'q' && op != 'Q' && op != 'H' && op != 'h')
+    if (addr < 0 && op != 'a' && op != 'i' && op != 'u' && op != 'q' && op != 'Q' && op != 'H' && op != 'h')
     {
         set_error(ed, "Invalid address");
         return;
@@ -1899,26 +2339,9 @@ static void execute_command(Editor *ed, const char *cmd)
         insert_line(ed, addr < 0 ? 0 : addr);
         break;
     case 'u':
-        if (!ed->undo_valid)
-        {
+        // Each u reverts one more command
+        if (!ed_undo(ed))
             set_error(ed, "Nothing to undo");
-            break;
-        }
-        // Swap current buffer with undo snapshot
-        {
-            // Free current lines
-            for (int i = 0; i < ed->num_lines; i++)
-                free(ed->lines[i]);
-            free(ed->lines);
-            ed->lines = ed->undo_lines;
-            ed->num_lines = ed->undo_num_lines;
-            ed->current_line = ed->undo_current_line;
-            ed->undo_lines = NULL;
-            ed->undo_num_lines = 0;
-            ed->undo_current_line = 0;
-            ed->undo_valid = 0;
-            ed->dirty = 1;
-        }
         break;
     case 'q':
         if (ed->dirty)
@@ -1965,16 +2388,7 @@ void load_file(Editor *ed, const char *filename)
         char *line = read_full_line(fp, &had_nl);
         if (!line)
             break;
-        char **new_lines = realloc(ed->lines, (ed->num_lines + 1) * sizeof(char *));
-        if (new_lines == NULL)
-        {
-            free(line);
-            fclose(fp);
-            critical_error(ed);
-        }
-        ed->lines = new_lines;
-        ed->lines[ed->num_lines] = line;
-        ed->num_lines++;
+        ed_insert_lines(ed, ed->num_lines, &line, 1);
         bytes += (int)strlen(line) + (had_nl ? 1 : 0);
         if (!had_nl)
             break; // EOF mid-line
@@ -2041,23 +2455,7 @@ void read_file_at_address(Editor *ed, int addr, const char *filename)
         if (!line)
             break;
 
-        char **new_lines = realloc(ed->lines, (ed->num_lines + 1) * sizeof(char *));
-        if (new_lines == NULL)
-        {
-            free(line);
-            fclose(fp);
-            critical_error(ed);
-        }
-        ed->lines = new_lines;
-
-        // Shift lines down to make room
-        for (int i = ed->num_lines; i > insert_pos; i--)
-        {
-            ed->lines[i] = ed->lines[i - 1];
-        }
-
-        ed->lines[insert_pos] = line;
-        ed->num_lines++;
+        ed_insert_lines(ed, insert_pos, &line, 1);
         insert_pos++;
         num_inserted++;
         bytes += (int)strlen(line) + (had_nl ? 1 : 0);
@@ -2102,8 +2500,8 @@ void write_append_file(Editor *ed, AddressRange range, const char *filename)
     int bytes = 0;
     for (int i = range.start; i <= range.end; i++)
     {
-        fprintf(fp, "%s\n", ed->lines[i]);
-        bytes += strlen(ed->lines[i]) + 1;
+        fprintf(fp, "%s\n", ed_line(ed, i));
+        bytes += strlen(ed_line(ed, i)) + 1;
     }
 
     fclose(fp);
@@ -2125,10 +2523,11 @@ void change_range(Editor *ed, AddressRange range)
         return;
     }
 
-    // Delete the range
+    // Delete the range, then insert where it started, as one undo step
+    int hold = ed->undo_hold;
+    ed->undo_hold = hold + 1;
     delete_range(ed, range);
 
-    // Insert at the position where range started
     int insert_addr = range.start;
     if (insert_addr > ed->num_lines)
         insert_addr = ed->num_lines;
@@ -2136,6 +2535,7 @@ void change_range(Editor *ed, AddressRange range)
         insert_addr = 0;
 
     insert_line(ed, insert_addr);
+    ed->undo_hold = hold;
 }
 
 // Move command: move range to after dest_addr
@@ -2172,16 +2572,8 @@ void move_range(Editor *ed, AddressRange range, int dest_addr)
     if (!moved_lines)
         critical_error(ed);
 
-    for (int i = 0; i < num_lines; i++)
-    {
-        moved_lines[i] = ed->lines[range.start + i];
-    }
-
-    // Remove lines from source (shift lines after range down)
-    for (int i = range.start; i < ed->num_lines - num_lines; i++)
-    {
-        ed->lines[i] = ed->lines[i + num_lines];
-    }
+    // Take the lines out
+    ed_remove_lines(ed, range.start, num_lines, moved_lines);
 
     // Adjust destination if it's after the moved range
     int adjusted_dest = dest_addr;
@@ -2190,17 +2582,8 @@ void move_range(Editor *ed, AddressRange range, int dest_addr)
         adjusted_dest -= num_lines;
     }
 
-    // Make room at destination (shift lines after dest up)
-    for (int i = ed->num_lines - num_lines - 1; i > adjusted_dest; i--)
-    {
-        ed->lines[i + num_lines] = ed->lines[i];
-    }
-
     // Insert moved lines at destination
-    for (int i = 0; i < num_lines; i++)
-    {
-        ed->lines[adjusted_dest + 1 + i] = moved_lines[i];
-    }
+    ed_insert_lines(ed, adjusted_dest + 1, moved_lines, num_lines);
 
     free(moved_lines);
 
@@ -2263,32 +2646,19 @@ void copy_range(Editor *ed, AddressRange range, int dest_addr)
 
     int num_lines = range.end - range.start + 1;
 
-    // Allocate space for new lines
-    char **new_lines = realloc(ed->lines, (ed->num_lines + num_lines) * sizeof(char *));
-    if (!new_lines)
+    // Copy the lines, then insert the copies at destination
+    char **copies = malloc(num_lines * sizeof(char *));
+    if (!copies)
         critical_error(ed);
-    ed->lines = new_lines;
-
-    // Make room at destination (shift lines after dest up)
-    for (int i = ed->num_lines - 1; i > dest_addr; i--)
-    {
-        ed->lines[i + num_lines] = ed->lines[i];
-    }
-
-    // Copy lines to destination
     for (int i = 0; i < num_lines; i++)
     {
-        int src_idx = range.start + i;
-        // Adjust source index if it's after the insertion point
-        if (src_idx > dest_addr)
-            src_idx += num_lines;
-
-        ed->lines[dest_addr + 1 + i] = my_strdup(ed->lines[src_idx]);
-        if (!ed->lines[dest_addr + 1 + i])
+        copies[i] = my_strdup(ed_line(ed, range.start + i));
+        if (!copies[i])
             critical_error(ed);
     }
+    ed_insert_lines(ed, dest_addr + 1, copies, num_lines);
+    free(copies);
 
-    ed->num_lines += num_lines;
     // POSIX: Current line should be set to the last line copied
     ed->current_line = dest_addr + num_lines; // last copied line (0-indexed)
     ed->dirty = 1;
@@ -2322,7 +2692,7 @@ void join_range(Editor *ed, AddressRange range)
     size_t total_len = 0;
     for (int i = range.start; i <= range.end; i++)
     {
-        total_len += strlen(ed->lines[i]);
+        total_len += strlen(ed_line(ed, i));
     }
 
     // Allocate new line
@@ -2334,36 +2704,21 @@ void join_range(Editor *ed, AddressRange range)
     // Concatenate all lines
     for (int i = range.start; i <= range.end; i++)
     {
-        strcat(joined, ed->lines[i]);
-        free(ed->lines[i]);
+        strcat(joined, ed_line(ed, i));
     }
 
     // Replace first line with joined content
-    ed->lines[range.start] = joined;
+    ed_set_line(ed, range.start, joined);
 
     // Remove remaining lines in range
-    int num_removed = range.end - range.start;
-    for (int i = range.start + 1; i < ed->num_lines - num_removed; i++)
-    {
-        ed->lines[i] = ed->lines[i + num_removed];
-    }
-
-    ed->num_lines -= num_removed;
-
-    if (ed->num_lines > 0)
-    {
-        char **new_lines = realloc(ed->lines, ed->num_lines * sizeof(char *));
-        if (!new_lines)
-            critical_error(ed);
-        ed->lines = new_lines;
-    }
+    ed_remove_lines(ed, range.start + 1, range.end - range.start, NULL);
 
     ed->current_line = range.start; // 0-indexed
     ed->dirty = 1;
 }
 
-// Substitute over a range using BRE; if global!=0, replace all occurrences per line
-void substitute_range(Editor *ed, AddressRange range, const char *pattern, const char *replacement, int global)
+// Substitute over a range using BRE; flags are SUB_GLOBAL and SUB_ICASE (see ed.h)
+void substitute_range(Editor *ed, AddressRange range, const char *pattern, const char *replacement, int flags)
 {
     prepare_undo(ed);
     if (range.start < 0 || range.end < 0)
@@ -2382,63 +2737,56 @@ void substitute_range(Editor *ed, AddressRange range, const char *pattern, const
         return;
     }
 
+    const BreProgram *prog = get_regex(ed, pattern, (flags & SUB_ICASE) ? BRE_ICASE : 0);
+    if (!prog)
+    {
+        set_error(ed, "Invalid regular expression");
+        return;
+    }
+
     int any_changed = 0;
-    for (int j = range.start; j <= range.end; j++)
+    int gave_up = 0;
+    BreBuffer buf = {0}; // reused for every line of the range
+    for (int j = range.start; j <= range.end && !gave_up; j++)
     {
-        BreMatch m;
-        if (global)
+        size_t count = 0;
+        const char *line = ed_line(ed, j);
+        BreResult r = bre_substitute_into(prog, line, strlen(line), replacement,
+                                          (flags & SUB_GLOBAL) ? 0 : 1, &buf, &count);
+        if (r == BRE_LIMIT)
         {
-            char *work = my_strdup(ed->lines[j]);
-            if (!work)
-                critical_error(ed);
-            int changed = 0;
-            while (bre_match(work, pattern, &m) == BRE_OK)
-            {
-                char *next = bre_substitute(work, pattern, replacement);
-                if (!next)
-                {
-                    free(work);
-                    critical_error(ed);
-                }
-                if (strcmp(next, work) == 0)
-                {
-                    free(next);
-                    break;
-                }
-                free(work);
-                work = next;
-                changed = 1;
-            }
-            if (changed)
-            {
-                free(ed->lines[j]);
-                ed->lines[j] = work;
-                any_changed = 1;
-            }
-            else
-            {
-                free(work);
-            }
+            // Lines already substituted stay changed, like any other error mid-range
+            gave_up = 1;
+            continue;
         }
-        else
+        if (r != BRE_OK)
         {
-            if (bre_match(ed->lines[j], pattern, &m) == BRE_OK)
-            {
-                char *new_line = bre_substitute(ed->lines[j], pattern, replacement);
-                if (!new_line)
-                    critical_error(ed);
-                free(ed->lines[j]);
-                ed->lines[j] = new_line;
-                any_changed = 1;
-            }
+            bre_buffer_free(&buf);
+            critical_error(ed);
+        }
+        if (count > 0)
+        {
+            char *new_line = my_strdup(buf.data);
+            if (!new_line)
+                critical_error(ed);
+            ed_set_line(ed, j, new_line);
+            any_changed = 1;
         }
     }
+    bre_buffer_free(&buf);
+    bre_cache_release(ed->re_cache, prog);
+    if (any_changed)
+        ed->dirty = 1;
+    if (gave_up)
+    {
+        set_error(ed, "Regular expression too complex");
+        return;
+    }
     if (!any_changed)
     {
         set_error(ed, "No match");
         return;
     }
-    ed->dirty = 1;
     ed->current_line = range.end; // 0-indexed
 }
 
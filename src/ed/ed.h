@@ -15,8 +15,10 @@ typedef struct {
 } AddressRange;
 
 typedef struct {
-    char **lines;
+    char **lines;     // Line store, a gap buffer: read it with ed_line()
     int num_lines;
+    int gap;          // Index in lines where the unused slots start
+    int gap_len;      // Number of unused slots
     int current_line;
     int dirty;
     char *filename;  // Current filename, or NULL if none
@@ -24,16 +26,30 @@ typedef struct {
     char *last_error; // Last error context string (heap allocated)
     int marks[26];    // 'a'..'z' marks -> 0-based line index, -1 if unset
     int prompt;       // prompt toggle (unused in tests)
-    // Single-level undo snapshot
-    char **undo_lines;
-    int undo_num_lines;
-    int undo_current_line;
-    int undo_valid;   // 1 if undo snapshot valid
+    struct UndoJournal *undo; // changes of past commands, for u
+    int undo_hold;    // > 0 while a command groups its sub-commands into one undo step
+    int undo_valid;   // 1 if there may be a command to undo
+    struct BreCache *re_cache; // compiled patterns, created on first use
+    char *last_pattern; // Previous regex, which an empty one stands for (heap allocated), or NULL
+    int last_pattern_flags; // Its BRE_* flags
 } Editor;
 
 void init_editor(Editor *ed);
 void free_editor(Editor *ed);
 
+// Line store access (0-based line indexes). Inserted and set lines are owned by
+// the editor; removed or replaced lines are freed, or handed to 'out' if it is
+// not NULL. Changes are recorded for undo while a command's undo step is open.
+char *ed_line(const Editor *ed, int i);
+void ed_set_line(Editor *ed, int i, char *line);
+void ed_insert_lines(Editor *ed, int at, char *const *src, int n);
+void ed_remove_lines(Editor *ed, int at, int n, char **out);
+
+// Memory the undo journal may hold before it forgets the oldest commands
+#define UNDO_MEMORY_LIMIT (64L * 1024 * 1024)
+// u: revert the latest command that changed the buffer. Returns 0 if there is none.
+int ed_undo(Editor *ed);
+
 // Expose for testing
 int parse_address(Editor *ed, const char *addr);
 AddressRange parse_address_range(Editor *ed, const char *range_str);
@@ -61,8 +77,11 @@ void change_range(Editor *ed, AddressRange range);
 void move_range(Editor *ed, AddressRange range, int dest_addr);
 void copy_range(Editor *ed, AddressRange range, int dest_addr);
 void join_range(Editor *ed, AddressRange range);
-// Substitute command over a range; if global!=0, replace all occurrences per line
-void substitute_range(Editor *ed, AddressRange range, const char *pattern, const char *replacement, int global);
+// Substitute command over a range. flags: SUB_GLOBAL replaces all occurrences per line
+// (s///g; 1 keeps working as before), SUB_ICASE matches ignoring case (s///I)
+#define SUB_GLOBAL 0x01
+#define SUB_ICASE 0x02
+void substitute_range(Editor *ed, AddressRange range, const char *pattern, const char *replacement, int flags);
 // Verbose/error helpers
 void set_verbose(Editor *ed, int on);
 const char *get_last_error(Editor *ed);
@@ -3,8 +3,8 @@
    Licensed under LGPL-2.1 or later
 
    Notes:
-   - This implementation uses a basic regular expression (BRE) engine declared in bre.h.
-   - Extended regular expressions (-E/--extended-regexp) are NOT supported and will error out.
+   - This implementation uses the regular expression engine declared in bre.h, which
+     compiles basic (default, -G) and extended (-E) regular expressions alike.
    - Tries to use only ISO C library facilities (no POSIX/Win32 specific calls).
 */
 
@@ -12,11 +12,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <errno.h>
+#include <time.h>
+#ifndef __STDC_NO_THREADS__
+#include <threads.h>
+#endif
 
 #include "getopt.h"
 #include "bre.h"
+#include "litsearch.h"
 
 typedef struct {
     char **items;
@@ -50,9 +56,9 @@ static void vec_free(StringVec *v) {
 
 static void usage(FILE *stream, const char *progname) {
     fprintf(stream,
-        "Usage: %s [-E|-F] [-i] [-v] [-w] [-x] [-c] [-l] [-n] [-q] [-s] pattern [file...]\n"
-        "   or: %s [-E|-F] [-i] [-v] [-w] [-x] [-c] [-l] [-n] [-q] [-s] -e pattern ... [file...]\n"
-        "   or: %s [-E|-F] [-i] [-v] [-w] [-x] [-c] [-l] [-n] [-q] [-s] -f file ... [file...]\n",
+        "Usage: %s [-E|-F] [-i] [-v] [-w] [-x] [-c] [-l] [-n] [-q] [-s] [-H|-h] [-m NUM] [-j N] [--stats] pattern [file...]\n"
+        "   or: %s [-E|-F] [-i] [-v] [-w] [-x] [-c] [-l] [-n] [-q] [-s] [-H|-h] [-m NUM] [-j N] [--stats] -e pattern ... [file...]\n"
+        "   or: %s [-E|-F] [-i] [-v] [-w] [-x] [-c] [-l] [-n] [-q] [-s] [-H|-h] [-m NUM] [-j N] [--stats] -f file ... [file...]\n",
         progname, progname, progname);
 }
 
@@ -67,54 +73,177 @@ static char *xstrdup(const char *s) {
     return xstrdup_n(s, strlen(s));
 }
 
-static char *tolower_dup_n(const char *s, size_t n) {
-    char *p = (char *)malloc(n + 1);
-    if (!p) return NULL;
-    for (size_t i = 0; i < n; ++i) {
-        unsigned char ch = (unsigned char)s[i];
-        p[i] = (char)tolower(ch);
-    }
-    p[n] = '\0';
-    return p;
+static bool is_word_char(unsigned char ch) {
+    return (isalnum(ch) != 0) || ch == '_';
 }
-static char *tolower_dup(const char *s) {
-    return tolower_dup_n(s, strlen(s));
+
+/* --stats: where a search spends its effort. The counters are kept whether
+   or not they are printed; only the clock is read just for --stats, and then
+   once per block read and once per file rather than per line. */
+typedef struct {
+    unsigned long long bytes; /* read from the input */
+    size_t lines;             /* lines scanned */
+    size_t matched;           /* lines selected, after -v */
+    size_t literal_lines;     /* lines settled by fixed-string search alone */
+    size_t regex_lines;       /* lines handed to the regex engine */
+    size_t regex_calls;       /* calls into the regex engine for them */
+    size_t peak_buffer;       /* largest line buffer */
+    double read_secs;         /* waiting for fread() */
+    double match_secs;        /* matching and writing output */
+} GrepStats;
+
+static void stats_add(GrepStats *total, const GrepStats *st) {
+    total->bytes += st->bytes;
+    total->lines += st->lines;
+    total->matched += st->matched;
+    total->literal_lines += st->literal_lines;
+    total->regex_lines += st->regex_lines;
+    total->regex_calls += st->regex_calls;
+    if (st->peak_buffer > total->peak_buffer) total->peak_buffer = st->peak_buffer;
+    total->read_secs += st->read_secs;
+    total->match_secs += st->match_secs;
 }
 
-static bool is_word_char(unsigned char ch) {
-    return (isalnum(ch) != 0) || ch == '_';
+static void stats_print(const GrepStats *st, int nthreads) {
+    fflush(stdout);
+    fprintf(stderr,
+        "grep: bytes read       %llu\n"
+        "grep: lines scanned    %zu\n"
+        "grep: lines matched    %zu\n"
+        "grep: literal path     %zu lines\n"
+        "grep: regex path       %zu lines, %zu engine calls\n"
+        "grep: read time        %.3f s\n"
+        "grep: match time       %.3f s\n"
+        "grep: peak line buffer %zu bytes\n",
+        st->bytes, st->lines, st->matched, st->literal_lines, st->regex_lines, st->regex_calls,
+        st->read_secs, st->match_secs, st->peak_buffer);
+    if (nthreads > 1) fprintf(stderr, "grep: times are summed over %d threads\n", nthreads);
 }
 
-/* Read one line from stream. Grows buffer as needed.
-   Returns true if a line was read; false on EOF with no data.
-   The returned line is in *buf with length in *len. The line includes the
-   newline character if one was read. Buffer is NUL-terminated. */
-static bool read_line(FILE *f, char **buf, size_t *cap, size_t *len) {
-    if (!*buf || *cap == 0) {
-        *cap = 256;
-        *buf = (char *)malloc(*cap);
-        if (!*buf) return false;
-    }
-    *len = 0;
+/* Wall-clock seconds from an arbitrary origin, for --stats */
+static double now_seconds(void) {
+    struct timespec ts;
+    if (timespec_get(&ts, TIME_UTC) != TIME_UTC) return (double)clock() / CLOCKS_PER_SEC;
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Block-buffered line reader.
+   Input is read with fread() in blocks of GREP_BLOCK_SIZE bytes and lines are
+   found with memchr(), so each line is handed out as a span into the block
+   rather than copied. A line cut by the end of a block is moved to the front
+   before the next block is read; the buffer only grows for lines longer
+   than half of it. */
+#define GREP_BLOCK_SIZE (256 * 1024)
+
+typedef struct {
+    FILE *f;
+    char *buf;
+    size_t cap;     /* allocated size of buf */
+    size_t start;   /* first byte of the next line */
+    size_t scanned; /* bytes from start known to hold no newline */
+    size_t end;     /* bytes of buf filled from the stream */
+    long remaining; /* bytes left to read from the stream, or -1 for all of it */
+    bool eof;
+    bool error;     /* out of memory or a read error */
+    bool timed;     /* --stats: time the reads */
+    bool text;      /* read in binary mode: end lines in \n as a text-mode stream would */
+    bool (*cancel)(void *arg); /* if set and true before a read, stop reading */
+    void *cancel_arg;
+    bool cancelled;
+    unsigned long long bytes; /* read so far */
+    double read_secs;
+} LineReader;
+
+static void reader_init(LineReader *r, FILE *f) {
+    r->f = f;
+    r->buf = NULL;
+    r->cap = 0;
+    r->start = r->scanned = r->end = 0;
+    r->remaining = -1;
+    r->eof = false;
+    r->error = false;
+    r->timed = false;
+    r->text = false;
+    r->cancel = NULL;
+    r->cancel_arg = NULL;
+    r->cancelled = false;
+    r->bytes = 0;
+    r->read_secs = 0;
+}
+
+static void reader_free(LineReader *r) {
+    free(r->buf);
+    r->buf = NULL;
+    r->cap = 0;
+}
+
+/* Next line as a span of the reader's buffer, valid until the next call.
+   Returns true if a line was read; false at end of input or on error.
+   *len includes the newline if the line has one; the span is not
+   NUL-terminated. */
+static bool read_line(LineReader *r, const char **line, size_t *len) {
     for (;;) {
-        int c = fgetc(f);
-        if (c == EOF) {
-            if (*len == 0) return false;
-            (*buf)[*len] = '\0';
+        size_t avail = r->end - r->start;
+        char *nl = (r->scanned < avail) ? (char *)memchr(r->buf + r->start + r->scanned, '\n', avail - r->scanned) : NULL;
+        if (nl) {
+            *line = r->buf + r->start;
+            *len = (size_t)(nl - *line) + 1;
+            r->start += *len;
+            r->scanned = 0;
+#ifdef _WIN32
+            /* Text mode there turns \r\n into \n */
+            if (r->text && *len > 1 && nl[-1] == '\r') {
+                nl[-1] = '\n';
+                --*len;
+            }
+#endif
             return true;
         }
-        if (*len + 1 >= *cap) {
-            size_t ncap = (*cap) * 2;
-            char *nb = (char *)realloc(*buf, ncap);
-            if (!nb) return false;
-            *buf = nb;
-            *cap = ncap;
-        }
-        (*buf)[(*len)++] = (char)c;
-        if (c == '\n') {
-            (*buf)[*len] = '\0';
+        r->scanned = avail;
+        if (r->eof) {
+            if (avail == 0) return false;
+            /* Last line without a newline */
+            *line = r->buf + r->start;
+            *len = avail;
+            r->start = r->end;
+            r->scanned = 0;
             return true;
         }
+
+        /* Another thread may already have the answer */
+        if (r->cancel && r->cancel(r->cancel_arg)) {
+            r->cancelled = true;
+            return false;
+        }
+
+        /* Keep the partial line and fill the rest of the buffer */
+        if (r->start > 0) {
+            memmove(r->buf, r->buf + r->start, avail);
+            r->start = 0;
+            r->end = avail;
+        }
+        if (r->cap - r->end < GREP_BLOCK_SIZE / 2) {
+            size_t ncap = r->cap ? r->cap * 2 : GREP_BLOCK_SIZE;
+            char *nb = (char *)realloc(r->buf, ncap);
+            if (!nb) {
+                r->error = true;
+                return false;
+            }
+            r->buf = nb;
+            r->cap = ncap;
+        }
+        size_t want = r->cap - r->end;
+        if (r->remaining >= 0 && (unsigned long)r->remaining < want) want = (size_t)r->remaining;
+        double t0 = r->timed ? now_seconds() : 0;
+        size_t n = want ? fread(r->buf + r->end, 1, want, r->f) : 0;
+        if (r->timed) r->read_secs += now_seconds() - t0;
+        r->bytes += n;
+        r->end += n;
+        if (r->remaining >= 0) r->remaining -= (long)n;
+        if (n == 0) {
+            r->eof = true;
+            if (ferror(r->f)) r->error = true;
+        }
     }
 }
 
@@ -129,30 +258,6 @@ static bool literal_eq_case(const char *a, size_t alen, const char *b, size_t bl
     return true;
 }
 
-/* Find the next occurrence of needle in haystack starting from start.
-   Returns index or -1 if not found. Case-insensitive if icase true. */
-static long literal_find_next(const char *hay, size_t hlen, const char *ndl, size_t nlen, size_t start, bool icase) {
-    if (nlen == 0) {
-        if (start <= hlen) return (long)start;
-        return -1;
-    }
-    if (nlen > hlen) return -1;
-    for (size_t i = start; i + nlen <= hlen; ++i) {
-        if (!icase) {
-            if (memcmp(hay + i, ndl, nlen) == 0) return (long)i;
-        } else {
-            size_t j = 0;
-            for (; j < nlen; ++j) {
-                unsigned char a = (unsigned char)hay[i + j];
-                unsigned char b = (unsigned char)ndl[j];
-                if (tolower(a) != tolower(b)) break;
-            }
-            if (j == nlen) return (long)i;
-        }
-    }
-    return -1;
-}
-
 /* Word-boundary check: ensure that the match at [start, start+len) is bounded by non-word chars or edges */
 static bool boundaries_are_word(const char *text, size_t tlen, size_t start, size_t mlen) {
     if (mlen == 0) return false; /* empty string doesn't form a word */
@@ -169,24 +274,64 @@ static bool boundaries_are_word(const char *text, size_t tlen, size_t start, siz
     return left_ok && right_ok;
 }
 
+/* Compile each -F pattern into a skip table once, before reading input.
+   lits[i] searches for patterns->items[i]. Returns NULL on out of memory. */
+static LitSearch **compile_literals(const StringVec *patterns, bool icase) {
+    LitSearch **lits = (LitSearch **)calloc(patterns->size ? patterns->size : 1, sizeof(LitSearch *));
+    if (!lits) return NULL;
+    for (size_t i = 0; i < patterns->size; ++i) {
+        lits[i] = lit_compile(patterns->items[i], strlen(patterns->items[i]), icase);
+        if (!lits[i]) {
+            while (i > 0) lit_free(lits[--i]);
+            free(lits);
+            return NULL;
+        }
+    }
+    return lits;
+}
+
+static void free_literals(LitSearch **lits, size_t n) {
+    if (!lits) return;
+    for (size_t i = 0; i < n; ++i) lit_free(lits[i]);
+    free(lits);
+}
+
+/* Line being matched, for the -w check of each occurrence a LitSet reports */
+typedef struct {
+    const char *line;
+    size_t len;
+} WordCheck;
+
+static bool accept_word(void *arg, size_t start, size_t length) {
+    const WordCheck *wc = (const WordCheck *)arg;
+    return boundaries_are_word(wc->line, wc->len, start, length);
+}
+
 /* Does a line match any of the literal patterns according to flags?
+   Several patterns are matched together by 'set' in one scan of the line;
+   a single one is searched for with its skip table in lits[0].
    If -x: needle must equal entire line.
    If -w: occurrence must be word-bounded.
    Returns true if match found. */
-static bool line_matches_literal(const char *line, size_t llen, StringVec *patterns, bool icase, bool whole_word, bool whole_line) {
+static bool line_matches_literal(const char *line, size_t llen, const StringVec *patterns, LitSearch *const *lits, const LitSet *set, bool icase, bool whole_word, bool whole_line) {
+    if (set) {
+        if (whole_line) return lit_set_exact(set, line, llen);
+        if (!whole_word) return lit_set_scan(set, line, llen, NULL, NULL);
+        WordCheck wc = {line, llen};
+        return lit_set_scan(set, line, llen, accept_word, &wc);
+    }
     for (size_t p = 0; p < patterns->size; ++p) {
-        const char *pat = patterns->items[p];
-        size_t plen = strlen(pat);
+        size_t plen = lit_length(lits[p]);
         if (whole_line) {
-            if (literal_eq_case(line, llen, pat, plen, icase)) return true;
+            if (literal_eq_case(line, llen, patterns->items[p], plen, icase)) return true;
             continue;
         }
         /* search for any occurrence that meets boundary rules */
         size_t pos = 0;
         while (pos <= llen) {
-            long idx = literal_find_next(line, llen, pat, plen, pos, icase);
-            if (idx < 0) break;
-            size_t s = (size_t)idx;
+            const char *hit = lit_find(lits[p], line + pos, llen - pos);
+            if (!hit) break;
+            size_t s = (size_t)(hit - line);
             if (!whole_word || boundaries_are_word(line, llen, s, plen)) {
                 return true;
             }
@@ -201,90 +346,134 @@ static bool line_matches_literal(const char *line, size_t llen, StringVec *patte
 
 typedef struct {
     StringVec raw;       /* original patterns */
-    StringVec lower;     /* lower-cased patterns (only used if icase) */
+    BreProgram **progs;  /* compiled form of each pattern, built once before reading input */
+    size_t nprogs;
+    LitSearch **lits;    /* required literal of each program, or NULL if it has none */
+    BreSet *set;         /* all patterns in one automaton, when there are several */
 } RegexPatterns;
 
 static void regex_patterns_free(RegexPatterns *rp) {
+    for (size_t i = 0; i < rp->nprogs; ++i) bre_free(rp->progs[i]);
+    free(rp->progs);
+    free_literals(rp->lits, rp->nprogs);
+    rp->lits = NULL;
+    rp->progs = NULL;
+    rp->nprogs = 0;
+    bre_set_free(rp->set);
+    rp->set = NULL;
     vec_free(&rp->raw);
-    vec_free(&rp->lower);
 }
 
-static bool validate_regex_patterns(RegexPatterns *rp, bool icase) {
-    BreMatch m;
-    (void)m;
-    for (size_t i = 0; i < rp->raw.size; ++i) {
-        const char *pat = rp->raw.items[i];
-        BreResult r = bre_match("", pat, &m);
-        if (r == BRE_ERROR) return false;
-        if (icase) {
-            const char *lpat = rp->lower.items[i];
-            r = bre_match("", lpat, &m);
-            if (r == BRE_ERROR) return false;
+/* Compile every pattern once with BRE_* flags: BRE_ICASE for -i, BRE_EXTENDED
+   for -E, and BRE_WHOLE for -x, which anchors the whole pattern so matching
+   does not have to build a new pattern per line.
+   Returns false on a syntax error or out of memory. */
+static bool compile_regex_patterns(RegexPatterns *rp, int flags) {
+    rp->progs = (BreProgram **)calloc(rp->raw.size ? rp->raw.size : 1, sizeof(BreProgram *));
+    rp->lits = (LitSearch **)calloc(rp->raw.size ? rp->raw.size : 1, sizeof(LitSearch *));
+    bool ok = rp->progs != NULL && rp->lits != NULL;
+    for (size_t i = 0; i < rp->raw.size && ok; ++i) {
+        BreProgram *prog = bre_compile_flags(rp->raw.items[i], flags);
+        ok = prog != NULL;
+        if (ok) rp->progs[rp->nprogs++] = prog;
+        size_t litlen;
+        const char *lit = ok ? bre_required_literal(prog, &litlen) : NULL;
+        if (lit) {
+            rp->lits[i] = lit_compile(lit, litlen, (flags & BRE_ICASE) != 0);
+            ok = rp->lits[i] != NULL;
         }
     }
-    return true;
+    /* Several patterns are matched together in one scan per line */
+    if (ok && rp->raw.size > 1) {
+        rp->set = bre_set_compile((const char *const *)rp->raw.items, rp->raw.size, flags);
+        ok = rp->set != NULL;
+    }
+    return ok;
+}
+
+/* Matching state of one thread: scratch space for each compiled program,
+   so that threads can share the programs themselves. */
+typedef struct {
+    BreScratch **progs; /* one per program of the RegexPatterns */
+    BreScratch *set;    /* for rp->set, if any */
+} MatchScratch;
+
+static void match_scratch_free(MatchScratch *ms, size_t nprogs) {
+    if (ms->progs) {
+        for (size_t i = 0; i < nprogs; ++i) bre_scratch_free(ms->progs[i]);
+        free(ms->progs);
+    }
+    bre_scratch_free(ms->set);
+    ms->progs = NULL;
+    ms->set = NULL;
 }
 
-/* Regex search across a line. If -x: we will anchor by wrapping ^...$.
-   If -w: we will iterate matches and check word boundaries. */
-static bool line_matches_regex(const char *line, size_t llen, const RegexPatterns *rp, bool icase, bool whole_word, bool whole_line) {
-    /* Build a temporary lower-case copy of line if icase */
-    char *lower_line = NULL;
-    const char *target_line = line;
-    if (icase) {
-        lower_line = tolower_dup_n(line, llen);
-        if (!lower_line) return false; /* out-of-memory -> treat as no match */
-        target_line = lower_line;
+static bool match_scratch_init(MatchScratch *ms, const RegexPatterns *rp) {
+    ms->progs = (BreScratch **)calloc(rp->nprogs ? rp->nprogs : 1, sizeof(BreScratch *));
+    ms->set = NULL;
+    bool ok = ms->progs != NULL;
+    for (size_t i = 0; i < rp->nprogs && ok; ++i) {
+        ms->progs[i] = bre_scratch_new(rp->progs[i]);
+        ok = ms->progs[i] != NULL;
     }
+    if (ok && rp->set) {
+        ms->set = bre_set_scratch_new(rp->set);
+        ok = ms->set != NULL;
+    }
+    if (!ok) match_scratch_free(ms, rp->nprogs);
+    return ok;
+}
+
+/* Regex search across a line. -x is handled by the anchored programs.
+   If -w: we will iterate matches and check word boundaries.
+   Sets *gave_up when a back-reference pattern ran out of its match budget
+   (BRE_LIMIT); the line then counts as not matching that pattern. */
+static bool line_matches_regex(const char *line, size_t llen, const RegexPatterns *rp, MatchScratch *ms, bool whole_word, bool whole_line, bool *gave_up, GrepStats *st) {
+    BreResult r = BRE_NOMATCH;
+    /* One scan for all patterns; -w still needs each pattern's match positions */
+    if (rp->set && !whole_word) {
+        st->regex_lines++;
+        st->regex_calls++;
+        r = bre_set_test_r(rp->set, ms->set, line, llen);
+        if (r == BRE_LIMIT) *gave_up = true;
+        return r == BRE_OK;
+    }
+
+    /* Reject the line cheaply when it lacks the required literal of every pattern */
+    bool possible = false;
+    for (size_t i = 0; i < rp->nprogs && !possible; ++i)
+        possible = !rp->lits[i] || lit_find(rp->lits[i], line, llen) != NULL;
+    if (!possible) {
+        st->literal_lines++;
+        return false;
+    }
+    st->regex_lines++;
 
+    /* -i is compiled into the programs, so the line is matched as it is */
     BreMatch m;
-    for (size_t i = 0; i < rp->raw.size; ++i) {
-        const char *pat = icase ? rp->lower.items[i] : rp->raw.items[i];
+    for (size_t i = 0; i < rp->nprogs; ++i) {
+        const BreProgram *prog = rp->progs[i];
 
-        if (whole_line) {
-            /* Anchor the pattern as ^pat$ */
-            size_t plen = strlen(pat);
-            char *anch = (char *)malloc(plen + 3); /* ^ + pat + $ + '\0' */
-            if (!anch) { free(lower_line); return false; }
-            anch[0] = '^';
-            memcpy(anch + 1, pat, plen);
-            anch[1 + plen] = '$';
-            anch[2 + plen] = '\0';
-            BreResult r = bre_match(target_line, anch, &m);
-            free(anch);
-            if (r == BRE_OK) { free(lower_line); return true; }
+        /* Without -w any match will do, so skip computing where it is */
+        if (whole_line || !whole_word) {
+            st->regex_calls++;
+            r = bre_test_n_r(prog, ms->progs[i], line, llen);
+            if (r == BRE_OK) return true;
+            if (r == BRE_LIMIT) *gave_up = true;
             continue;
         }
 
-        /* Not whole-line: iterate possible matches to find a word-bounded one if needed */
+        /* -w: walk the matches in one pass to find a word-bounded one */
         size_t offset = 0;
-        while (offset <= llen) {
-            BreResult r = bre_match(target_line + offset, pat, &m);
-            if (r == BRE_OK) {
-                /* m.start and m.length are relative to target_line+offset */
-                if (m.start < 0) {
-                    /* safety: unexpected return; avoid infinite loop */
-                    offset++;
-                    continue;
-                }
-                size_t abs_start = offset + (size_t)m.start;
-                size_t mlen = (size_t)m.length;
-                if (!whole_word || boundaries_are_word(line, llen, abs_start, mlen)) {
-                    free(lower_line);
-                    return true;
-                }
-                /* advance from the match start by at least 1 to find later matches */
-                offset = abs_start + (mlen > 0 ? 1 : 1);
-            } else if (r == BRE_NOMATCH) {
-                break;
-            } else {
-                /* BRE_ERROR: treat as no match for this pattern; continue others */
-                break;
-            }
+        while (offset <= llen && (st->regex_calls++, r = bre_match_at_r(prog, ms->progs[i], line, llen, offset, &m)) == BRE_OK) {
+            size_t abs_start = (size_t)m.start;
+            size_t mlen = (size_t)m.length;
+            if (boundaries_are_word(line, llen, abs_start, mlen)) return true;
+            /* A longer word may start inside this match, so resume just after its start */
+            offset = abs_start + 1;
         }
+        if (r == BRE_LIMIT) *gave_up = true;
     }
-
-    free(lower_line);
     return false;
 }
 
@@ -304,10 +493,12 @@ static bool load_patterns_from_file(const char *filename, StringVec *out, bool s
         }
     }
 
-    char *buf = NULL;
-    size_t cap = 0, len = 0;
+    LineReader reader;
+    reader_init(&reader, f);
+    const char *buf;
+    size_t len;
     bool ok = true;
-    while (read_line(f, &buf, &cap, &len)) {
+    while (read_line(&reader, &buf, &len)) {
         /* strip trailing newline */
         size_t plen = len;
         if (plen > 0 && buf[plen - 1] == '\n') plen--;
@@ -315,32 +506,593 @@ static bool load_patterns_from_file(const char *filename, StringVec *out, bool s
         if (!p) { ok = false; break; }
         if (!vec_push(out, p)) { free(p); ok = false; break; }
     }
+    if (reader.error) {
+        if (!suppress_errors) fprintf(stderr, "grep: %s: read error\n", filename);
+        ok = false;
+    }
 
     if (f != stdin) fclose(f);
-    free(buf);
+    reader_free(&reader);
     return ok;
 }
 
-static void print_matched_line(const char *filename, bool multiple_files, bool show_lineno, long lineno, const char *line, size_t len) {
-    if (multiple_files) {
-        fputs(filename, stdout);
-        fputc(':', stdout);
+/* Where a file's results go: straight to a stream, or into memory when
+   files are searched in parallel and printed later in argument order. */
+typedef struct {
+    FILE *stream; /* NULL: collect in data */
+    char *data;
+    size_t len;
+    size_t cap;
+    bool failed;  /* out of memory while collecting */
+    /* A part of a file searched on its own (-j on one file) cannot know the
+       number of its first line, so line numbers are recorded here instead
+       and printed when the parts are put back together */
+    bool defer_linenos;
+    size_t *fix_at;   /* offset in data where a line number goes */
+    long *fix_lineno; /* line number within the part, from 1 */
+    size_t nfix;
+    size_t fixcap;
+} Output;
+
+static void out_write(Output *o, const char *s, size_t n) {
+    if (o->stream) {
+        fwrite(s, 1, n, o->stream);
+        return;
+    }
+    if (o->failed) return;
+    if (o->len + n > o->cap) {
+        size_t ncap = o->cap ? o->cap * 2 : 4096;
+        while (ncap < o->len + n) ncap *= 2;
+        char *nd = (char *)realloc(o->data, ncap);
+        if (!nd) {
+            o->failed = true;
+            return;
+        }
+        o->data = nd;
+        o->cap = ncap;
+    }
+    memcpy(o->data + o->len, s, n);
+    o->len += n;
+}
+
+static void out_puts(Output *o, const char *s) {
+    out_write(o, s, strlen(s));
+}
+
+/* Write "lineno:", or record where it goes if line numbers are deferred */
+static void out_lineno(Output *o, long lineno) {
+    if (!o->defer_linenos) {
+        char num[32];
+        int n = snprintf(num, sizeof(num), "%ld:", lineno);
+        out_write(o, num, (size_t)n);
+        return;
+    }
+    if (o->failed) return;
+    if (o->nfix == o->fixcap) {
+        size_t ncap = o->fixcap ? o->fixcap * 2 : 64;
+        size_t *na = (size_t *)realloc(o->fix_at, ncap * sizeof(size_t));
+        if (na) o->fix_at = na;
+        long *nl = (long *)realloc(o->fix_lineno, ncap * sizeof(long));
+        if (nl) o->fix_lineno = nl;
+        if (!na || !nl) {
+            o->failed = true;
+            return;
+        }
+        o->fixcap = ncap;
+    }
+    o->fix_at[o->nfix] = o->len;
+    o->fix_lineno[o->nfix++] = lineno;
+}
+
+/* Print collected output, adding 'base' to the deferred line numbers */
+static void out_flush(const Output *o, FILE *stream, long base) {
+    size_t pos = 0;
+    for (size_t i = 0; i < o->nfix; ++i) {
+        fwrite(o->data + pos, 1, o->fix_at[i] - pos, stream);
+        fprintf(stream, "%ld:", base + o->fix_lineno[i]);
+        pos = o->fix_at[i];
+    }
+    if (o->len <= pos)
+        return; /* nothing collected: data may still be NULL */
+    fwrite(o->data + pos, 1, o->len - pos, stream);
+}
+
+static void out_free(Output *o) {
+    free(o->data);
+    free(o->fix_at);
+    free(o->fix_lineno);
+    o->data = NULL;
+    o->fix_at = NULL;
+    o->fix_lineno = NULL;
+}
+
+/* Everything that decides how lines are matched and printed; shared read-only
+   by the threads of -j */
+typedef struct {
+    bool opt_F, opt_i, opt_v, opt_w, opt_x, opt_c, opt_l, opt_n, opt_q;
+    bool timed;                 /* --stats: read the clock */
+    size_t max_count;           /* -m: stop a file after this many selected lines */
+    bool with_filename;         /* prefix lines and counts with the file name */
+    const StringVec *patterns;  /* -F */
+    LitSearch *const *lits;     /* -F with one pattern */
+    const LitSet *lit_set;      /* -F with several patterns */
+    const RegexPatterns *rp;    /* otherwise */
+} Search;
+
+/* Where the output of a part stood after one of its selected lines, so that
+   -m can cut the part short when the parts before it selected enough */
+typedef struct {
+    size_t out_len, out_nfix;
+    size_t err_len, err_nfix;
+} OutputMark;
+
+/* Outcome of searching one file, or one part of a file */
+typedef struct {
+    Output out;     /* standard output */
+    Output err;     /* error messages */
+    int open_errno; /* the file could not be opened */
+    bool matched;
+    bool error;
+    bool cancelled; /* stopped early because the answer was known elsewhere */
+    size_t count;   /* selected lines */
+    long lines;     /* lines read */
+    OutputMark *marks; /* -m on a part: one per printed line */
+    size_t nmarks;
+    size_t markcap;
+    GrepStats stats;
+} FileResult;
+
+/* A result whose output goes straight to stdout and stderr */
+static void result_init(FileResult *res) {
+    memset(res, 0, sizeof(*res));
+    res->out.stream = stdout;
+    res->err.stream = stderr;
+}
+
+static void result_free(FileResult *res) {
+    out_free(&res->out);
+    out_free(&res->err);
+    free(res->marks);
+    res->marks = NULL;
+}
+
+static void result_mark(FileResult *res) {
+    if (res->nmarks == res->markcap) {
+        size_t ncap = res->markcap ? res->markcap * 2 : 64;
+        OutputMark *nm = (OutputMark *)realloc(res->marks, ncap * sizeof(OutputMark));
+        if (!nm) {
+            res->out.failed = true;
+            return;
+        }
+        res->marks = nm;
+        res->markcap = ncap;
+    }
+    OutputMark *m = &res->marks[res->nmarks++];
+    m->out_len = res->out.len;
+    m->out_nfix = res->out.nfix;
+    m->err_len = res->err.len;
+    m->err_nfix = res->err.nfix;
+}
+
+static void print_matched_line(Output *o, const char *filename, bool with_filename, bool show_lineno, long lineno, const char *line, size_t len) {
+    if (with_filename) {
+        out_puts(o, filename);
+        out_write(o, ":", 1);
     }
     if (show_lineno) {
-        fprintf(stdout, "%ld:", lineno);
+        out_lineno(o, lineno);
     }
     /* Print the line as-is. If it doesn't end with '\n', append one to keep output tidy. */
-    fwrite(line, 1, len, stdout);
+    out_write(o, line, len);
     if (len == 0 || line[len - 1] != '\n') {
-        fputc('\n', stdout);
+        out_write(o, "\n", 1);
+    }
+}
+
+/* -c output for a whole file: unless -l printed the name instead, or -q
+   has nothing to say */
+static void print_count(Output *o, const Search *s, const char *fname, const FileResult *res) {
+    if (s->opt_l || (s->opt_q && res->matched)) return;
+    char num[32];
+    snprintf(num, sizeof(num), "%zu\n", res->count);
+    if (s->with_filename) {
+        out_puts(o, fname);
+        out_write(o, ":", 1);
+    }
+    out_puts(o, num);
+}
+
+/* Search the lines of 'reader', writing to res->out and res->err. With 'part'
+   the lines are one part of the file: -c and -l leave the count and the file
+   name to the caller, which adds up the parts. Reading stops as soon as the
+   result is known: at the first selected line for -l and -q, and after
+   max_count of them for -m. */
+static void search_lines(const Search *s, const char *fname, LineReader *reader, bool part, MatchScratch *ms, FileResult *res) {
+    const char *line;
+    size_t len;
+    long lineno = 0;
+    size_t selected = 0;
+    GrepStats *st = &res->stats;
+    reader->timed = s->timed;
+    double t0 = s->timed ? now_seconds() : 0;
+    while (selected < s->max_count && read_line(reader, &line, &len)) {
+        lineno++;
+        /* Exclude trailing newline from matching; print will use it as-is */
+        size_t content_len = len;
+        if (content_len > 0 && line[content_len - 1] == '\n') content_len--;
+
+        bool matched = false;
+        if (s->opt_F) {
+            st->literal_lines++;
+            matched = line_matches_literal(line, content_len, s->patterns, s->lits, s->lit_set, s->opt_i, s->opt_w, s->opt_x);
+        } else {
+            bool gave_up = false;
+            matched = line_matches_regex(line, content_len, s->rp, ms, s->opt_w, s->opt_x, &gave_up, st);
+            if (gave_up) {
+                out_puts(&res->err, "grep: ");
+                out_puts(&res->err, fname);
+                out_write(&res->err, ":", 1);
+                out_lineno(&res->err, lineno);
+                out_puts(&res->err, " pattern too complex for this line\n");
+                res->error = true;
+            }
+        }
+        if (s->opt_v) matched = !matched;
+
+        if (matched) {
+            res->matched = true;
+            selected++;
+            if (s->opt_q) {
+                /* Quiet: the exit status is known */
+                break;
+            }
+            if (s->opt_l) {
+                /* list filename once and stop scanning this file */
+                if (!part) {
+                    out_puts(&res->out, fname);
+                    out_write(&res->out, "\n", 1);
+                }
+                break;
+            } else if (!s->opt_c) {
+                print_matched_line(&res->out, fname, s->with_filename, s->opt_n, lineno, line, len);
+                if (part && s->max_count != SIZE_MAX) result_mark(res);
+            }
+        }
+    }
+
+    res->count = selected;
+    res->lines = lineno;
+    res->cancelled = reader->cancelled;
+    st->bytes += reader->bytes;
+    st->lines += (size_t)lineno;
+    st->matched += selected;
+    if (reader->cap > st->peak_buffer) st->peak_buffer = reader->cap;
+    if (s->timed) {
+        st->read_secs += reader->read_secs;
+        st->match_secs += now_seconds() - t0 - reader->read_secs;
+    }
+    if (s->opt_c && !part) print_count(&res->out, s, fname, res);
+    if (reader->error) {
+        out_puts(&res->err, "grep: ");
+        out_puts(&res->err, fname);
+        out_puts(&res->err, ": read error\n");
+        res->error = true;
+    }
+}
+
+/* Search one file (or stdin for "-"), writing to res->out and res->err.
+   Reading stops early if cancel(cancel_arg) becomes true. */
+static void search_file(const Search *s, const char *fname, bool (*cancel)(void *), void *cancel_arg,
+                        MatchScratch *ms, FileResult *res) {
+    FILE *f = NULL;
+    if (strcmp(fname, "-") == 0) {
+        f = stdin;
+    } else {
+        f = fopen(fname, "r");
+        if (!f) {
+            res->open_errno = errno;
+            res->error = true;
+            return;
+        }
+    }
+
+    LineReader reader;
+    reader_init(&reader, f);
+    reader.cancel = cancel;
+    reader.cancel_arg = cancel_arg;
+    search_lines(s, fname, &reader, false, ms, res);
+    reader_free(&reader);
+    if (f != stdin) fclose(f);
+}
+
+/* Report what search_file() could not write itself. Returns false if a
+   collected result was lost for lack of memory. */
+static bool finish_file(const char *fname, FileResult *res, bool quiet_errors) {
+    if (res->open_errno && !quiet_errors) fprintf(stderr, "grep: %s: %s\n", fname, strerror(res->open_errno));
+    if (!res->out.stream) out_flush(&res->out, stdout, 0);
+    if (!res->err.stream) out_flush(&res->err, stderr, 0);
+    result_free(res);
+    return !res->out.failed && !res->err.failed;
+}
+
+#ifndef __STDC_NO_THREADS__
+/* -j: worker threads take files in argument order and collect each file's
+   output in memory; the main thread prints the results in the same order as
+   they complete. Workers stay at most GREP_JOBS_AHEAD files per thread ahead
+   of the printing, which bounds the memory held by collected output.
+
+   A single large file is instead cut into parts of about GREP_PART_SIZE
+   bytes, each searched by a worker with a stream of its own. Part k starts
+   after the first newline at or after offset k * GREP_PART_SIZE - 1, which
+   each worker finds by seeking there and reading forward, so a line always
+   belongs to exactly one part. Line numbers within a part are fixed up when
+   the parts are printed, and -c, -l and -q add up the parts' results.
+
+   Once the answer is known -- a match with -q, or with -l on one file, or
+   -m lines selected from the parts printed so far -- the pool stops: no
+   more work is taken and the searches under way stop at their next read. */
+#define GREP_JOBS_AHEAD 4
+#define GREP_PART_SIZE (16L * 1024 * 1024)
+#define GREP_PARTS_AHEAD 2
+
+typedef struct {
+    const Search *search;
+    const char **files;
+    int nfiles;     /* files, or parts of files[0] if part_file */
+    bool part_file; /* search parts of one file */
+    long file_size;
+    FileResult *results;
+    bool *done;
+    int next;    /* next file a worker takes */
+    int printed; /* files whose results have been printed */
+    int window;  /* how far 'next' may run ahead of 'printed' */
+    bool stop;   /* the answer is known: take no more work, cancel the rest */
+    bool found;  /* a worker found the match that -q or -l was waiting for */
+    mtx_t lock;
+    cnd_t changed;
+} Pool;
+
+typedef struct {
+    Pool *pool;
+    MatchScratch scratch;
+} Worker;
+
+/* Offset of the first line that starts at or after 'at' */
+static bool line_start_after(FILE *f, long at, long size, long *start) {
+    if (at <= 0 || at >= size) {
+        *start = at <= 0 ? 0 : size;
+        return true;
+    }
+    if (fseek(f, at - 1, SEEK_SET) != 0) return false;
+    int c;
+    long pos = at - 1;
+    while ((c = getc(f)) != EOF) {
+        pos++;
+        if (c == '\n') break;
+    }
+    if (ferror(f)) return false;
+    *start = pos;
+    return true;
+}
+
+/* Search part 'k' of a file of 'size' bytes */
+static void search_part(const Search *s, const char *fname, long size, int k, bool (*cancel)(void *),
+                        void *cancel_arg, MatchScratch *ms, FileResult *res) {
+    res->out.defer_linenos = true;
+    res->err.defer_linenos = true;
+    /* Binary mode, where seeking to any offset is defined */
+    FILE *f = fopen(fname, "rb");
+    if (!f) {
+        res->open_errno = errno;
+        res->error = true;
+        return;
+    }
+    long start, end;
+    if (!line_start_after(f, (long)k * GREP_PART_SIZE, size, &start) ||
+        !line_start_after(f, (long)(k + 1) * GREP_PART_SIZE, size, &end) ||
+        fseek(f, start, SEEK_SET) != 0) {
+        out_puts(&res->err, "grep: ");
+        out_puts(&res->err, fname);
+        out_puts(&res->err, ": read error\n");
+        res->error = true;
+        fclose(f);
+        return;
+    }
+    LineReader reader;
+    reader_init(&reader, f);
+    reader.text = true; /* read the lines the serial search would */
+    reader.remaining = end > start ? end - start : 0;
+    reader.cancel = cancel;
+    reader.cancel_arg = cancel_arg;
+    search_lines(s, fname, &reader, true, ms, res);
+    reader_free(&reader);
+    fclose(f);
+}
+
+static bool pool_stopped(void *arg) {
+    Pool *p = (Pool *)arg;
+    mtx_lock(&p->lock);
+    bool stop = p->stop;
+    mtx_unlock(&p->lock);
+    return stop;
+}
+
+static void pool_stop(Pool *p) {
+    mtx_lock(&p->lock);
+    p->stop = true;
+    cnd_broadcast(&p->changed);
+    mtx_unlock(&p->lock);
+}
+
+static int worker_main(void *arg) {
+    Worker *w = (Worker *)arg;
+    Pool *p = w->pool;
+    const Search *s = p->search;
+    for (;;) {
+        mtx_lock(&p->lock);
+        while (!p->stop && p->next < p->nfiles && p->next >= p->printed + p->window) cnd_wait(&p->changed, &p->lock);
+        if (p->stop || p->next >= p->nfiles) {
+            mtx_unlock(&p->lock);
+            return 0;
+        }
+        int i = p->next++;
+        mtx_unlock(&p->lock);
+
+        FileResult *res = &p->results[i];
+        if (p->part_file) search_part(s, p->files[0], p->file_size, i, pool_stopped, p, &w->scratch, res);
+        else search_file(s, p->files[i], pool_stopped, p, &w->scratch, res);
+
+        mtx_lock(&p->lock);
+        p->done[i] = true;
+        /* -q needs one match anywhere, -l one in the file */
+        if (res->matched && !res->cancelled && (s->opt_q || (p->part_file && s->opt_l))) {
+            p->stop = true;
+            p->found = true;
+        }
+        cnd_broadcast(&p->changed);
+        mtx_unlock(&p->lock);
+    }
+}
+
+/* Search 'files' with 'nthreads' workers, printing results in order, or with
+   'file_size' >= 0 the parts of the single file files[0].
+   Returns false if the threads could not be started. */
+static bool search_parallel(const Search *s, const char **files, int nfiles, long file_size, int nthreads,
+                            bool quiet_errors, bool *any_match, bool *had_error, GrepStats *stats) {
+    Pool p;
+    p.search = s;
+    p.files = files;
+    p.part_file = file_size >= 0;
+    p.file_size = file_size;
+    p.nfiles = p.part_file ? (int)((file_size + GREP_PART_SIZE - 1) / GREP_PART_SIZE) : nfiles;
+    nfiles = p.nfiles;
+    p.results = (FileResult *)calloc((size_t)nfiles, sizeof(FileResult));
+    p.done = (bool *)calloc((size_t)nfiles, sizeof(bool));
+    p.next = 0;
+    p.printed = 0;
+    p.stop = false;
+    p.found = false;
+    p.window = nthreads * (p.part_file ? GREP_PARTS_AHEAD : GREP_JOBS_AHEAD);
+    Worker *workers = (Worker *)calloc((size_t)nthreads, sizeof(Worker));
+    thrd_t *threads = (thrd_t *)calloc((size_t)nthreads, sizeof(thrd_t));
+    bool ok = p.results && p.done && workers && threads;
+    bool have_lock = ok && mtx_init(&p.lock, mtx_plain) == thrd_success;
+    bool have_cond = have_lock && cnd_init(&p.changed) == thrd_success;
+    ok = have_cond;
+
+    int started = 0;
+    for (int t = 0; ok && t < nthreads; ++t) {
+        workers[t].pool = &p;
+        ok = s->opt_F || match_scratch_init(&workers[t].scratch, s->rp);
+        if (ok) ok = thrd_create(&threads[t], worker_main, &workers[t]) == thrd_success;
+        if (ok) started++;
+        else if (!s->opt_F) match_scratch_free(&workers[t].scratch, s->rp->nprogs);
+    }
+    if (!ok && started > 0) {
+        /* Let the running workers finish the files on their own */
+        ok = true;
+    }
+
+    if (ok) {
+        FileResult whole;
+        result_init(&whole);
+        for (int i = 0; i < nfiles; ++i) {
+            mtx_lock(&p.lock);
+            while (!p.done[i] && !(p.stop && i >= p.next)) cnd_wait(&p.changed, &p.lock);
+            bool searched = p.done[i];
+            mtx_unlock(&p.lock);
+
+            /* After a stop, what is left was never searched or only in part */
+            FileResult *res = &p.results[i];
+            if (!searched || res->cancelled) break;
+            const char *fname = p.part_file ? files[0] : files[i];
+            bool enough = false;
+            if (p.part_file && res->count >= s->max_count - whole.count) {
+                /* -m: keep the part up to the last line wanted */
+                size_t keep = s->max_count - whole.count;
+                if (keep < res->nmarks) {
+                    if (keep == 0) {
+                        res->out.len = res->out.nfix = res->err.len = res->err.nfix = 0;
+                    } else {
+                        const OutputMark *m = &res->marks[keep - 1];
+                        res->out.len = m->out_len;
+                        res->out.nfix = m->out_nfix;
+                        res->err.len = m->err_len;
+                        res->err.nfix = m->err_nfix;
+                    }
+                }
+                res->count = keep;
+                res->matched = keep > 0;
+                enough = true;
+            }
+            if (p.part_file) {
+                /* Put the parts back together; report a failed open once */
+                if (res->open_errno && whole.open_errno) res->open_errno = 0;
+                else if (res->open_errno) whole.open_errno = res->open_errno;
+                whole.matched = whole.matched || res->matched;
+                whole.count += res->count;
+                out_flush(&res->out, stdout, whole.lines);
+                out_flush(&res->err, stderr, whole.lines);
+                whole.lines += res->lines;
+                res->out.len = res->err.len = 0;
+                res->out.nfix = res->err.nfix = 0;
+            }
+            if (!finish_file(fname, res, quiet_errors)) {
+                fprintf(stderr, "grep: %s: out of memory\n", fname);
+                res->error = true;
+            }
+            if (res->matched) *any_match = true;
+            if (res->error) *had_error = true;
+            stats_add(stats, &res->stats);
+
+            /* Like the serial search, -q ends with the first file that matched */
+            if (enough || (s->opt_q && res->matched)) {
+                pool_stop(&p);
+                break;
+            }
+            mtx_lock(&p.lock);
+            p.printed++;
+            cnd_broadcast(&p.changed);
+            mtx_unlock(&p.lock);
+        }
+        for (int t = 0; t < started; ++t) {
+            thrd_join(threads[t], NULL);
+            if (!s->opt_F) match_scratch_free(&workers[t].scratch, s->rp->nprogs);
+        }
+        /* A worker stopped by -q or -l may have found a match left unprinted */
+        mtx_lock(&p.lock);
+        bool found = p.found;
+        mtx_unlock(&p.lock);
+        if (found) {
+            *any_match = true;
+            whole.matched = true;
+        }
+        if (p.part_file && !whole.open_errno) {
+            if (s->opt_l && whole.matched) printf("%s\n", files[0]);
+            if (s->opt_c) print_count(&whole.out, s, files[0], &whole);
+        }
+        /* Results left unprinted by a stop */
+        for (int i = 0; i < nfiles; ++i) result_free(&p.results[i]);
     }
+
+    if (have_cond) cnd_destroy(&p.changed);
+    if (have_lock) mtx_destroy(&p.lock);
+    free(threads);
+    free(workers);
+    free(p.done);
+    free(p.results);
+    return ok;
 }
+#endif
+
+#define OPT_HELP 256 /* --help has no short option: -h and -H are taken */
+#define OPT_STATS 257
 
 int main(int argc, char *const argv[]) {
     int c;
 
     /* Option flags required by POSIX */
-    bool opt_E = false, opt_F = false;  /* -E extended regex (unsupported), -F fixed strings */
+    bool opt_E = false, opt_F = false;  /* -E extended regex, -F fixed strings */
     bool opt_i = false;                 /* ignore case */
     bool opt_v = false;                 /* invert match */
     bool opt_w = false;                 /* match whole word */
@@ -350,6 +1102,10 @@ int main(int argc, char *const argv[]) {
     bool opt_n = false;                 /* prefix with line number */
     bool opt_q = false;                 /* quiet, set exit status only */
     bool opt_s = false;                 /* suppress error messages about nonexistent/readable files */
+    int opt_H = -1;                     /* -H 1, -h 0: prefix lines with the file name; default: if several files */
+    long opt_j = 1;                     /* files searched at once */
+    long opt_m = -1;                    /* -m: selected lines per file, or -1 for no limit */
+    bool opt_stats = false;             /* --stats: report where the time went */
 
     StringVec patterns; vec_init(&patterns);    /* Collected patterns (strings) */
     StringVec e_patterns; vec_init(&e_patterns);/* from -e */
@@ -374,18 +1130,24 @@ int main(int argc, char *const argv[]) {
         {"no-messages",        no_argument,       NULL, 's'},
         {"file",               required_argument, NULL, 'f'},
         {"regexp",             required_argument, NULL, 'e'},
-        {"help",               no_argument,       NULL, 'H'},
+        {"with-filename",      no_argument,       NULL, 'H'},
+        {"no-filename",        no_argument,       NULL, 'h'},
+        {"max-count",          required_argument, NULL, 'm'},
+        {"jobs",               required_argument, NULL, 'j'},
+        {"stats",              no_argument,       NULL, OPT_STATS},
+        {"help",               no_argument,       NULL, OPT_HELP},
         {"version",            no_argument,       NULL, 'V'},
         {NULL, 0, NULL, 0}
     };
 
     opterr = 1;  /* let getopt print some errors itself if any implementation does */
 
-    while ((c = getopt_long(argc, argv, "GEFiwvxclnqse:f:HV", longopts, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, "GEFiwvxclnqsHhm:j:e:f:V", longopts, NULL)) != -1) {
         switch (c) {
-            case 'G': /* basic (default) */ break;
-            case 'E': opt_E = true; break;
-            case 'F': opt_F = true; break;
+            /* -G, -E and -F select the pattern syntax; the last one given wins */
+            case 'G': /* basic (default) */ opt_E = opt_F = false; break;
+            case 'E': opt_E = true; opt_F = false; break;
+            case 'F': opt_F = true; opt_E = false; break;
             case 'i': opt_i = true; break;
             case 'v': opt_v = true; break;
             case 'w': opt_w = true; break;
@@ -395,6 +1157,32 @@ int main(int argc, char *const argv[]) {
             case 'n': opt_n = true; break;
             case 'q': opt_q = true; break;
             case 's': opt_s = true; break;
+            case 'H': opt_H = 1; break;
+            case 'h': opt_H = 0; break;
+
+            case 'm': {
+                char *end;
+                errno = 0;
+                opt_m = strtol(optarg, &end, 10);
+                if (errno || end == optarg || *end || opt_m < 0) {
+                    fprintf(stderr, "grep: invalid max count: %s\n", optarg);
+                    vec_free(&e_patterns);
+                    vec_free(&f_patterns);
+                    return 2;
+                }
+            } break;
+
+            case 'j': {
+                char *end;
+                errno = 0;
+                opt_j = strtol(optarg, &end, 10);
+                if (errno || end == optarg || *end || opt_j < 1) {
+                    fprintf(stderr, "grep: invalid number of jobs: %s\n", optarg);
+                    vec_free(&e_patterns);
+                    vec_free(&f_patterns);
+                    return 2;
+                }
+            } break;
 
             case 'e': {
                 char *dup = xstrdup(optarg);
@@ -416,7 +1204,9 @@ int main(int argc, char *const argv[]) {
                 }
             } break;
 
-            case 'H':
+            case OPT_STATS: opt_stats = true; break;
+
+            case OPT_HELP:
                 usage(stdout, argv[0]);
                 vec_free(&e_patterns);
                 vec_free(&f_patterns);
@@ -437,18 +1227,6 @@ int main(int argc, char *const argv[]) {
         }
     }
 
-    /* Error on -E: Only basic regular expressions supported */
-    if (opt_E) {
-        if (!opt_s) {
-            fprintf(stderr, "grep: -E/--extended-regexp is not supported; only basic regular expressions (-G/--basic-regexp) are implemented.\n");
-        }
-        vec_free(&e_patterns);
-        vec_free(&f_patterns);
-        return 2;
-    }
-
-    /* If both -E and -F were given, -E already errored out; but if both -G and -F it's fine (just -F). */
-
     /* Collect positional pattern if no -e and no -f patterns were provided after options */
     bool have_any_pattern = (e_patterns.size > 0) || (f_patterns.size > 0);
     if (!have_any_pattern) {
@@ -506,10 +1284,15 @@ int main(int argc, char *const argv[]) {
     /* Prepare regex patterns structure if needed */
     RegexPatterns rp;
     vec_init(&rp.raw);
-    vec_init(&rp.lower);
+    rp.progs = NULL;
+    rp.nprogs = 0;
+    rp.lits = NULL;
+    rp.set = NULL;
+    LitSearch **lits = NULL; /* -F with one pattern: its skip table */
+    LitSet *lit_set = NULL;  /* -F with several patterns: one automaton for all */
 
     if (!opt_F) {
-        /* Move ownership of patterns into rp.raw, and build lower case copies if -i */
+        /* Move ownership of patterns into rp.raw */
         for (size_t i = 0; i < patterns.size; ++i) {
             if (!vec_push(&rp.raw, patterns.items[i])) {
                 if (!opt_s) fprintf(stderr, "grep: out of memory\n");
@@ -520,126 +1303,101 @@ int main(int argc, char *const argv[]) {
                 return 2;
             }
             patterns.items[i] = NULL; /* moved */
-            if (opt_i) {
-                char *lp = tolower_dup(rp.raw.items[i]);
-                if (!lp || !vec_push(&rp.lower, lp)) {
-                    if (!opt_s) fprintf(stderr, "grep: out of memory\n");
-                    regex_patterns_free(&rp);
-                    for (size_t j = i + 1; j < patterns.size; ++j) free(patterns.items[j]);
-                    free(patterns.items);
-                    return 2;
-                }
-            }
         }
         free(patterns.items); /* only container remains */
         patterns.items = NULL;
         patterns.size = patterns.capacity = 0;
 
-        /* Validate regex syntax now to fail early */
-        if (!validate_regex_patterns(&rp, opt_i)) {
+        /* Compile (and so validate) every pattern now to fail early */
+        int flags = (opt_i ? BRE_ICASE : 0) | (opt_E ? BRE_EXTENDED : 0) | (opt_x ? BRE_WHOLE : 0);
+        if (!compile_regex_patterns(&rp, flags)) {
             if (!opt_s) {
-                fprintf(stderr, "grep: invalid basic regular expression");
+                fprintf(stderr, "grep: invalid %s regular expression", opt_E ? "extended" : "basic");
                 if (pattern_file_opt) fprintf(stderr, " (from %s)", pattern_file_opt);
                 fputc('\n', stderr);
             }
             regex_patterns_free(&rp);
             return 2;
         }
+    } else {
+        if (patterns.size > 1) lit_set = lit_set_compile((const char *const *)patterns.items, patterns.size, opt_i);
+        else lits = compile_literals(&patterns, opt_i);
+        if (!lits && !lit_set) {
+            if (!opt_s) fprintf(stderr, "grep: out of memory\n");
+            vec_free(&patterns);
+            return 2;
+        }
     }
 
     /* Remaining arguments are filenames (or stdin if none) */
+    const char *stdin_only[] = {"-"};
     const char **files = (const char **)&argv[optind];
     int file_count = argc - optind;
+    if (file_count == 0) {
+        files = stdin_only;
+        file_count = 1;
+    }
 
-    bool multiple_files = file_count > 1 || (file_count == 1 && strcmp(files[0], "-") != 0 ? false : false);
-    /* For grep, when more than one file is processed, prefix filename. We'll set multiple_files if file_count > 1. */
-    multiple_files = file_count > 1;
+    /* When more than one file is processed, prefix lines with the filename, unless -H or -h says otherwise */
+    Search search = {
+        .opt_F = opt_F, .opt_i = opt_i, .opt_v = opt_v, .opt_w = opt_w, .opt_x = opt_x,
+        .opt_c = opt_c, .opt_l = opt_l, .opt_n = opt_n, .opt_q = opt_q, .timed = opt_stats,
+        .max_count = opt_m >= 0 && (unsigned long)opt_m < SIZE_MAX ? (size_t)opt_m : SIZE_MAX,
+        .with_filename = opt_H >= 0 ? opt_H == 1 : argc - optind > 1,
+        .patterns = &patterns, .lits = lits, .lit_set = lit_set, .rp = &rp,
+    };
 
     bool any_match = false;
     bool had_error = false;
+    /* -m 0 selects no line: like GNU grep, open no file and exit 1 */
+    bool done = search.max_count == 0;
+    GrepStats stats = {0};
+    int nthreads = 1;
 
-    /* Helper lambda-like to process a stream */
-    struct Processor {
-        /* state captured by functions below */
-    } proc;
-
-    for (int fi = 0; fi < (file_count == 0 ? 1 : file_count); ++fi) {
-        const char *fname = (file_count == 0) ? "-" : files[fi];
-        FILE *f = NULL;
-        if (strcmp(fname, "-") == 0) {
-            f = stdin;
-        } else {
-            f = fopen(fname, "r");
-            if (!f) {
-                if (!opt_s) fprintf(stderr, "grep: %s: %s\n", fname, strerror(errno));
-                had_error = true;
-                continue;
-            }
-        }
-
-        char *line = NULL;
-        size_t cap = 0, len = 0;
-        long lineno = 0;
-        size_t match_count = 0;
-        bool printed_filename_for_l = false;
-        while (read_line(f, &line, &cap, &len)) {
-            lineno++;
-            /* Exclude trailing newline from matching; print will use it as-is */
-            size_t content_len = len;
-            if (content_len > 0 && line[content_len - 1] == '\n') content_len--;
-
-            bool matched = false;
-            if (opt_F) {
-                matched = line_matches_literal(line, content_len, &patterns, opt_i, opt_w, opt_x);
-            } else {
-                matched = line_matches_regex(line, content_len, &rp, opt_i, opt_w, opt_x);
-            }
-            if (opt_v) matched = !matched;
-
-            if (matched) {
-                any_match = true;
-                if (opt_q) {
-                    /* Quiet: exit immediately success */
-                    free(line);
-                    if (f != stdin) fclose(f);
-                    if (!opt_F) regex_patterns_free(&rp);
-                    else vec_free(&patterns);
-                    return 0;
-                }
-                if (opt_l) {
-                    if (!printed_filename_for_l) {
-                        fputs(fname, stdout);
-                        fputc('\n', stdout);
-                        printed_filename_for_l = true;
-                    }
-                    /* Continue reading to next file; no need to read remaining lines if -l behaves as first match only.
-                       But POSIX allows listing file name once; we can break early. */
-                    break; /* list filename once and stop scanning this file */
-                } else if (opt_c) {
-                    match_count++;
-                } else {
-                    print_matched_line(fname, multiple_files, opt_n, lineno, line, len);
-                }
-            }
-        }
-
-        if (opt_l) {
-            /* already printed file name if matched; else nothing */
-        } else if (opt_c) {
-            if (multiple_files) {
-                printf("%s:%zu\n", fname, match_count);
-            } else {
-                printf("%zu\n", match_count);
-            }
+#ifndef __STDC_NO_THREADS__
+    if (!done && opt_j > 1 && file_count > 1) {
+        nthreads = opt_j < file_count ? (int)opt_j : file_count;
+        done = search_parallel(&search, files, file_count, -1, nthreads, opt_s, &any_match, &had_error, &stats);
+    } else if (!done && opt_j > 1) {
+        /* One file: search parts of it at once if it is a large regular file;
+           stdin and pipes, which cannot seek, are read serially */
+        long size = -1;
+        FILE *f = strcmp(files[0], "-") != 0 ? fopen(files[0], "rb") : NULL;
+        if (f && fseek(f, 0, SEEK_END) == 0) size = ftell(f);
+        if (f) fclose(f);
+        if (size >= 2 * GREP_PART_SIZE) {
+            long nparts = (size + GREP_PART_SIZE - 1) / GREP_PART_SIZE;
+            nthreads = opt_j < nparts ? (int)opt_j : (int)nparts;
+            done = search_parallel(&search, files, 1, size, nthreads, opt_s, &any_match, &had_error, &stats);
         }
+    }
+    if (!done) nthreads = 1;
+#endif
 
-        free(line);
-        if (f != stdin) fclose(f);
+    MatchScratch scratch = {NULL, NULL};
+    if (!done && !opt_F && !match_scratch_init(&scratch, &rp)) {
+        if (!opt_s) fprintf(stderr, "grep: out of memory\n");
+        regex_patterns_free(&rp);
+        return 2;
+    }
+    for (int fi = 0; !done && fi < file_count; ++fi) {
+        FileResult res;
+        result_init(&res);
+        search_file(&search, files[fi], NULL, NULL, &scratch, &res);
+        finish_file(files[fi], &res, opt_s);
+        if (res.matched) any_match = true;
+        if (res.error) had_error = true;
+        stats_add(&stats, &res.stats);
+        /* Quiet: exit immediately on success */
+        if (opt_q && res.matched) break;
     }
+    if (!opt_F) match_scratch_free(&scratch, rp.nprogs);
+    if (opt_stats) stats_print(&stats, nthreads);
 
     if (!opt_F) regex_patterns_free(&rp);
-    else vec_free(&patterns);
+    else { free_literals(lits, patterns.size); lit_set_free(lit_set); vec_free(&patterns); }
 
+    if (opt_q && any_match) return 0;
     if (had_error) return 2;
     return any_match ? 0 : 1;
 }
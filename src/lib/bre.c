@@ -1,6 +1,7 @@
 // Expand BreResult to differentiate group presence vs mismatch, and use it in match_group and match_here.
 
 #include "bre.h"
+#include "bre_impl.h"
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -8,8 +9,6 @@
 #include <string.h>
 #include <limits.h>
 
-#define RE_DUP_MAX 255
-
 static BreResult match_here(MatchContext* ctx, BreMatch* m, int* total_out);
 static bool in_char_class(unsigned char c, const char* pat, int pi, int pend, int* after);
 static int find_group_end(const char* pat, int pi, int pend);
@@ -39,74 +38,178 @@ static int find_group_end(const char* pat, int pi, int pend)
 	return -1;
 }
 
-static bool in_char_class(unsigned char c, const char* pat, int pi, int pend, int* after)
+/* Bracket expressions */
+
+typedef struct
 {
-	bool invert = false;
-	int i = pi + 1;
-	if (i < pend && pat[i] == '^')
+	const char* name;
+	int (*test)(int);
+} BreNamedClass;
+
+static const BreNamedClass named_classes[] = {
+	{ "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank }, { "cntrl", iscntrl },
+	{ "digit", isdigit }, { "graph", isgraph }, { "lower", islower }, { "print", isprint },
+	{ "punct", ispunct }, { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+};
+
+static void bitmap_add(unsigned char* map, int c)
+{
+	map[c >> 3] |= (unsigned char)(1u << (c & 7));
+}
+
+/* Offset of the "x]" that closes a "[x" term whose body starts at 'i', or -1 */
+static int bracket_term_end(const char* pat, int i, int pend, char x)
+{
+	for (; i + 1 < pend; i++)
 	{
-		invert = true;
-		i++;
+		if (pat[i] == x && pat[i + 1] == ']')
+			return i;
+	}
+	return -1;
+}
+
+/* One bracket character at pat[i]: a plain byte, or a [.c.] / [=c=] term
+   naming a single byte. Stores it in 'c' and returns the offset after it. */
+static int bracket_char(const char* pat, int i, int pend, int* c)
+{
+	if (pat[i] == '[' && i + 1 < pend && (pat[i + 1] == '.' || pat[i + 1] == '='))
+	{
+		int close = bracket_term_end(pat, i + 2, pend, pat[i + 1]);
+		if (close != i + 3)
+			return -1;
+		*c = (unsigned char)pat[i + 2];
+		return close + 2;
 	}
-	bool matched = false;
-	unsigned char prev = 0;
-	bool has_prev = false;
-	for (; i < pend && pat[i] != ']'; i++)
+	*c = (unsigned char)pat[i];
+	return i + 1;
+}
+
+/* Parse the bracket expression opening at pat[pi] into 'map', a 256-bit set
+ * of the bytes it matches with any leading '^' already applied. With 'icase'
+ * both cases of every member letter are included. Returns the offset after
+ * the closing ']', or -1 if the expression is malformed.
+ */
+static int parse_bracket(const char* pat, int pi, int pend, bool icase, unsigned char* map)
+{
+	unsigned char set[32] = { 0 };
+	int i = pi + 1;
+	bool invert = i < pend && pat[i] == '^';
+	if (invert)
+		i++;
+	/* A ']' first in the list is an ordinary member */
+	bool first = true;
+	while (i < pend && (pat[i] != ']' || first))
 	{
-		if (pat[i] == '-' && has_prev && (i + 1) < pend && pat[i + 1] != ']')
+		first = false;
+		if (pat[i] == '[' && i + 1 < pend && pat[i + 1] == ':')
+		{
+			int close = bracket_term_end(pat, i + 2, pend, ':');
+			if (close < 0)
+				return -1;
+			const BreNamedClass* nc = NULL;
+			for (size_t k = 0; k < sizeof(named_classes) / sizeof(named_classes[0]); k++)
+			{
+				size_t n = strlen(named_classes[k].name);
+				if ((size_t)(close - (i + 2)) == n && memcmp(pat + i + 2, named_classes[k].name, n) == 0)
+					nc = &named_classes[k];
+			}
+			if (!nc)
+				return -1;
+			for (int c = 0; c < 256; c++)
+			{
+				if (nc->test(c))
+					bitmap_add(set, c);
+			}
+			i = close + 2;
+			continue;
+		}
+		int lo = 0;
+		i = bracket_char(pat, i, pend, &lo);
+		if (i < 0)
+			return -1;
+		if (i + 1 < pend && pat[i] == '-' && pat[i + 1] != ']')
 		{
-			unsigned char start = prev;
-			unsigned char end = (unsigned char)pat[i + 1];
-			if (start <= c && c <= end)
-				matched = true;
-			i++;
-			has_prev = false;
-			prev = 0;
+			int hi = 0;
+			i = bracket_char(pat, i + 1, pend, &hi);
+			if (i < 0)
+				return -1;
+			for (int c = lo; c <= hi; c++)
+				bitmap_add(set, c);
 		}
 		else
 		{
-			if ((unsigned char)pat[i] == c)
-				matched = true;
-			prev = (unsigned char)pat[i];
-			has_prev = true;
+			bitmap_add(set, lo);
 		}
 	}
-	if (i >= pend || pat[i] != ']')
+	if (i >= pend)
+		return -1;
+
+	if (icase)
+	{
+		for (int c = 0; c < 256; c++)
+		{
+			if (bre_bitmap_has(set, (unsigned char)c))
+			{
+				bitmap_add(set, tolower(c));
+				bitmap_add(set, toupper(c));
+			}
+		}
+	}
+	for (int k = 0; k < 32; k++)
+		map[k] = (unsigned char)(invert ? ~set[k] : set[k]);
+	return i + 1;
+}
+
+static bool in_char_class(unsigned char c, const char* pat, int pi, int pend, int* after)
+{
+	unsigned char map[32];
+	int end = parse_bracket(pat, pi, pend, false, map);
+	if (end < 0)
 		return false;
-	*after = i + 1;
-	return invert ? !matched : matched;
+	*after = end;
+	return bre_bitmap_has(map, c);
 }
 
 /* Quantifiers */
 
-BreResult parse_bre_repetition(const char* pat, int pi, int pend, BreRepetition* rep)
+/* Length of the closing brace of an interval at 'j' (\} in a BRE, } in an ERE), or 0 */
+static int interval_close(const char* pat, int j, int pend, bool extended)
 {
-	if (pi + 5 > pend)
+	if (extended)
+		return j < pend && pat[j] == '}';
+	return (j + 1 < pend && pat[j] == '\\' && pat[j + 1] == '}') ? 2 : 0;
+}
+
+/* Read the decimal count at pat[*j]; values above BRE_DUP_MAX come back as BRE_DUP_MAX + 1 */
+static int parse_count(const char* pat, int* j, int pend)
+{
+	int n = 0;
+	while (*j < pend && isdigit((unsigned char)pat[*j]))
 	{
-		if (pi < pend && pat[pi] == '\\' && pi + 1 < pend && pat[pi + 1] == '{')
-			return BRE_ERROR;
-		return BRE_NOMATCH;
+		if (n <= BRE_DUP_MAX)
+			n = n * 10 + (pat[*j] - '0');
+		(*j)++;
 	}
-	if (pat[pi] != '\\' || pat[pi + 1] != '{')
-		return BRE_NOMATCH;
+	return n > BRE_DUP_MAX ? BRE_DUP_MAX + 1 : n;
+}
 
-	int j = pi + 2;
-	const char* start = pat + j;
+/* Parse the bounds of an interval; 'j' is just past the opening brace */
+static BreResult parse_interval(const char* pat, int j, int pend, bool extended, BreRepetition* rep)
+{
+	int close;
 	if (j >= pend || !isdigit((unsigned char)pat[j]))
 		return BRE_ERROR;
-	while (j < pend && isdigit((unsigned char)pat[j]))
-		j++;
-	rep->min = atoi(start);
-	if (rep->min > RE_DUP_MAX)
+	rep->min = parse_count(pat, &j, pend);
+	if (rep->min > BRE_DUP_MAX)
 		return BRE_ERROR;
 
 	if (j >= pend)
 		return BRE_ERROR;
 
-	if (pat[j] == '\\' && j + 1 < pend && pat[j + 1] == '}')
+	if ((close = interval_close(pat, j, pend, extended)) > 0)
 	{
 		rep->max = rep->min;
-		rep->next_pi = j + 2;
+		rep->next_pi = j + close;
 		return BRE_OK;
 	}
 
@@ -116,25 +219,63 @@ BreResult parse_bre_repetition(const char* pat, int pi, int pend, BreRepetition*
 	if (j >= pend)
 		return BRE_ERROR;
 
-	if (pat[j] == '\\' && j + 1 < pend && pat[j + 1] == '}')
+	if ((close = interval_close(pat, j, pend, extended)) > 0)
 	{
 		rep->max = -1;
-		rep->next_pi = j + 2;
+		rep->next_pi = j + close;
 		return BRE_OK;
 	}
 
-	start = pat + j;
 	if (!isdigit((unsigned char)pat[j]))
 		return BRE_ERROR;
-	while (j < pend && isdigit((unsigned char)pat[j]))
-		j++;
-	rep->max = atoi(start);
-	if (rep->max > RE_DUP_MAX || rep->min > rep->max)
+	rep->max = parse_count(pat, &j, pend);
+	if (rep->max > BRE_DUP_MAX || rep->min > rep->max)
 		return BRE_ERROR;
-	if (j + 1 >= pend || pat[j] != '\\' || pat[j + 1] != '}')
+	if ((close = interval_close(pat, j, pend, extended)) == 0)
 		return BRE_ERROR;
 
-	rep->next_pi = j + 2;
+	rep->next_pi = j + close;
+	return BRE_OK;
+}
+
+BreResult parse_bre_repetition(const char* pat, int pi, int pend, BreRepetition* rep)
+{
+	if (pi + 5 > pend)
+	{
+		if (pi < pend && pat[pi] == '\\' && pi + 1 < pend && pat[pi + 1] == '{')
+			return BRE_ERROR;
+		return BRE_NOMATCH;
+	}
+	if (pat[pi] != '\\' || pat[pi + 1] != '{')
+		return BRE_NOMATCH;
+	return parse_interval(pat, pi + 2, pend, false, rep);
+}
+
+/* ERE quantifiers: *, +, ? and {n,m} */
+static BreResult parse_ere_quantifier(const char* pat, int at, int pend, BreRepetition* rep)
+{
+	if (at >= pend)
+		return BRE_NOMATCH;
+	switch (pat[at])
+	{
+	case '*':
+		rep->min = 0;
+		rep->max = -1;
+		break;
+	case '+':
+		rep->min = 1;
+		rep->max = -1;
+		break;
+	case '?':
+		rep->min = 0;
+		rep->max = 1;
+		break;
+	case '{':
+		return parse_interval(pat, at + 1, pend, true, rep);
+	default:
+		return BRE_NOMATCH;
+	}
+	rep->next_pi = at + 1;
 	return BRE_OK;
 }
 
@@ -208,29 +349,50 @@ static BreResult once_class(MatchContext* ctx, int atom_start, int atom_end, int
 	return BRE_OK;
 }
 
-/* Repetition with exact backtracking (prefix_out reports span of repeated atoms) */
+/* Repetition with exact backtracking (prefix_out reports span of repeated atoms).
+ * The atom is matched as often as it goes, counting up, and the advance of
+ * every occurrence is kept in a heap array; the rest of the pattern is then
+ * tried while giving occurrences back one at a time. Stack use does not
+ * depend on the count.
+ */
 
 static BreResult match_repeated(MatchContext* ctx, AtomOnceFn atom_once, int atom_start, int atom_end,
 	const BreRepetition* rep, BreMatch* m, int* total_out, int* prefix_out, void* user)
 {
-	(void)m;
 	int tpos = ctx->ti;
-	int max_possible = (rep->max < 0) ? 10000 : rep->max;
-	int advs[256];
+	int* advs = NULL;
+	int cap = 0;
 	int have = 0;
+	BreResult result = BRE_NOMATCH;
 
-	while (have < max_possible)
+	while (rep->max < 0 || have < rep->max)
 	{
 		int adv = 0;
 		BreResult r = atom_once(ctx, atom_start, atom_end, tpos, &adv, user);
 		if (r == BRE_ERROR)
+		{
+			free(advs);
 			return BRE_ERROR;
+		}
 		if (r != BRE_OK)
 			break;
-		if (have < (int)(sizeof(advs) / sizeof(advs[0])))
-			advs[have] = adv;
+		if (have == cap)
+		{
+			int ncap = cap ? cap * 2 : 64;
+			int* na = (int*)realloc(advs, (size_t)ncap * sizeof(int));
+			if (!na)
+			{
+				free(advs);
+				return BRE_ERROR;
+			}
+			advs = na;
+			cap = ncap;
+		}
+		advs[have++] = adv;
 		tpos += adv;
-		have++;
+		/* Once the minimum is met, further empty occurrences add nothing */
+		if (adv == 0 && have >= rep->min)
+			break;
 	}
 
 	while (have >= rep->min)
@@ -241,21 +403,24 @@ static BreResult match_repeated(MatchContext* ctx, AtomOnceFn atom_once, int ato
 		int rest_total = 0;
 		BreResult rr = match_here(&rest_ctx, m, &rest_total);
 		if (rr == BRE_ERROR)
-			return BRE_ERROR;
+		{
+			result = BRE_ERROR;
+			break;
+		}
 		if (rr == BRE_OK)
 		{
 			if (prefix_out)
 				*prefix_out = tpos - ctx->ti;
 			*total_out = (tpos - ctx->ti) + rest_total;
-			return BRE_OK;
+			result = BRE_OK;
+			break;
 		}
 		if (have == 0)
 			break;
-		int last_adv = (have <= (int)(sizeof(advs) / sizeof(advs[0]))) ? advs[have - 1] : 1;
-		tpos -= last_adv;
-		have--;
+		tpos -= advs[--have];
 	}
-	return BRE_NOMATCH;
+	free(advs);
+	return result;
 }
 
 /* Group Handling */
@@ -411,17 +576,6 @@ BreResult match_group(MatchContext* ctx, BreMatch* m, int* total_out)
 }
 /* Dispatcher */
 
-static int find_class_end_simple(const char* pat, int pi, int pend)
-{
-	int i = pi + 1;
-	if (i < pend && pat[i] == '^')
-		i++;
-	for (; i < pend; ++i)
-		if (pat[i] == ']')
-			return i + 1;
-	return -1;
-}
-
 static BreResult match_here(MatchContext* ctx, BreMatch* m, int* total_out)
 {
 	if (ctx->pi >= ctx->pend)
@@ -460,7 +614,8 @@ static BreResult match_here(MatchContext* ctx, BreMatch* m, int* total_out)
 	if (ctx->pat[ctx->pi] == '[')
 	{
 		int atom_start = ctx->pi;
-		int atom_end = find_class_end_simple(ctx->pat, atom_start, ctx->pend);
+		unsigned char map[32];
+		int atom_end = parse_bracket(ctx->pat, atom_start, ctx->pend, false, map);
 		if (atom_end < 0)
 			return BRE_ERROR;
 		BreRepetition rep = { .min = 1, .max = 1, .next_pi = atom_end };
@@ -530,176 +685,1539 @@ static BreResult match_here(MatchContext* ctx, BreMatch* m, int* total_out)
 	}
 }
 
-/* Sort captured groups in BreMatch by ascending start index.
-   - Only the first match->num_groups entries are considered.
-   - Groups with start < 0 (unset) are placed at the end.
-*/
-static void bre_sort_groups_by_start(BreMatch* match)
-{
-	if (!match || match->num_groups <= 1)
-		return;
+/* Compiled programs
+ *
+ * bre_compile() parses a pattern once into a small syntax tree and then
+ * flattens it into an instruction array.  Group boundaries become SAVE
+ * instructions on capture slots, repetitions are expanded into SPLIT/JMP
+ * loops, and bracket expressions become byte maps so the executor never has
+ * to rescan the pattern text.  ERE patterns have a parser of their own but
+ * build the same tree, with alternation as one more node type, so every
+ * engine runs them unchanged.
+ */
 
-	int n = match->num_groups;
+#define BRE_MAX_PROGRAM (1 << 18) /* instruction limit for expanded repetitions */
+#define BRE_MAX_LITERAL 64        /* longest required literal kept for prefiltering */
 
-	// Simple stable insertion sort by start (treat -1 as +infinity)
-	for (int i = 1; i < n; i++)
-	{
-		int s = match->groups[i].start;
-		int l = match->groups[i].length;
+typedef enum
+{
+	BRE_NODE_EMPTY,
+	BRE_NODE_CHAR,
+	BRE_NODE_ANY,
+	BRE_NODE_CLASS,
+	BRE_NODE_BOL,
+	BRE_NODE_EOL,
+	BRE_NODE_GROUP,
+	BRE_NODE_BACKREF,
+	BRE_NODE_CAT,
+	BRE_NODE_ALT,
+	BRE_NODE_REPEAT
+} BreNodeType;
 
-		// Map -1 to a large value so unset groups go to the end
-		int key = (s < 0) ? INT_MAX : s;
+typedef struct
+{
+	BreNodeType type;
+	int arg;   /* byte, class index or group number */
+	int min;   /* REPEAT bounds; max == -1 means unbounded */
+	int max;
+	int left;  /* child (GROUP, REPEAT) or first operand (CAT, ALT) */
+	int right; /* second operand (CAT, ALT) */
+} BreNode;
 
-		int j = i - 1;
-		while (j >= 0)
-		{
-			int js = match->groups[j].start;
-			int jkey = (js < 0) ? INT_MAX : js;
+typedef struct
+{
+	const char* pat;
+	int pi;
+	int pend;
+	BreNode* nodes;
+	int nnodes;
+	int cap;
+	int ngroups;
+	unsigned closed_groups; /* bit n set once group n has seen its \) */
+	BreClass* classes;      /* compiled bracket expressions, indexed by CLASS nodes */
+	int nclasses;
+	int class_cap;
+	bool has_backrefs;
+	bool icase;             /* store literal bytes lower case */
+	bool extended;          /* ERE syntax */
+	bool error;
+} BreParser;
 
-			if (jkey <= key)
-				break;
+typedef struct
+{
+	const BreNode* nodes;
+	BreInst* insts;
+	int ninsts;
+	int cap;
+	int nslots;
+	bool error;
+} BreEmitter;
+
+static int new_node(BreParser* p, BreNodeType type, int arg, int left, int right)
+{
+	if (p->nnodes == p->cap)
+	{
+		int ncap = p->cap ? p->cap * 2 : 32;
+		BreNode* nn = (BreNode*)realloc(p->nodes, (size_t)ncap * sizeof(BreNode));
+		if (!nn)
+		{
+			p->error = true;
+			return -1;
+		}
+		p->nodes = nn;
+		p->cap = ncap;
+	}
+	BreNode* n = &p->nodes[p->nnodes];
+	n->type = type;
+	n->arg = arg;
+	n->min = 1;
+	n->max = 1;
+	n->left = left;
+	n->right = right;
+	return p->nnodes++;
+}
 
-			match->groups[j + 1].start = match->groups[j].start;
-			match->groups[j + 1].length = match->groups[j].length;
-			j--;
+/* Reserve an empty bracket-expression map; returns its index or -1 */
+static int new_class(BreParser* p)
+{
+	if (p->nclasses == p->class_cap)
+	{
+		int ncap = p->class_cap ? p->class_cap * 2 : 4;
+		BreClass* nc = (BreClass*)realloc(p->classes, (size_t)ncap * sizeof(BreClass));
+		if (!nc)
+		{
+			p->error = true;
+			return -1;
 		}
-		match->groups[j + 1].start = s;
-		match->groups[j + 1].length = l;
+		p->classes = nc;
+		p->class_cap = ncap;
 	}
+	return p->nclasses++;
 }
 
-/* Public API */
-BreResult bre_match(const char* text, const char* pattern, BreMatch* match)
+static int char_node(BreParser* p, int c)
 {
-	if (!text || !pattern || !match)
-		return BRE_ERROR;
+	return new_node(p, BRE_NODE_CHAR, p->icase ? tolower(c) : c, -1, -1);
+}
 
-	match->start = -1;
-	match->length = 0;
-	match->num_groups = 0;
-	for (int i = 0; i < BRE_MAX_GROUPS; i++)
+static bool at_group_close(const BreParser* p, int at)
+{
+	if (p->extended)
+		return at < p->pend && p->pat[at] == ')';
+	return at + 1 < p->pend && p->pat[at] == '\\' && p->pat[at + 1] == ')';
+}
+
+static int parse_alternation(BreParser* p, bool in_group);
+
+/* Parse a group from its opening \( (or '(' in an ERE) through the matching close. */
+static int parse_group(BreParser* p)
+{
+	int delim = p->extended ? 1 : 2;
+	int group = ++p->ngroups;
+	p->pi += delim;
+	int inner = parse_alternation(p, true);
+	if (p->error)
+		return -1;
+	if (!at_group_close(p, p->pi))
 	{
-		match->groups[i].start = -1;
-		match->groups[i].length = 0;
+		p->error = true;
+		return -1;
 	}
+	p->pi += delim;
+	if (group < 32)
+		p->closed_groups |= 1u << group;
+	return new_node(p, BRE_NODE_GROUP, group, inner, -1);
+}
 
-	int plen = (int)strlen(pattern);
-	bool anchored_start = (plen > 0 && pattern[0] == '^');
-	int start_pi = anchored_start ? 1 : 0;
+/* Parse \1-\9 at p->pi; the group must already be closed. */
+static int parse_backref(BreParser* p)
+{
+	int group = p->pat[p->pi + 1] - '0';
+	if (!(p->closed_groups & (1u << group)))
+	{
+		p->error = true;
+		return -1;
+	}
+	p->has_backrefs = true;
+	p->pi += 2;
+	return new_node(p, BRE_NODE_BACKREF, group, -1, -1);
+}
 
-	// Base context template (pattern indices constant)
-	MatchContext base = { .base = text, .text = text, .ti = 0, .pat = pattern, .pi = start_pi, .pend = plen };
+/* Parse one ERE atom other than '.' and a bracket expression. '^' and '$'
+   are anchors wherever they appear, and a quantifier character that begins
+   a branch stands for itself. */
+static int parse_ere_atom(BreParser* p)
+{
+	const char* pat = p->pat;
+	char c = pat[p->pi];
 
-	if (anchored_start)
+	switch (c)
 	{
-		MatchContext ctx = base;
-		int consumed = 0;
-		BreResult r = match_here(&ctx, match, &consumed);
-		if (r == BRE_OK)
+	case '^':
+		p->pi++;
+		return new_node(p, BRE_NODE_BOL, 0, -1, -1);
+	case '$':
+		p->pi++;
+		return new_node(p, BRE_NODE_EOL, 0, -1, -1);
+	case '(':
+		return parse_group(p);
+	case ')':
+		/* A group's own ')' ends its sequence before getting here */
+		p->error = true;
+		return -1;
+	case '\\':
+		if (p->pi + 1 >= p->pend)
 		{
-			match->start = 0;
-			match->length = consumed;
-			bre_sort_groups_by_start(match);
+			p->error = true;
+			return -1;
 		}
-		return r;
+		if (pat[p->pi + 1] >= '1' && pat[p->pi + 1] <= '9')
+			return parse_backref(p);
+		p->pi += 2;
+		return char_node(p, (unsigned char)pat[p->pi - 1]);
+	default:
+		p->pi++;
+		return char_node(p, (unsigned char)c);
 	}
+}
+
+/* Parse one atom at p->pi. 'seq_start' tells whether the atom begins a
+   (sub)expression, where '*' is an ordinary character. */
+static int parse_atom(BreParser* p, bool in_group, bool seq_start)
+{
+	const char* pat = p->pat;
+	char c = pat[p->pi];
 
-	int tlen = (int)strlen(text);
-	for (int s = 0; s <= tlen; s++)
+	if (c == '.')
+	{
+		p->pi++;
+		return new_node(p, BRE_NODE_ANY, 0, -1, -1);
+	}
+	if (c == '[')
 	{
-		// Reset groups each try
-		match->num_groups = 0;
-		for (int i = 0; i < BRE_MAX_GROUPS; i++)
+		int cls = new_class(p);
+		if (cls < 0)
+			return -1;
+		int end = parse_bracket(pat, p->pi, p->pend, p->icase, p->classes[cls].bits);
+		if (end < 0)
 		{
-			match->groups[i].start = -1;
-			match->groups[i].length = 0;
+			p->error = true;
+			return -1;
+		}
+		p->pi = end;
+		return new_node(p, BRE_NODE_CLASS, cls, -1, -1);
+	}
+	if (p->extended)
+		return parse_ere_atom(p);
+	if (c == '$' && (p->pi + 1 == p->pend || (in_group && at_group_close(p, p->pi + 1))))
+	{
+		p->pi++;
+		return new_node(p, BRE_NODE_EOL, 0, -1, -1);
+	}
+	if (c == '*' && seq_start)
+	{
+		p->pi++;
+		return char_node(p, '*');
+	}
+	if (c == '\\')
+	{
+		if (p->pi + 1 >= p->pend)
+		{
+			p->error = true;
+			return -1;
+		}
+		char esc = pat[p->pi + 1];
+		if (esc == '(')
+			return parse_group(p);
+		if (esc == ')' || esc == '{' || esc == '}')
+		{
+			p->error = true;
+			return -1;
+		}
+		if (esc >= '1' && esc <= '9')
+			return parse_backref(p);
+		p->pi += 2;
+		return char_node(p, (unsigned char)esc);
+	}
+	p->pi++;
+	return char_node(p, (unsigned char)c);
+}
+
+/* Wrap 'atom' in REPEAT nodes for every quantifier that follows it. */
+static int parse_quantifiers(BreParser* p, int atom)
+{
+	for (;;)
+	{
+		BreRepetition rep;
+		BreResult qr = p->extended ? parse_ere_quantifier(p->pat, p->pi, p->pend, &rep)
+			: parse_quantifier(p->pat, p->pi, p->pend, &rep);
+		if (qr == BRE_ERROR)
+		{
+			p->error = true;
+			return -1;
 		}
+		if (qr == BRE_NOMATCH)
+			return atom;
+		int node = new_node(p, BRE_NODE_REPEAT, 0, atom, -1);
+		if (node < 0)
+			return -1;
+		p->nodes[node].min = rep.min;
+		p->nodes[node].max = rep.max;
+		p->pi = rep.next_pi;
+		atom = node;
+	}
+}
 
-		MatchContext ctx = base; // fresh copy
-		ctx.ti = s;
+/* Parse a concatenation up to the end of the pattern or, inside a group, up
+   to the closing \). An ERE sequence also ends at '|'. */
+static int parse_sequence(BreParser* p, bool in_group)
+{
+	int seq = -1;
+	bool seq_start = true;
 
-		int consumed = 0;
-		BreResult r = match_here(&ctx, match, &consumed);
-		if (r == BRE_ERROR)
-			return BRE_ERROR;
-		if (r == BRE_OK)
+	if (!p->extended && p->pi < p->pend && p->pat[p->pi] == '^')
+	{
+		p->pi++;
+		seq = new_node(p, BRE_NODE_BOL, 0, -1, -1);
+	}
+
+	while (!p->error && p->pi < p->pend)
+	{
+		if (at_group_close(p, p->pi))
 		{
-			match->start = s;
-			match->length = consumed;
-			bre_sort_groups_by_start(match);
-			return BRE_OK;
+			if (in_group)
+				break;
+			p->error = true;
+			return -1;
 		}
-		// else BRE_NOMATCH → try next s
+		if (p->extended && p->pat[p->pi] == '|')
+			break;
+		int atom = parse_atom(p, in_group, seq_start);
+		if (atom < 0)
+			return -1;
+		seq_start = false;
+		if (p->extended || p->nodes[atom].type != BRE_NODE_EOL)
+			atom = parse_quantifiers(p, atom);
+		if (atom < 0)
+			return -1;
+		seq = (seq < 0) ? atom : new_node(p, BRE_NODE_CAT, 0, seq, atom);
 	}
-	return BRE_NOMATCH;
+	if (p->error)
+		return -1;
+	if (seq < 0)
+		seq = new_node(p, BRE_NODE_EMPTY, 0, -1, -1);
+	return seq;
 }
 
-char* bre_substitute(const char* text, const char* pattern, const char* replacement)
+/* Parse sequences separated by '|' (ERE only). The alternatives nest to the
+   right, so the leftmost one is tried first. */
+static int parse_alternation(BreParser* p, bool in_group)
 {
-	if (!text || !pattern || !replacement)
-		return NULL;
+	int alt = parse_sequence(p, in_group);
+	if (alt < 0 || !p->extended || p->pi >= p->pend || p->pat[p->pi] != '|')
+		return alt;
+	p->pi++;
+	int rest = parse_alternation(p, in_group);
+	if (rest < 0)
+		return -1;
+	return new_node(p, BRE_NODE_ALT, 0, alt, rest);
+}
 
-	BreMatch m;
-	BreResult mr = bre_match(text, pattern, &m);
-	if (mr == BRE_ERROR)
-		return NULL;
+/* Does every match of node 'n' start at the beginning of the text? */
+static bool node_anchored(const BreNode* nodes, int n)
+{
+	const BreNode* node = &nodes[n];
+	switch (node->type)
+	{
+	case BRE_NODE_BOL:
+		return true;
+	case BRE_NODE_GROUP:
+	case BRE_NODE_CAT:
+		return node_anchored(nodes, node->left);
+	case BRE_NODE_ALT:
+		return node_anchored(nodes, node->left) && node_anchored(nodes, node->right);
+	default:
+		return false;
+	}
+}
 
-	if (mr == BRE_NOMATCH || m.start < 0)
+/* Shortest and longest text node 'n' can match; *max is -1 when unbounded.
+   Lengths that do not fit an int saturate (min) or count as unbounded (max). */
+static void node_length(const BreNode* nodes, int n, int* min, int* max)
+{
+	const BreNode* node = &nodes[n];
+	int amin, amax, bmin, bmax;
+	switch (node->type)
 	{
-		size_t n = strlen(text) + 1;
-		char* out = (char*)malloc(n);
-		if (!out)
-			return NULL;
-		memcpy(out, text, n);
-		return out;
+	case BRE_NODE_CHAR:
+	case BRE_NODE_ANY:
+	case BRE_NODE_CLASS:
+		*min = *max = 1;
+		return;
+	case BRE_NODE_GROUP:
+		node_length(nodes, node->left, min, max);
+		return;
+	case BRE_NODE_CAT:
+		node_length(nodes, node->left, &amin, &amax);
+		node_length(nodes, node->right, &bmin, &bmax);
+		*min = (amin > INT_MAX - bmin) ? INT_MAX : amin + bmin;
+		*max = (amax < 0 || bmax < 0 || amax > INT_MAX - bmax) ? -1 : amax + bmax;
+		return;
+	case BRE_NODE_ALT:
+		node_length(nodes, node->left, &amin, &amax);
+		node_length(nodes, node->right, &bmin, &bmax);
+		*min = amin < bmin ? amin : bmin;
+		*max = (amax < 0 || bmax < 0) ? -1 : (amax > bmax ? amax : bmax);
+		return;
+	case BRE_NODE_REPEAT:
+	{
+		node_length(nodes, node->left, &amin, &amax);
+		long long lo = (long long)amin * node->min;
+		long long hi = (amax == 0) ? 0 : (amax < 0 || node->max < 0) ? -1 : (long long)amax * node->max;
+		*min = lo > INT_MAX ? INT_MAX : (int)lo;
+		*max = hi > INT_MAX ? -1 : (int)hi;
+		return;
+	}
+	case BRE_NODE_BACKREF:
+		*min = 0;
+		*max = -1;
+		return;
+	default:
+		/* anchors and empty */
+		*min = *max = 0;
+		return;
 	}
+}
 
-	size_t prefix_len = (size_t)m.start;
-	size_t suffix_len = strlen(text) - (size_t)m.start - (size_t)m.length;
+/* Does every match of node 'n' end at the end of the text? */
+static bool node_end_anchored(const BreNode* nodes, int n)
+{
+	const BreNode* node = &nodes[n];
+	switch (node->type)
+	{
+	case BRE_NODE_EOL:
+		return true;
+	case BRE_NODE_GROUP:
+		return node_end_anchored(nodes, node->left);
+	case BRE_NODE_CAT:
+		return node_end_anchored(nodes, node->right);
+	case BRE_NODE_ALT:
+		return node_end_anchored(nodes, node->left) && node_end_anchored(nodes, node->right);
+	default:
+		return false;
+	}
+}
 
-	size_t rep_len = 0;
-	for (const char* r = replacement; *r; r++)
+static bool node_nullable(const BreNode* nodes, int n)
+{
+	const BreNode* node = &nodes[n];
+	switch (node->type)
 	{
-		if (*r == '\\' && r[1] >= '1' && r[1] <= '9')
-		{
-			int g = r[1] - '1';
-			if (g >= 0 && g < m.num_groups && m.groups[g].start >= 0)
-				rep_len += (size_t)m.groups[g].length;
-			r++;
-		}
-		else
-		{
-			rep_len++;
-		}
+	case BRE_NODE_CHAR:
+	case BRE_NODE_ANY:
+	case BRE_NODE_CLASS:
+		return false;
+	case BRE_NODE_GROUP:
+		return node_nullable(nodes, node->left);
+	case BRE_NODE_CAT:
+		return node_nullable(nodes, node->left) && node_nullable(nodes, node->right);
+	case BRE_NODE_ALT:
+		return node_nullable(nodes, node->left) || node_nullable(nodes, node->right);
+	case BRE_NODE_REPEAT:
+		return node->min == 0 || node_nullable(nodes, node->left);
+	default:
+		/* anchors, empty and back-references (the group may be empty) */
+		return true;
 	}
+}
 
-	size_t out_len = prefix_len + rep_len + suffix_len;
-	char* out = (char*)malloc(out_len + 1);
-	if (!out)
-		return NULL;
+/* Literal analysis. For every node we track the text each match must begin
+ * and end with, the longest text every match must contain, and whether the
+ * node only ever matches one fixed string. Strings longer than
+ * BRE_MAX_LITERAL are cut down, which keeps them required but inexact.
+ */
+typedef struct
+{
+	char s[BRE_MAX_LITERAL];
+	int len;
+} BreLit;
+
+typedef struct
+{
+	bool exact; /* always matches exactly 'prefix' (== 'suffix' == 'req') */
+	BreLit prefix;
+	BreLit suffix;
+	BreLit req;
+} BreLitInfo;
 
-	memcpy(out, text, prefix_len);
-	char* p = out + prefix_len;
+static void lit_cat(BreLit* dst, const BreLit* a, const BreLit* b, bool keep_end)
+{
+	int total = a->len + b->len;
+	int drop = total > BRE_MAX_LITERAL ? total - BRE_MAX_LITERAL : 0;
+	char tmp[2 * BRE_MAX_LITERAL];
+	memcpy(tmp, a->s, (size_t)a->len);
+	memcpy(tmp + a->len, b->s, (size_t)b->len);
+	dst->len = total - drop;
+	memcpy(dst->s, tmp + (keep_end ? drop : 0), (size_t)dst->len);
+}
 
-	for (const char* r = replacement; *r; r++)
+static void lit_best(BreLit* best, const BreLit* cand)
+{
+	if (cand->len > best->len)
+		*best = *cand;
+}
+
+static void lit_info(const BreNode* nodes, int n, BreLitInfo* out)
+{
+	const BreNode* node = &nodes[n];
+	memset(out, 0, sizeof(*out));
+	switch (node->type)
 	{
-		if (*r == '\\' && r[1] >= '1' && r[1] <= '9')
+	case BRE_NODE_CHAR:
+		out->exact = true;
+		out->prefix.s[0] = (char)node->arg;
+		out->prefix.len = 1;
+		out->suffix = out->req = out->prefix;
+		break;
+	case BRE_NODE_EMPTY:
+	case BRE_NODE_BOL:
+	case BRE_NODE_EOL:
+		out->exact = true;
+		break;
+	case BRE_NODE_GROUP:
+		lit_info(nodes, node->left, out);
+		break;
+	case BRE_NODE_CAT:
+	{
+		BreLitInfo a, b;
+		lit_info(nodes, node->left, &a);
+		lit_info(nodes, node->right, &b);
+		BreLit join;
+		lit_cat(&join, &a.suffix, &b.prefix, false);
+		out->req = a.req;
+		lit_best(&out->req, &b.req);
+		lit_best(&out->req, &join);
+		if (a.exact)
+			lit_cat(&out->prefix, &a.prefix, &b.prefix, false);
+		else
+			out->prefix = a.prefix;
+		if (b.exact)
+			lit_cat(&out->suffix, &a.suffix, &b.suffix, true);
+		else
+			out->suffix = b.suffix;
+		out->exact = a.exact && b.exact && a.prefix.len + b.prefix.len <= BRE_MAX_LITERAL;
+		break;
+	}
+	case BRE_NODE_REPEAT:
+	{
+		if (node->min == 0)
+			break;
+		BreLitInfo c;
+		lit_info(nodes, node->left, &c);
+		out->prefix = c.prefix;
+		out->suffix = c.suffix;
+		out->req = c.req;
+		if (c.exact && node->min == node->max)
 		{
-			int g = r[1] - '1';
-			if (g >= 0 && g < m.num_groups && m.groups[g].start >= 0)
+			/* x\{n\} is the fixed string x repeated n times */
+			for (int i = 1; i < node->min && out->prefix.len < BRE_MAX_LITERAL; i++)
 			{
-				memcpy(p, text + m.groups[g].start, (size_t)m.groups[g].length);
-				p += m.groups[g].length;
+				lit_cat(&out->prefix, &out->prefix, &c.prefix, false);
+				lit_cat(&out->suffix, &out->suffix, &c.suffix, true);
 			}
-			r++;
-		}
-		else
-		{
-			*p++ = *r;
+			out->req = out->prefix;
+			out->exact = (long)c.prefix.len * node->min <= BRE_MAX_LITERAL;
 		}
+		break;
 	}
+	default:
+		/* ANY, CLASS, BACKREF and ALT match varying text */
+		break;
+	}
+}
 
-	memcpy(p, text + m.start + m.length, suffix_len);
-	out[out_len] = '\0';
+/* Fill prog->first with the bytes a match can start with. Left empty when
+   a match may be empty or start with any byte. */
+void bre_compute_first_bytes(BreProgram* prog)
+{
+	int* stack = (int*)malloc((size_t)prog->ninsts * sizeof(int));
+	bool* seen = (bool*)calloc((size_t)prog->ninsts, sizeof(bool));
+	bool ok = stack && seen;
+	int top = 0;
+	unsigned char first[32] = { 0 };
+
+	if (ok)
+		stack[top++] = 0;
+	while (ok && top > 0)
+	{
+		int pc = stack[--top];
+		if (seen[pc])
+			continue;
+		seen[pc] = true;
+		const BreInst* in = &prog->insts[pc];
+		switch ((BreOpcode)in->op)
+		{
+		case BRE_OP_CHAR:
+		{
+			int up = prog->icase ? toupper(in->arg) : in->arg;
+			first[in->arg >> 3] |= (unsigned char)(1u << (in->arg & 7));
+			first[up >> 3] |= (unsigned char)(1u << (up & 7));
+			break;
+		}
+		case BRE_OP_CLASS:
+			for (int k = 0; k < 32; k++)
+				first[k] |= prog->classes[in->arg].bits[k];
+			break;
+		case BRE_OP_SPLIT:
+			stack[top++] = in->y;
+			stack[top++] = in->x;
+			break;
+		case BRE_OP_JMP:
+			stack[top++] = in->x;
+			break;
+		case BRE_OP_SAVE:
+		case BRE_OP_BOL:
+		case BRE_OP_PROGRESS:
+			stack[top++] = pc + 1;
+			break;
+		default:
+			/* ANY, EOL, BACKREF or MATCH: no useful restriction */
+			ok = false;
+			break;
+		}
+	}
+	free(stack);
+	free(seen);
+
+	prog->first_byte = -1;
+	prog->has_first = false;
+	if (!ok)
+		return;
+	int count = 0;
+	for (int c = 0; c < 256; c++)
+	{
+		if (first[c >> 3] & (1u << (c & 7)))
+		{
+			count++;
+			prog->first_byte = c;
+		}
+	}
+	if (count == 0 || count == 256)
+	{
+		prog->first_byte = -1;
+		return;
+	}
+	if (count > 1)
+		prog->first_byte = -1;
+	memcpy(prog->first, first, sizeof(first));
+	prog->has_first = true;
+}
+
+/* Number the instructions from which no BACKREF or PROGRESS can be reached,
+   the ones whose outcome the backtracker may memoize, in prog->memo_pc. */
+static bool compute_memo_pcs(BreProgram* prog)
+{
+	int n = prog->ninsts;
+	bool* tainted = (bool*)calloc((size_t)n, sizeof(bool));
+	prog->memo_pc = (int*)malloc((size_t)n * sizeof(int));
+	if (!tainted || !prog->memo_pc)
+	{
+		free(tainted);
+		return false;
+	}
+	/* Propagate backwards along the edges until nothing changes; loops need
+	   more than one pass */
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (int pc = n - 1; pc >= 0; pc--)
+		{
+			const BreInst* in = &prog->insts[pc];
+			bool t;
+			switch ((BreOpcode)in->op)
+			{
+			case BRE_OP_BACKREF:
+			case BRE_OP_PROGRESS:
+				t = true;
+				break;
+			case BRE_OP_SPLIT:
+				t = tainted[in->x] || tainted[in->y];
+				break;
+			case BRE_OP_JMP:
+				t = tainted[in->x];
+				break;
+			case BRE_OP_MATCH:
+				t = false;
+				break;
+			default:
+				t = tainted[pc + 1];
+				break;
+			}
+			if (t && !tainted[pc])
+			{
+				tainted[pc] = true;
+				changed = true;
+			}
+		}
+	}
+	prog->nmemo = 0;
+	for (int pc = 0; pc < n; pc++)
+		prog->memo_pc[pc] = tainted[pc] ? -1 : prog->nmemo++;
+	free(tainted);
+	return true;
+}
+
+static int emit(BreEmitter* e, BreOpcode op, int arg, int x, int y)
+{
+	if (e->error)
+		return -1;
+	if (e->ninsts >= BRE_MAX_PROGRAM)
+	{
+		e->error = true;
+		return -1;
+	}
+	if (e->ninsts == e->cap)
+	{
+		int ncap = e->cap ? e->cap * 2 : 64;
+		BreInst* ni = (BreInst*)realloc(e->insts, (size_t)ncap * sizeof(BreInst));
+		if (!ni)
+		{
+			e->error = true;
+			return -1;
+		}
+		e->insts = ni;
+		e->cap = ncap;
+	}
+	BreInst* in = &e->insts[e->ninsts];
+	in->op = (unsigned char)op;
+	in->arg = arg;
+	in->x = x;
+	in->y = y;
+	return e->ninsts++;
+}
+
+static void gen_node(BreEmitter* e, int n);
+
+/* Emit 'body' repeated min..max times (max < 0: unbounded), greedily. */
+static void gen_repeat(BreEmitter* e, int body, int min, int max)
+{
+	for (int i = 0; i < min && !e->error; i++)
+		gen_node(e, body);
+
+	if (max < 0)
+	{
+		int loop = emit(e, BRE_OP_SPLIT, 0, 0, 0);
+		if (loop < 0)
+			return;
+		e->insts[loop].x = loop + 1;
+		if (node_nullable(e->nodes, body))
+		{
+			/* Guard against looping forever on an empty iteration */
+			int reg = e->nslots++;
+			emit(e, BRE_OP_SAVE, reg, 0, 0);
+			gen_node(e, body);
+			emit(e, BRE_OP_PROGRESS, reg, 0, 0);
+		}
+		else
+		{
+			gen_node(e, body);
+		}
+		emit(e, BRE_OP_JMP, 0, loop, 0);
+		if (!e->error)
+			e->insts[loop].y = e->ninsts;
+		return;
+	}
+
+	/* Optional copies: each SPLIT may skip the rest of the chain. The pending
+	   exits are threaded through 'y' and patched once the end is known. */
+	int pending = -1;
+	for (int i = min; i < max && !e->error; i++)
+	{
+		int split = emit(e, BRE_OP_SPLIT, 0, 0, pending);
+		if (split < 0)
+			return;
+		e->insts[split].x = split + 1;
+		pending = split;
+		gen_node(e, body);
+	}
+	if (e->error)
+		return;
+	while (pending >= 0)
+	{
+		int next = e->insts[pending].y;
+		e->insts[pending].y = e->ninsts;
+		pending = next;
+	}
+}
+
+static void gen_node(BreEmitter* e, int n)
+{
+	const BreNode* node = &e->nodes[n];
+	switch (node->type)
+	{
+	case BRE_NODE_EMPTY:
+		break;
+	case BRE_NODE_CHAR:
+		emit(e, BRE_OP_CHAR, node->arg, 0, 0);
+		break;
+	case BRE_NODE_ANY:
+		emit(e, BRE_OP_ANY, 0, 0, 0);
+		break;
+	case BRE_NODE_CLASS:
+		emit(e, BRE_OP_CLASS, node->arg, 0, 0);
+		break;
+	case BRE_NODE_BOL:
+		emit(e, BRE_OP_BOL, 0, 0, 0);
+		break;
+	case BRE_NODE_EOL:
+		emit(e, BRE_OP_EOL, 0, 0, 0);
+		break;
+	case BRE_NODE_GROUP:
+		emit(e, BRE_OP_SAVE, 2 * node->arg, 0, 0);
+		gen_node(e, node->left);
+		emit(e, BRE_OP_SAVE, 2 * node->arg + 1, 0, 0);
+		break;
+	case BRE_NODE_BACKREF:
+		emit(e, BRE_OP_BACKREF, node->arg, 0, 0);
+		break;
+	case BRE_NODE_CAT:
+		gen_node(e, node->left);
+		gen_node(e, node->right);
+		break;
+	case BRE_NODE_ALT:
+	{
+		/* SPLIT to both alternatives; the first jumps over the second */
+		int split = emit(e, BRE_OP_SPLIT, 0, 0, 0);
+		if (split < 0)
+			return;
+		e->insts[split].x = split + 1;
+		gen_node(e, node->left);
+		int jmp = emit(e, BRE_OP_JMP, 0, 0, 0);
+		if (jmp < 0)
+			return;
+		e->insts[split].y = e->ninsts;
+		gen_node(e, node->right);
+		if (!e->error)
+			e->insts[jmp].x = e->ninsts;
+		break;
+	}
+	case BRE_NODE_REPEAT:
+		/* A repeated group saves inside each pass: it holds the last one,
+		   and stays unset if the group never matched */
+		gen_repeat(e, node->left, node->min, node->max);
+		break;
+	}
+}
+
+BreProgram* bre_compile(const char* pattern)
+{
+	return bre_compile_flags(pattern, 0);
+}
+
+BreProgram* ere_compile(const char* pattern)
+{
+	return bre_compile_flags(pattern, BRE_EXTENDED);
+}
+
+BreProgram* bre_compile_flags(const char* pattern, int flags)
+{
+	if (!pattern)
+		return NULL;
+
+	BreParser p = { .pat = pattern, .pi = 0, .pend = (int)strlen(pattern), .icase = (flags & BRE_ICASE) != 0,
+		.extended = (flags & BRE_EXTENDED) != 0 };
+	int root = parse_alternation(&p, false);
+	if (!p.error && root >= 0 && (flags & BRE_WHOLE))
+	{
+		int bol = new_node(&p, BRE_NODE_BOL, 0, -1, -1);
+		int eol = new_node(&p, BRE_NODE_EOL, 0, -1, -1);
+		if (!p.error)
+			root = new_node(&p, BRE_NODE_CAT, 0, new_node(&p, BRE_NODE_CAT, 0, bol, root), eol);
+	}
+	if (p.error || root < 0 || p.pi != p.pend)
+	{
+		free(p.nodes);
+		free(p.classes);
+		return NULL;
+	}
+
+	BreEmitter e = { .nodes = p.nodes, .nslots = 2 * (p.ngroups + 1) };
+	emit(&e, BRE_OP_SAVE, 0, 0, 0);
+	gen_node(&e, root);
+	emit(&e, BRE_OP_SAVE, 1, 0, 0);
+	emit(&e, BRE_OP_MATCH, 0, 0, 0);
+
+	BreProgram* prog = NULL;
+	if (!e.error)
+		prog = (BreProgram*)calloc(1, sizeof(BreProgram));
+	if (!prog)
+	{
+		free(e.insts);
+		free(p.nodes);
+		free(p.classes);
+		return NULL;
+	}
+
+	prog->classes = p.classes;
+	prog->nclasses = p.nclasses;
+	prog->insts = e.insts;
+	prog->ninsts = e.ninsts;
+	prog->ngroups = p.ngroups;
+	prog->nslots = e.nslots;
+	prog->anchored = node_anchored(p.nodes, root);
+	prog->end_anchored = node_end_anchored(p.nodes, root);
+	node_length(p.nodes, root, &prog->min_len, &prog->max_len);
+	prog->has_backrefs = p.has_backrefs;
+	prog->icase = p.icase;
+	prog->longest = p.extended;
+	bre_set_limits(prog, NULL);
+
+	BreLitInfo info;
+	lit_info(p.nodes, root, &info);
+	free(p.nodes);
+	if (info.req.len > 0)
+	{
+		prog->literal = (char*)malloc((size_t)info.req.len + 1);
+		if (!prog->literal)
+		{
+			bre_free(prog);
+			return NULL;
+		}
+		memcpy(prog->literal, info.req.s, (size_t)info.req.len);
+		prog->literal[info.req.len] = '\0';
+		prog->literal_len = info.req.len;
+		prog->literal_search = lit_compile(prog->literal, (size_t)prog->literal_len, prog->icase);
+		if (!prog->literal_search)
+		{
+			bre_free(prog);
+			return NULL;
+		}
+	}
+	bre_compute_first_bytes(prog);
+	if (prog->has_backrefs && !compute_memo_pcs(prog))
+	{
+		bre_free(prog);
+		return NULL;
+	}
+	return prog;
+}
+
+void bre_set_limits(BreProgram* prog, const BreLimits* limits)
+{
+	if (!prog)
+		return;
+	if (limits)
+	{
+		prog->limits = *limits;
+		return;
+	}
+	prog->limits.max_steps = BRE_DEFAULT_MAX_STEPS;
+	prog->limits.max_depth = BRE_DEFAULT_MAX_DEPTH;
+	prog->limits.memoize = true;
+}
+
+void bre_free(BreProgram* prog)
+{
+	if (!prog)
+		return;
+	bre_scratch_free(prog->scratch);
+	free(prog->literal);
+	lit_free(prog->literal_search);
+	free(prog->insts);
+	free(prog->classes);
+	free(prog->memo_pc);
+	free(prog);
+}
+
+/* Backtracking executor
+ *
+ * Alternatives and slot updates are kept on an explicit heap stack so that
+ * long runs of a repeated atom do not translate into C recursion.
+ *
+ * Back-references make the search exponential in the worst case, so every
+ * search runs under a budget of executed instructions and stack entries
+ * and gives up with BRE_LIMIT once either is spent. Where the rest of a
+ * match cannot depend on captured text or loop registers (no BACKREF or
+ * PROGRESS is reachable), the outcome of a thread depends only on its
+ * instruction and text position; those pairs are remembered in a bitmap
+ * once visited, and a second thread reaching one is dropped, since the
+ * first already explored everything it could do.
+ */
+
+typedef struct
+{
+	int pc;   /* resume point, or -1 for a slot restore */
+	int sp;   /* text position, or the slot index to restore */
+	int old;  /* previous slot value for restores */
+} BtFrame;
+
+typedef struct
+{
+	BtFrame* frames;
+	int n;
+	int cap;
+	int peak;             /* deepest the stack has been */
+	unsigned long steps;  /* instructions executed so far in this search */
+	unsigned char* memo;  /* visited (pc, sp) bits, (len + 1) per memo_pc entry, or NULL */
+	int* best;            /* prog->longest: slots of the longest match from this start */
+	bool found;           /* 'best' holds a match */
+} BtStack;
+
+static BreResult bt_push(const BreProgram* prog, BtStack* st, int pc, int sp, int old)
+{
+	if (st->n == st->cap)
+	{
+		if (prog->limits.max_depth && (size_t)st->n >= prog->limits.max_depth)
+			return BRE_LIMIT;
+		int ncap = st->cap ? st->cap * 2 : 64;
+		if (prog->limits.max_depth && (size_t)ncap > prog->limits.max_depth)
+			ncap = (int)prog->limits.max_depth;
+		BtFrame* nf = (BtFrame*)realloc(st->frames, (size_t)ncap * sizeof(BtFrame));
+		if (!nf)
+			return BRE_ERROR;
+		st->frames = nf;
+		st->cap = ncap;
+	}
+	st->frames[st->n].pc = pc;
+	st->frames[st->n].sp = sp;
+	st->frames[st->n].old = old;
+	st->n++;
+	if (st->n > st->peak)
+		st->peak = st->n;
+	return BRE_OK;
+}
+
+/* Run the program anchored at 'start'. Returns BRE_OK with 'slots' filled in,
+   BRE_NOMATCH, BRE_LIMIT when the budget runs out, or BRE_ERROR if the
+   backtrack stack cannot grow. */
+static BreResult bt_run(const BreProgram* prog, const char* text, int len, int start, int* slots, BtStack* st)
+{
+	const BreInst* insts = prog->insts;
+	unsigned long max_steps = prog->limits.max_steps;
+
+	for (int i = 0; i < prog->nslots; i++)
+		slots[i] = -1;
+	st->n = 0;
+	st->found = false;
+	BreResult pr = bt_push(prog, st, 0, start, 0);
+	if (pr != BRE_OK)
+		return pr;
+
+	while (st->n > 0)
+	{
+		BtFrame f = st->frames[--st->n];
+		if (f.pc < 0)
+		{
+			slots[f.sp] = f.old;
+			continue;
+		}
+
+		int pc = f.pc;
+		int sp = f.sp;
+		for (;;)
+		{
+			if (max_steps && ++st->steps > max_steps)
+				return BRE_LIMIT;
+			if (st->memo && prog->memo_pc[pc] >= 0 && sp <= len)
+			{
+				size_t bit = (size_t)prog->memo_pc[pc] * (size_t)(len + 1) + (size_t)sp;
+				if (st->memo[bit >> 3] & (1u << (bit & 7)))
+					break;
+				st->memo[bit >> 3] |= (unsigned char)(1u << (bit & 7));
+			}
+			const BreInst* in = &insts[pc];
+			bool ok = true;
+			switch ((BreOpcode)in->op)
+			{
+			case BRE_OP_CHAR:
+				ok = sp < len && bre_fold(prog, (unsigned char)text[sp]) == in->arg;
+				sp++;
+				pc++;
+				break;
+			case BRE_OP_ANY:
+				ok = sp < len;
+				sp++;
+				pc++;
+				break;
+			case BRE_OP_CLASS:
+				ok = sp < len && bre_class_contains(prog, in->arg, (unsigned char)text[sp]);
+				sp++;
+				pc++;
+				break;
+			case BRE_OP_BOL:
+				ok = sp == 0;
+				pc++;
+				break;
+			case BRE_OP_EOL:
+				ok = sp == len;
+				pc++;
+				break;
+			case BRE_OP_SAVE:
+				pr = bt_push(prog, st, -1, in->arg, slots[in->arg]);
+				if (pr != BRE_OK)
+					return pr;
+				slots[in->arg] = sp;
+				pc++;
+				break;
+			case BRE_OP_SPLIT:
+				pr = bt_push(prog, st, in->y, sp, 0);
+				if (pr != BRE_OK)
+					return pr;
+				pc = in->x;
+				break;
+			case BRE_OP_JMP:
+				pc = in->x;
+				break;
+			case BRE_OP_BACKREF:
+			{
+				int gs = slots[2 * in->arg];
+				int ge = slots[2 * in->arg + 1];
+				ok = gs >= 0 && ge >= gs && ge - gs <= len - sp;
+				if (ok && !prog->icase)
+					ok = memcmp(text + gs, text + sp, (size_t)(ge - gs)) == 0;
+				for (int k = 0; ok && prog->icase && k < ge - gs; k++)
+					ok = tolower((unsigned char)text[gs + k]) == tolower((unsigned char)text[sp + k]);
+				if (ok)
+					sp += ge - gs;
+				pc++;
+				break;
+			}
+			case BRE_OP_PROGRESS:
+				ok = slots[in->arg] != sp;
+				pc++;
+				break;
+			case BRE_OP_MATCH:
+				if (!prog->longest)
+					return BRE_OK;
+				/* Keep the longest and go on looking for a longer one */
+				if (!st->found || slots[1] > st->best[1])
+					memcpy(st->best, slots, (size_t)prog->nslots * sizeof(int));
+				st->found = true;
+				ok = false;
+				break;
+			}
+			if (!ok)
+				break;
+		}
+	}
+	if (st->found)
+	{
+		memcpy(slots, st->best, (size_t)prog->nslots * sizeof(int));
+		return BRE_OK;
+	}
+	return BRE_NOMATCH;
+}
+
+static void fill_match(const BreProgram* prog, const int* slots, BreMatch* match)
+{
+	match->start = slots[0];
+	match->length = slots[1] - slots[0];
+	match->num_groups = prog->ngroups < BRE_MAX_GROUPS ? prog->ngroups : BRE_MAX_GROUPS;
+	for (int i = 0; i < BRE_MAX_GROUPS; i++)
+	{
+		int gs = (i < match->num_groups) ? slots[2 * (i + 1)] : -1;
+		int ge = (i < match->num_groups) ? slots[2 * (i + 1) + 1] : -1;
+		if (gs >= 0 && ge >= gs)
+		{
+			match->groups[i].start = gs;
+			match->groups[i].length = ge - gs;
+		}
+		else
+		{
+			match->groups[i].start = -1;
+			match->groups[i].length = 0;
+		}
+	}
+}
+
+static void clear_match(BreMatch* match)
+{
+	match->start = -1;
+	match->length = 0;
+	match->num_groups = 0;
+	for (int i = 0; i < BRE_MAX_GROUPS; i++)
+	{
+		match->groups[i].start = -1;
+		match->groups[i].length = 0;
+	}
+}
+
+bool bre_literal_possible(const BreProgram* prog, const char* text, int len, int start)
+{
+	if (!prog->literal_search)
+		return true;
+	if (start >= len)
+		return false;
+	return lit_find(prog->literal_search, text + start, (size_t)(len - start)) != NULL;
+}
+
+int bre_skip_to_first(const BreProgram* prog, const char* text, int len, int sp)
+{
+	if (!prog->has_first)
+		return sp;
+	if (prog->first_byte >= 0)
+	{
+		const char* hit = sp < len ? (const char*)memchr(text + sp, prog->first_byte, (size_t)(len - sp)) : NULL;
+		return hit ? (int)(hit - text) : len;
+	}
+	while (sp < len && !bre_bitmap_has(prog->first, (unsigned char)text[sp]))
+		sp++;
+	return sp;
+}
+
+BreResult bre_backtrack_search(const BreProgram* prog, const char* text, int len, int start, int* slots, int* peak_depth)
+{
+	if (peak_depth)
+		*peak_depth = 0;
+	if (!bre_search_window(prog, len, &start) || !bre_literal_possible(prog, text, len, start))
+		return BRE_NOMATCH;
+
+	BtStack st = { 0 };
+	if (prog->limits.memoize && prog->nmemo > 0 &&
+		(size_t)prog->nmemo * (size_t)(len + 1) <= BRE_MEMO_MAX_BITS)
+	{
+		/* A visited pair fails whatever the start, so the bitmap serves all starts */
+		st.memo = (unsigned char*)calloc(((size_t)prog->nmemo * (size_t)(len + 1) + 7) / 8, 1);
+		if (!st.memo)
+			return BRE_ERROR;
+	}
+	if (prog->longest)
+	{
+		st.best = (int*)malloc((size_t)prog->nslots * sizeof(int));
+		if (!st.best)
+		{
+			free(st.memo);
+			return BRE_ERROR;
+		}
+	}
+	BreResult r = BRE_NOMATCH;
+	int last = prog->anchored ? start : len - prog->min_len;
+	for (int s = start; s <= last; s++)
+	{
+		if (!prog->anchored)
+		{
+			s = bre_skip_to_first(prog, text, len, s);
+			/* has_first means no empty match, so none can start at len */
+			if ((s == len && prog->has_first) || s > last)
+				break;
+		}
+		r = bt_run(prog, text, len, s, slots, &st);
+		if (r != BRE_NOMATCH)
+			break;
+	}
+	free(st.frames);
+	free(st.memo);
+	free(st.best);
+	if (peak_depth)
+		*peak_depth = st.peak;
+	return r;
+}
+
+/* Scratch space */
+
+BreScratch* bre_scratch_alloc(const BreProgram* prog)
+{
+	BreScratch* scratch = (BreScratch*)calloc(1, sizeof(BreScratch));
+	if (!scratch)
+		return NULL;
+	scratch->prog = prog;
+	if (prog)
+	{
+		scratch->slots = (int*)malloc((size_t)prog->nslots * sizeof(int));
+		if (!scratch->slots)
+		{
+			free(scratch);
+			return NULL;
+		}
+	}
+	return scratch;
+}
+
+BreScratch* bre_scratch_new(const BreProgram* prog)
+{
+	return prog ? bre_scratch_alloc(prog) : NULL;
+}
+
+void bre_scratch_free(BreScratch* scratch)
+{
+	if (!scratch)
+		return;
+	bre_pike_cache_free(scratch->pike);
+	bre_dfa_cache_free(scratch->dfa);
+	free(scratch->slots);
+	free(scratch);
+}
+
+BreScratch* bre_own_scratch(const BreProgram* prog)
+{
+	/* The program's own scratch is what makes the plain functions unsafe to
+	   call on one program from two threads; the _r functions never touch it. */
+	if (!prog->scratch)
+		((BreProgram*)prog)->scratch = bre_scratch_alloc(prog);
+	return prog->scratch;
+}
+
+/* Public API */
+/* Search text[start..len) with the engine suited to the program. 'slots' has prog->nslots entries. */
+static BreResult search_slots(const BreProgram* prog, BreScratch* scratch, const char* text, int len, int start,
+	int* slots)
+{
+	/* Back-references need the backtracker; everything else runs in linear time */
+	return prog->has_backrefs ? bre_backtrack_search(prog, text, len, start, slots, NULL)
+		: bre_pike_search(prog, scratch, text, len, start, slots);
+}
+
+BreResult bre_match_at_r(const BreProgram* prog, BreScratch* scratch, const char* text, size_t len, size_t start,
+	BreMatch* match)
+{
+	if (!prog || !scratch || scratch->prog != prog || !text || !match)
+		return BRE_ERROR;
+
+	clear_match(match);
+	/* Offsets are reported as int */
+	if (len > INT_MAX || start > len)
+		return BRE_ERROR;
+
+	BreResult r = search_slots(prog, scratch, text, (int)len, (int)start, scratch->slots);
+	if (r == BRE_OK)
+		fill_match(prog, scratch->slots, match);
+	return r;
+}
+
+BreResult bre_match_at(const BreProgram* prog, const char* text, size_t len, size_t start, BreMatch* match)
+{
+	if (!prog)
+		return BRE_ERROR;
+	return bre_match_at_r(prog, bre_own_scratch(prog), text, len, start, match);
+}
+
+BreResult bre_exec(const BreProgram* prog, const char* text, BreMatch* match)
+{
+	if (!text)
+		return BRE_ERROR;
+	return bre_match_at(prog, text, strlen(text), 0, match);
+}
+
+BreResult bre_test_n_r(const BreProgram* prog, BreScratch* scratch, const char* text, size_t len)
+{
+	if (!prog || !scratch || scratch->prog != prog || !text || len > INT_MAX)
+		return BRE_ERROR;
+
+	if (prog->has_backrefs)
+		return bre_backtrack_search(prog, text, (int)len, 0, scratch->slots, NULL);
+	/* In a tail window the VM only follows attempts that still fit, while the
+	   DFA restarts at every byte, which costs a lot with large counts */
+	if (prog->end_anchored && prog->max_len >= 0 && (size_t)prog->max_len < len)
+		return bre_pike_search(prog, scratch, text, (int)len, 0, scratch->slots);
+	return bre_dfa_search(prog, scratch, text, (int)len);
+}
+
+BreResult bre_test_n(const BreProgram* prog, const char* text, size_t len)
+{
+	if (!prog)
+		return BRE_ERROR;
+	return bre_test_n_r(prog, bre_own_scratch(prog), text, len);
+}
+
+BreResult bre_test(const BreProgram* prog, const char* text)
+{
+	if (!text)
+		return BRE_ERROR;
+	return bre_test_n(prog, text, strlen(text));
+}
+
+const char* bre_required_literal(const BreProgram* prog, size_t* len)
+{
+	if (!prog || !prog->literal)
+		return NULL;
+	if (len)
+		*len = (size_t)prog->literal_len;
+	return prog->literal;
+}
+
+BreResult bre_match(const char* text, const char* pattern, BreMatch* match)
+{
+	if (!text || !pattern || !match)
+		return BRE_ERROR;
+
+	BreProgram* prog = bre_compile(pattern);
+	if (!prog)
+	{
+		clear_match(match);
+		return BRE_ERROR;
+	}
+	BreResult r = bre_exec(prog, text, match);
+	bre_free(prog);
+	return r;
+}
+
+BreResult bre_match_n(const char* text, size_t len, const char* pattern, BreMatch* match)
+{
+	if (!text || !pattern || !match)
+		return BRE_ERROR;
+
+	BreProgram* prog = bre_compile(pattern);
+	if (!prog)
+	{
+		clear_match(match);
+		return BRE_ERROR;
+	}
+	BreResult r = bre_match_at(prog, text, len, 0, match);
+	bre_free(prog);
+	return r;
+}
+
+void bre_buffer_free(BreBuffer* buf)
+{
+	if (!buf)
+		return;
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = 0;
+	buf->cap = 0;
+}
+
+static bool buf_append(BreBuffer* buf, const char* s, size_t n)
+{
+	if (buf->len + n + 1 > buf->cap)
+	{
+		size_t ncap = buf->cap ? buf->cap : 64;
+		while (ncap < buf->len + n + 1)
+			ncap *= 2;
+		char* nd = (char*)realloc(buf->data, ncap);
+		if (!nd)
+			return false;
+		buf->data = nd;
+		buf->cap = ncap;
+	}
+	memcpy(buf->data + buf->len, s, n);
+	buf->len += n;
+	return true;
+}
+
+/* Append 'replacement' for the match recorded in 'slots': & is the whole match,
+   \1-\9 a group, \& and \\ the character itself. */
+static bool append_replacement(BreBuffer* out, const BreProgram* prog, const char* text, const int* slots,
+	const char* replacement)
+{
+	for (const char* r = replacement; *r; r++)
+	{
+		int g = -1;
+		if (*r == '&')
+			g = 0;
+		else if (*r == '\\' && r[1] >= '1' && r[1] <= '9')
+			g = *++r - '0';
+		else if (*r == '\\' && (r[1] == '&' || r[1] == '\\'))
+			r++;
+
+		if (g < 0)
+		{
+			if (!buf_append(out, r, 1))
+				return false;
+		}
+		else if (g <= prog->ngroups && slots[2 * g] >= 0 && slots[2 * g + 1] >= slots[2 * g])
+		{
+			if (!buf_append(out, text + slots[2 * g], (size_t)(slots[2 * g + 1] - slots[2 * g])))
+				return false;
+		}
+	}
+	return true;
+}
+
+BreResult bre_substitute_into_r(const BreProgram* prog, BreScratch* scratch, const char* text, size_t len,
+	const char* replacement, int occurrence, BreBuffer* out, size_t* count)
+{
+	if (count)
+		*count = 0;
+	if (!prog || !scratch || scratch->prog != prog || !text || !replacement || !out || occurrence < 0 ||
+		len > INT_MAX)
+		return BRE_ERROR;
+
+	int* slots = scratch->slots;
+
+	out->len = 0;
+	BreResult r = BRE_OK;
+	size_t done = 0;   /* text[0..done) has been copied or replaced */
+	int at = 0;        /* where the next search starts */
+	int prev_end = -1; /* end of the previous match */
+	int seen = 0;
+	size_t n = 0;
+	while (at <= (int)len)
+	{
+		BreResult mr = search_slots(prog, scratch, text, (int)len, at, slots);
+		if (mr != BRE_OK)
+		{
+			if (mr != BRE_NOMATCH)
+				r = mr;
+			break;
+		}
+		int ms = slots[0];
+		int me = slots[1];
+		at = me > ms ? me : me + 1;
+		/* An empty match right after the previous match is not a new one */
+		if (me == ms && ms == prev_end)
+			continue;
+		prev_end = me;
+		seen++;
+		if (occurrence != 0 && seen != occurrence)
+			continue;
+
+		if (!buf_append(out, text + done, (size_t)ms - done) ||
+			!append_replacement(out, prog, text, slots, replacement))
+		{
+			r = BRE_ERROR;
+			break;
+		}
+		done = (size_t)me;
+		n++;
+		if (occurrence != 0)
+			break;
+	}
+
+	if (r == BRE_OK && !buf_append(out, text + done, len - done))
+		r = BRE_ERROR;
+	if (r != BRE_OK)
+		return r;
+	out->data[out->len] = '\0';
+	if (count)
+		*count = n;
+	return BRE_OK;
+}
+
+BreResult bre_substitute_into(const BreProgram* prog, const char* text, size_t len, const char* replacement,
+	int occurrence, BreBuffer* out, size_t* count)
+{
+	if (count)
+		*count = 0;
+	if (!prog)
+		return BRE_ERROR;
+	return bre_substitute_into_r(prog, bre_own_scratch(prog), text, len, replacement, occurrence, out, count);
+}
+
+char* bre_substitute_prog(const BreProgram* prog, const char* text, const char* replacement)
+{
+	if (!text)
+		return NULL;
+
+	BreBuffer buf = { 0 };
+	if (bre_substitute_into(prog, text, strlen(text), replacement, 1, &buf, NULL) != BRE_OK)
+	{
+		bre_buffer_free(&buf);
+		return NULL;
+	}
+	return buf.data;
+}
+
+char* bre_substitute(const char* text, const char* pattern, const char* replacement)
+{
+	if (!text || !pattern || !replacement)
+		return NULL;
+
+	BreProgram* prog = bre_compile(pattern);
+	if (!prog)
+		return NULL;
+	char* out = bre_substitute_prog(prog, text, replacement);
+	bre_free(prog);
 	return out;
 }
@@ -2,8 +2,15 @@
 #define BRE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
-#define BRE_MAX_GROUPS 9 // Maximum number of capture groups (1-9)
+#define BRE_MAX_GROUPS 9   // Maximum number of capture groups (1-9)
+#define BRE_DUP_MAX 65535  // Largest count in an interval \{n,m\}
+
+/* Compile flags for bre_compile_flags() and bre_set_compile() */
+#define BRE_ICASE 0x01    // Ignore case: letters, bracket expressions and back-references
+#define BRE_EXTENDED 0x02 // ERE syntax, as ere_compile() takes it
+#define BRE_WHOLE 0x04    // Match only the whole text, as ^(pattern)$ would without adding a group
 
 /* Success/No-match/Error result code for engine functions */
 typedef enum
@@ -14,7 +21,9 @@ typedef enum
 
     // Group-specific disambiguation:
     BRE_NOT_GROUP = 3,     // Pattern at current position is not a capture group
-    BRE_GROUP_MISMATCH = 4 // Pattern is a capture group but it failed to match at current text position
+    BRE_GROUP_MISMATCH = 4, // Pattern is a capture group but it failed to match at current text position
+
+    BRE_LIMIT = 5 // Matching gave up: the pattern's step or backtrack budget ran out (see BreLimits)
 } BreResult;
 
 /* Structure to hold match result and capture groups */
@@ -47,20 +56,248 @@ typedef struct
     int next_pi; // next pattern index after the repetition spec
 } BreRepetition;
 
+/* A compiled BRE pattern. Opaque; create with bre_compile() and release with bre_free().
+ * A program can be reused for any number of texts. Patterns without back-references
+ * are matched in time linear in the text.
+ *
+ * Threads: the matching functions below keep their scratch space inside the program,
+ * so they must not run on one program from two threads at once. The _r variants
+ * (bre_match_at_r(), bre_test_n_r(), ...) take a BreScratch instead and only read the
+ * program, so any number of threads may share one program as long as each thread
+ * passes its own scratch.
+ */
+typedef struct BreProgram BreProgram;
+
+/* Per-thread matching state for one program or set: NFA thread lists, DFA states and
+ * capture slots, built on first use and reused by later calls. Opaque; create with
+ * bre_scratch_new() or bre_set_scratch_new() and release with bre_scratch_free()
+ * before the program or set it belongs to.
+ */
+typedef struct BreScratch BreScratch;
+
+/* Budget for matching patterns with back-references, which need a backtracking
+ * search that can take exponential time on hostile input. A search that exceeds
+ * it stops with BRE_LIMIT. Patterns without back-references run in linear time
+ * and ignore these limits.
+ */
+typedef struct
+{
+    unsigned long max_steps; // instructions executed per search; 0 = unlimited
+    size_t max_depth;        // pending backtrack entries; 0 = unlimited
+    bool memoize;            // remember failed states where back-references cannot affect the outcome
+} BreLimits;
+
+#define BRE_DEFAULT_MAX_STEPS 100000000UL  // roughly a second of matching
+#define BRE_DEFAULT_MAX_DEPTH ((size_t)1 << 22)
+
+/* Compile a BRE pattern once for repeated matching.
+ * Intervals are expanded into copies of the repeated atom, so a pattern whose
+ * expansion would exceed about 260000 instructions (e.g. \(.\{1000\}\)\{1000\})
+ * is refused like a syntax error. Matching stays linear in the text, but an
+ * unanchored search may follow one attempt per copy at a time, so large counts
+ * over text that keeps almost matching cost up to that count per byte.
+ * Returns a newly allocated program, or NULL on syntax errors or allocation failure.
+ */
+BreProgram *bre_compile(const char *pattern);
+
+/* Same as bre_compile() with BRE_* flags, e.g. BRE_ICASE for case-insensitive matching.
+ * Case is folded while matching, so the text never needs a lower-cased copy.
+ */
+BreProgram *bre_compile_flags(const char *pattern, int flags);
+
+/* Compile a POSIX extended regular expression (ERE) into the same kind of program.
+ * Adds alternation '|', unescaped groups '(' ')', '+', '?' and intervals '{n,m}';
+ * '^' and '$' are anchors anywhere, and '*', '+', '?' or '{' at the start of a
+ * pattern, group or alternative stand for themselves. \1-\9 are back-references as
+ * in a BRE, and any other escaped character is literal. The match is the leftmost-
+ * longest one POSIX asks for, so a|ab matches all of "ab". Groups are taken from
+ * the first alternative, in pattern order, that reaches that end, which can differ
+ * from the POSIX rule of longest subexpressions first: (a|ab)(c|bcd) on "abcd"
+ * captures "a" and "bcd". Returns NULL on syntax errors.
+ * Same as bre_compile_flags(pattern, BRE_EXTENDED).
+ */
+BreProgram *ere_compile(const char *pattern);
+
+/* Replace the budget of a program; NULL restores the defaults (BRE_DEFAULT_MAX_STEPS,
+ * BRE_DEFAULT_MAX_DEPTH, memoization on), which every new program starts with.
+ */
+void bre_set_limits(BreProgram *prog, const BreLimits *limits);
+
+/* Match a compiled program against a string.
+ * Fills 'match' like bre_match(). Returns BRE_OK, BRE_NOMATCH, BRE_LIMIT, or BRE_ERROR
+ * on invalid arguments.
+ */
+BreResult bre_exec(const BreProgram *prog, const char *text, BreMatch *match);
+
+/* Match a compiled program against text[0..len), searching from offset 'start'.
+ * The text may contain NUL bytes and need not be NUL-terminated. Positions in
+ * 'match' are offsets from 'text', not from 'start'; text before 'start' is still
+ * context, so '^' only matches at offset 0. To visit every match in one forward
+ * pass, resume at match->start + match->length (one further if the match was empty).
+ * Returns BRE_OK, BRE_NOMATCH, BRE_LIMIT, or BRE_ERROR on invalid arguments or start > len.
+ */
+BreResult bre_match_at(const BreProgram *prog, const char *text, size_t len, size_t start, BreMatch *match);
+
+/* Same as bre_match_at() using the caller's scratch, which must come from
+ * bre_scratch_new(prog); BRE_ERROR otherwise. Safe to call from several threads on
+ * one program, each with its own scratch.
+ */
+BreResult bre_match_at_r(const BreProgram *prog, BreScratch *scratch, const char *text, size_t len, size_t start,
+                         BreMatch *match);
+
+/* Report whether a compiled program matches anywhere in 'text'.
+ * Computes no positions or groups, which makes it the fastest way to ask yes/no
+ * questions such as line selection. Returns BRE_OK, BRE_NOMATCH, BRE_LIMIT, or BRE_ERROR.
+ */
+BreResult bre_test(const BreProgram *prog, const char *text);
+
+/* Same as bre_test() for text[0..len), which may contain NUL bytes. */
+BreResult bre_test_n(const BreProgram *prog, const char *text, size_t len);
+
+/* Same as bre_test_n() using the caller's scratch; see bre_match_at_r(). */
+BreResult bre_test_n_r(const BreProgram *prog, BreScratch *scratch, const char *text, size_t len);
+
+/* Text that every match of 'prog' contains, such as "ERROR:" for "ERROR:.*timeout".
+ * Returns NULL when the pattern has no such literal; otherwise sets '*len' (if not NULL)
+ * and returns a pointer owned by the program. A text without it cannot match, so callers
+ * can reject it with a plain substring search before running the matcher.
+ */
+const char *bre_required_literal(const BreProgram *prog, size_t *len);
+
+/* Release a program returned by bre_compile(). NULL is ignored. */
+void bre_free(BreProgram *prog);
+
+/* Scratch space for matching 'prog' with the _r functions. Returns NULL if 'prog' is
+ * NULL or on allocation failure.
+ */
+BreScratch *bre_scratch_new(const BreProgram *prog);
+
+/* Release scratch space. NULL is ignored. */
+void bre_scratch_free(BreScratch *scratch);
+
+/* A set of BRE patterns matched together in one scan of the text, for callers such
+ * as grep -e/-f that only need to know which patterns occur. Like a program, a set
+ * may be shared by threads that use the _r functions, each with its own scratch.
+ */
+typedef struct BreSet BreSet;
+
+/* Compile 'n' patterns into a set with BRE_* 'flags'. Returns NULL if any pattern is
+ * invalid or on allocation failure.
+ */
+BreSet *bre_set_compile(const char *const *patterns, size_t n, int flags);
+
+/* Number of patterns in the set. */
+size_t bre_set_size(const BreSet *set);
+
+/* Match every pattern of the set against text[0..len) in one pass. If 'matched' is
+ * not NULL it must have bre_set_size() entries; entry i is set to whether pattern i
+ * matches. Returns BRE_OK if any pattern matches, BRE_NOMATCH, BRE_LIMIT, or BRE_ERROR.
+ */
+BreResult bre_set_match(const BreSet *set, const char *text, size_t len, bool *matched);
+
+/* Whether any pattern of the set matches text[0..len); stops at the first match. */
+BreResult bre_set_test(const BreSet *set, const char *text, size_t len);
+
+/* Scratch space for matching 'set' with bre_set_match_r() and bre_set_test_r().
+ * Release it with bre_scratch_free().
+ */
+BreScratch *bre_set_scratch_new(const BreSet *set);
+
+/* Same as bre_set_match() and bre_set_test() using the caller's scratch. */
+BreResult bre_set_match_r(const BreSet *set, BreScratch *scratch, const char *text, size_t len, bool *matched);
+BreResult bre_set_test_r(const BreSet *set, BreScratch *scratch, const char *text, size_t len);
+
+/* Release a set. NULL is ignored. */
+void bre_set_free(BreSet *set);
+
+/* A cache of compiled programs keyed by pattern text and flags, for tools such as
+ * ed and sed that use the same patterns many times. The least recently used entry
+ * is evicted when the cache is full, but never while a caller still holds it.
+ * A cache belongs to one thread; the programs it hands out follow the usual rules.
+ */
+typedef struct BreCache BreCache;
+
+#define BRE_CACHE_DEFAULT_CAPACITY 16
+
+typedef struct
+{
+    unsigned long hits;      // lookups answered without compiling
+    unsigned long misses;    // lookups that compiled the pattern, valid or not
+    unsigned long evictions; // programs freed to make room
+    size_t entries;          // programs held now
+} BreCacheStats;
+
+/* Create a cache keeping up to 'capacity' programs, or BRE_CACHE_DEFAULT_CAPACITY
+ * if 0. Returns NULL on allocation failure.
+ */
+BreCache *bre_cache_new(size_t capacity);
+
+/* Release a cache and all its programs. NULL is ignored. */
+void bre_cache_free(BreCache *cache);
+
+/* The program for 'pattern' compiled with BRE_* 'flags', compiling it on a miss.
+ * Returns NULL if the pattern is invalid (nothing is cached) or on allocation
+ * failure. The program stays valid until it is passed to bre_cache_release().
+ */
+const BreProgram *bre_cache_get(BreCache *cache, const char *pattern, int flags);
+
+/* Give back a program from bre_cache_get(). The cache keeps it for later lookups. */
+void bre_cache_release(BreCache *cache, const BreProgram *prog);
+
+/* Lookup counters and the current number of entries. */
+void bre_cache_stats(const BreCache *cache, BreCacheStats *stats);
+
 /* Match a BRE pattern against a string.
  * Fills 'match' with the match position and capture groups.
- * Returns BRE_OK if a match is found, BRE_NOMATCH if none, BRE_ERROR on syntax errors.
+ * Returns BRE_OK if a match is found, BRE_NOMATCH if none, BRE_ERROR on syntax errors,
+ * or BRE_LIMIT if a back-reference pattern exhausted the default budget.
+ * Equivalent to bre_compile() + bre_exec() + bre_free(); compile once when matching repeatedly.
  */
 BreResult bre_match(const char *text, const char *pattern, BreMatch *match);
 
+/* Same as bre_match() for text[0..len), which may contain NUL bytes. */
+BreResult bre_match_n(const char *text, size_t len, const char *pattern, BreMatch *match);
+
 /* Substitute the first match of a BRE pattern with a replacement.
  * Returns a newly allocated string with the substitution, or NULL on error.
  * Caller must free the result.
- * 'text' is the input; 'pattern' is the BRE pattern; 'replacement' includes \1-\9.
+ * 'text' is the input; 'pattern' is the BRE pattern; 'replacement' may use & for the
+ * whole match, \1-\9 for groups, and \& or \\ for a literal '&' or backslash.
  * If there is no match, returns a copy of 'text'.
  */
 char *bre_substitute(const char *text, const char *pattern, const char *replacement);
 
+/* Same as bre_substitute() for a compiled program. */
+char *bre_substitute_prog(const BreProgram *prog, const char *text, const char *replacement);
+
+/* Growable output buffer for bre_substitute_into(). Owned by the caller: start
+ * from BreBuffer buf = {0}, reuse it for any number of substitutions, and release
+ * it with bre_buffer_free().
+ */
+typedef struct
+{
+    char *data; // result, NUL-terminated after a successful substitution
+    size_t len; // result length, not counting the NUL
+    size_t cap; // allocated size of 'data'
+} BreBuffer;
+
+/* Substitute matches of 'prog' in text[0..len) in a single forward pass, writing the
+ * result to 'out' (its previous contents are discarded). 'occurrence' 0 replaces every
+ * match, n > 0 only the nth. 'replacement' is expanded as for bre_substitute().
+ * Sets '*count' (if not NULL) to the number of replacements, which may be 0; 'out'
+ * then holds a copy of the text. Returns BRE_OK, BRE_LIMIT if a search ran out of
+ * budget, or BRE_ERROR on invalid arguments or allocation failure.
+ */
+BreResult bre_substitute_into(const BreProgram *prog, const char *text, size_t len, const char *replacement,
+                              int occurrence, BreBuffer *out, size_t *count);
+
+/* Same as bre_substitute_into() using the caller's scratch; see bre_match_at_r(). */
+BreResult bre_substitute_into_r(const BreProgram *prog, BreScratch *scratch, const char *text, size_t len,
+                                const char *replacement, int occurrence, BreBuffer *out, size_t *count);
+
+/* Release the memory of a BreBuffer and reset it to empty. NULL is ignored. */
+void bre_buffer_free(BreBuffer *buf);
+
 /* Exposed for tests: BRE repetition parser \{n\}, \{n,\}, \{n,m\}
  * Returns:
  *   BRE_OK     if a valid repetition was parsed and out params are set
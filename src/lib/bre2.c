@@ -8,6 +8,16 @@
 
 #define RE_DUP_MAX 255
 
+/* Instrumentation hooks around each match_here() call; a benchmark can
+   define them to measure recursion depth. */
+#ifndef BRE2_ENTER
+#define BRE2_ENTER()
+#define BRE2_LEAVE()
+#endif
+
+static int match_here(const char *base, const char *text, int ti, const char *pat, int pi, int pend, BreMatch *m,
+                      int *group_id);
+
 /* Find closing \) for \( ... \) */
 static int find_group_end(const char *pat, int pi, int pend)
 {
@@ -252,8 +262,8 @@ static int match_atom(const char *base, const char *text, int ti, const char *pa
 }
 
 /* Main recursive matcher */
-static int match_here(const char *base, const char *text, int ti, const char *pat, int pi, int pend, BreMatch *m,
-                      int *group_id)
+static int match_here_step(const char *base, const char *text, int ti, const char *pat, int pi, int pend, BreMatch *m,
+                           int *group_id)
 {
     if (pi >= pend)
         return text[ti] == '\0' ? 0 : -1;
@@ -274,6 +284,15 @@ static int match_here(const char *base, const char *text, int ti, const char *pa
     return consumed + rest;
 }
 
+static int match_here(const char *base, const char *text, int ti, const char *pat, int pi, int pend, BreMatch *m,
+                      int *group_id)
+{
+    BRE2_ENTER();
+    int r = match_here_step(base, text, ti, pat, pi, pend, m, group_id);
+    BRE2_LEAVE();
+    return r;
+}
+
 bool bre_match(const char *text, const char *pattern, BreMatch *match)
 {
     if (!text || !pattern || !match)
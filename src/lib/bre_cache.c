@@ -0,0 +1,175 @@
+/* bre_cache.c - compiled programs kept by pattern text
+ *
+ * Editors and stream editors see the same few patterns over and over: an
+ * address checked on every line, a g/re/ command running s/re/x/ on each
+ * line it selects, an empty pattern standing for the previous one.  The
+ * cache maps pattern text plus compile flags to the program built for it,
+ * so each distinct pattern is compiled once.  Entries live in a small array
+ * searched by hash; the least recently used entry that nobody holds is
+ * evicted once the array is full.
+ */
+
+#include "bre.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+	char* pattern;
+	int flags;
+	unsigned hash;
+	BreProgram* prog;
+	unsigned long last_use; /* cache clock at the last lookup */
+	int refs;               /* bre_cache_get() calls not yet released */
+} BreCacheEntry;
+
+struct BreCache
+{
+	BreCacheEntry* entries;
+	size_t nentries;
+	size_t cap;      /* allocated entries; exceeds capacity only while all are held */
+	size_t capacity; /* entries kept once released */
+	unsigned long clock;
+	BreCacheStats stats;
+};
+
+static unsigned hash_pattern(const char* pattern, int flags)
+{
+	unsigned h = 2166136261u ^ (unsigned)flags;
+	for (const unsigned char* p = (const unsigned char*)pattern; *p; p++)
+		h = (h ^ *p) * 16777619u;
+	return h;
+}
+
+BreCache* bre_cache_new(size_t capacity)
+{
+	BreCache* cache = (BreCache*)calloc(1, sizeof(BreCache));
+	if (!cache)
+		return NULL;
+	cache->capacity = capacity ? capacity : BRE_CACHE_DEFAULT_CAPACITY;
+	return cache;
+}
+
+void bre_cache_free(BreCache* cache)
+{
+	if (!cache)
+		return;
+	for (size_t i = 0; i < cache->nentries; i++)
+	{
+		free(cache->entries[i].pattern);
+		bre_free(cache->entries[i].prog);
+	}
+	free(cache->entries);
+	free(cache);
+}
+
+static void drop_entry(BreCache* cache, size_t i)
+{
+	free(cache->entries[i].pattern);
+	bre_free(cache->entries[i].prog);
+	cache->entries[i] = cache->entries[--cache->nentries];
+	cache->stats.evictions++;
+}
+
+/* Evict least recently used entries nobody holds until at most 'limit' remain */
+static void evict_to(BreCache* cache, size_t limit)
+{
+	while (cache->nentries > limit)
+	{
+		size_t victim = cache->nentries;
+		for (size_t i = 0; i < cache->nentries; i++)
+		{
+			const BreCacheEntry* e = &cache->entries[i];
+			if (e->refs == 0 && (victim == cache->nentries || e->last_use < cache->entries[victim].last_use))
+				victim = i;
+		}
+		if (victim == cache->nentries)
+			return; /* everything is in use */
+		drop_entry(cache, victim);
+	}
+}
+
+const BreProgram* bre_cache_get(BreCache* cache, const char* pattern, int flags)
+{
+	if (!cache || !pattern)
+		return NULL;
+
+	unsigned h = hash_pattern(pattern, flags);
+	cache->clock++;
+	for (size_t i = 0; i < cache->nentries; i++)
+	{
+		BreCacheEntry* e = &cache->entries[i];
+		if (e->hash == h && e->flags == flags && strcmp(e->pattern, pattern) == 0)
+		{
+			cache->stats.hits++;
+			e->last_use = cache->clock;
+			e->refs++;
+			return e->prog;
+		}
+	}
+
+	cache->stats.misses++;
+	BreProgram* prog = bre_compile_flags(pattern, flags);
+	if (!prog)
+		return NULL;
+
+	evict_to(cache, cache->capacity - 1);
+	if (cache->nentries == cache->cap)
+	{
+		size_t ncap = cache->cap ? cache->cap * 2 : cache->capacity;
+		BreCacheEntry* ne = (BreCacheEntry*)realloc(cache->entries, ncap * sizeof(BreCacheEntry));
+		if (!ne)
+		{
+			bre_free(prog);
+			return NULL;
+		}
+		cache->entries = ne;
+		cache->cap = ncap;
+	}
+	size_t len = strlen(pattern);
+	char* copy = (char*)malloc(len + 1);
+	if (!copy)
+	{
+		bre_free(prog);
+		return NULL;
+	}
+	memcpy(copy, pattern, len + 1);
+
+	BreCacheEntry* e = &cache->entries[cache->nentries++];
+	e->pattern = copy;
+	e->flags = flags;
+	e->hash = h;
+	e->prog = prog;
+	e->last_use = cache->clock;
+	e->refs = 1;
+	return prog;
+}
+
+void bre_cache_release(BreCache* cache, const BreProgram* prog)
+{
+	if (!cache || !prog)
+		return;
+	for (size_t i = 0; i < cache->nentries; i++)
+	{
+		BreCacheEntry* e = &cache->entries[i];
+		if (e->prog == prog)
+		{
+			if (e->refs > 0)
+				e->refs--;
+			break;
+		}
+	}
+	/* Entries kept beyond the capacity while everything was held go now */
+	evict_to(cache, cache->capacity);
+}
+
+void bre_cache_stats(const BreCache* cache, BreCacheStats* stats)
+{
+	if (!stats)
+		return;
+	memset(stats, 0, sizeof(*stats));
+	if (!cache)
+		return;
+	*stats = cache->stats;
+	stats->entries = cache->nentries;
+}
@@ -0,0 +1,440 @@
+/* bre_dfa.c - lazily built DFA for yes/no matching of compiled BRE programs
+ *
+ * bre_test() only has to decide whether a program matches somewhere, so it
+ * needs neither capture slots nor thread priorities: the set of live NFA
+ * instructions is all the state there is.  Each distinct set becomes a DFA
+ * state the first time it is reached, and its transitions are filled in as
+ * bytes are seen, so the inner loop is one table lookup per byte.  Bytes the
+ * program cannot tell apart share a column of the transition table.
+ *
+ * The number of states and their total size are bounded. Once the cache is full the search goes on
+ * as a plain NFA simulation over instruction sets, which is slower but still
+ * linear in the text.
+ */
+
+#include "bre_impl.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DFA_MAX_STATES 1024
+#define DFA_MAX_POOL (1 << 20) /* instructions stored over all states; large counts make big sets */
+#define DFA_UNKNOWN (-1) /* transition not computed yet */
+#define DFA_FULL (-2)    /* transition needs a new state but the cache is full */
+#define DFA_NOMEM (-3)
+
+typedef struct
+{
+	int first; /* offset of the state's instructions in the pc pool */
+	int n;
+	bool match; /* the set contains MATCH */
+	unsigned hash;
+} DfaState;
+
+struct BreDfaCache
+{
+	unsigned char byteclass[256]; /* column of each byte in the transition table */
+	int nclasses;
+
+	DfaState* states;
+	int nstates, states_cap;
+	int* next; /* nstates * nclasses transitions */
+
+	int* pool; /* instruction lists of all states */
+	int pool_len, pool_cap;
+
+	int* table; /* open-addressed hash of state indexes, -1 when empty */
+	int table_size;
+
+	int start;   /* state at text offset 0 */
+	int restart; /* state with no attempt in progress, or -1 */
+
+	/* Scratch for computing instruction sets */
+	unsigned* seen;
+	unsigned gen;
+	int* stack;
+	int* seeds;
+	int* set;
+	int nset;
+	int* fallback;
+};
+
+void bre_dfa_cache_free(BreDfaCache* cache)
+{
+	if (!cache)
+		return;
+	free(cache->states);
+	free(cache->next);
+	free(cache->pool);
+	free(cache->table);
+	free(cache->seen);
+	free(cache->stack);
+	free(cache->seeds);
+	free(cache->set);
+	free(cache->fallback);
+	free(cache);
+}
+
+static bool consumes(const BreProgram* prog, const BreInst* in, unsigned char c)
+{
+	switch ((BreOpcode)in->op)
+	{
+	case BRE_OP_CHAR:
+		return bre_fold(prog, c) == (unsigned char)in->arg;
+	case BRE_OP_ANY:
+		return true;
+	case BRE_OP_CLASS:
+		return bre_class_contains(prog, in->arg, c);
+	default:
+		return false;
+	}
+}
+
+/* Split the byte values into classes that every instruction treats alike */
+static void compute_byteclasses(const BreProgram* prog, BreDfaCache* c)
+{
+	memset(c->byteclass, 0, sizeof(c->byteclass));
+	c->nclasses = 1;
+	for (int pc = 0; pc < prog->ninsts; pc++)
+	{
+		const BreInst* in = &prog->insts[pc];
+		if (in->op != BRE_OP_CHAR && in->op != BRE_OP_CLASS)
+			continue;
+		int map[512];
+		int n = 0;
+		for (int i = 0; i < 2 * c->nclasses; i++)
+			map[i] = -1;
+		for (int b = 0; b < 256; b++)
+		{
+			int key = 2 * c->byteclass[b] + (consumes(prog, in, (unsigned char)b) ? 1 : 0);
+			if (map[key] < 0)
+				map[key] = n++;
+			c->byteclass[b] = (unsigned char)map[key];
+		}
+		c->nclasses = n;
+		if (n == 256)
+			break;
+	}
+}
+
+static void next_gen(BreDfaCache* c, int ninsts)
+{
+	if (++c->gen == UINT_MAX)
+	{
+		memset(c->seen, 0, (size_t)ninsts * sizeof(unsigned));
+		c->gen = 1;
+	}
+}
+
+static int compare_pc(const void* a, const void* b)
+{
+	int x = *(const int*)a;
+	int y = *(const int*)b;
+	return (x > y) - (x < y);
+}
+
+/* Epsilon closure of the seed instructions. BOL holds only when 'bol' is set
+   and EOL only when 'eol' is set; an EOL that does not hold stays in the set
+   so the end of the text can be checked later. Loop registers do not change
+   which instructions are reachable, so SAVE and PROGRESS are followed freely.
+   The resulting CHAR/ANY/CLASS/EOL/MATCH instructions are stored in c->set in
+   pc order, which makes equal sets compare equal. The set is sorted rather
+   than read off the whole program, so a step costs the size of the set even
+   when large counts make the program long. Returns the set size. */
+static int closure(const BreProgram* prog, BreDfaCache* c, const int* seeds, int nseeds, bool bol, bool eol)
+{
+	const BreInst* insts = prog->insts;
+	int top = 0;
+	int n = 0;
+
+	next_gen(c, prog->ninsts);
+	for (int i = nseeds - 1; i >= 0; i--)
+		c->stack[top++] = seeds[i];
+	while (top > 0)
+	{
+		int pc = c->stack[--top];
+		while (c->seen[pc] != c->gen)
+		{
+			c->seen[pc] = c->gen;
+			const BreInst* in = &insts[pc];
+			if (in->op == BRE_OP_JMP)
+				pc = in->x;
+			else if (in->op == BRE_OP_SPLIT)
+			{
+				c->stack[top++] = in->y;
+				pc = in->x;
+			}
+			else if (in->op == BRE_OP_SAVE || in->op == BRE_OP_PROGRESS || (in->op == BRE_OP_BOL && bol) ||
+				(in->op == BRE_OP_EOL && eol))
+				pc++;
+			else
+			{
+				/* CHAR, ANY, CLASS, MATCH or a pending EOL; a BOL that does not hold is dropped */
+				if (in->op != BRE_OP_BOL)
+					c->set[n++] = pc;
+				break;
+			}
+		}
+	}
+	if (n > 1)
+		qsort(c->set, (size_t)n, sizeof(int), compare_pc);
+	c->nset = n;
+	return n;
+}
+
+/* Seeds for the set reached from 'pcs' by consuming byte 'b'. A search that
+   is not anchored also starts a new attempt after every byte. */
+static int step_seeds(const BreProgram* prog, BreDfaCache* c, const int* pcs, int n, unsigned char b)
+{
+	int nseeds = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (consumes(prog, &prog->insts[pcs[i]], b))
+			c->seeds[nseeds++] = pcs[i] + 1;
+	}
+	if (!prog->anchored)
+		c->seeds[nseeds++] = 0;
+	return nseeds;
+}
+
+static bool set_has_match(const BreProgram* prog, const int* pcs, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		if (prog->insts[pcs[i]].op == BRE_OP_MATCH)
+			return true;
+	}
+	return false;
+}
+
+/* Where matches go. With 'matched' NULL the first match ends the scan.
+   Otherwise each MATCH reached flags matched[arg] (the pattern of a BreSet)
+   and the scan goes on until all 'remaining' patterns have been seen. */
+typedef struct
+{
+	bool* matched;
+	int remaining;
+	bool any;
+} DfaReport;
+
+/* Record the MATCH instructions of a set; true when the scan can stop */
+static bool report(const BreProgram* prog, const int* pcs, int n, DfaReport* r)
+{
+	for (int i = 0; i < n; i++)
+	{
+		const BreInst* in = &prog->insts[pcs[i]];
+		if (in->op != BRE_OP_MATCH)
+			continue;
+		r->any = true;
+		if (!r->matched)
+			return true;
+		if (!r->matched[in->arg])
+		{
+			r->matched[in->arg] = true;
+			r->remaining--;
+		}
+	}
+	return r->matched && r->remaining == 0;
+}
+
+/* Report what the set accepts once the text ends here */
+static void report_at_end(const BreProgram* prog, BreDfaCache* c, const int* pcs, int n, bool at_start, DfaReport* r)
+{
+	if (report(prog, pcs, n, r))
+		return;
+	int nseeds = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (prog->insts[pcs[i]].op == BRE_OP_EOL)
+			c->seeds[nseeds++] = pcs[i] + 1;
+	}
+	if (nseeds == 0)
+		return;
+	int m = closure(prog, c, c->seeds, nseeds, at_start, true);
+	report(prog, c->set, m, r);
+}
+
+/* Find or create the state for the instruction set in c->set */
+static int intern_state(const BreProgram* prog, BreDfaCache* c, int n)
+{
+	unsigned h = 2166136261u;
+	for (int i = 0; i < n; i++)
+		h = (h ^ (unsigned)c->set[i]) * 16777619u;
+
+	unsigned mask = (unsigned)c->table_size - 1;
+	unsigned slot = h & mask;
+	for (; c->table[slot] >= 0; slot = (slot + 1) & mask)
+	{
+		const DfaState* s = &c->states[c->table[slot]];
+		if (s->hash == h && s->n == n && memcmp(c->pool + s->first, c->set, (size_t)n * sizeof(int)) == 0)
+			return c->table[slot];
+	}
+
+	/* The start states are always kept, however large */
+	if (c->nstates == DFA_MAX_STATES || (c->nstates >= 2 && c->pool_len + n > DFA_MAX_POOL))
+		return DFA_FULL;
+	if (c->nstates == c->states_cap)
+	{
+		int ncap = c->states_cap * 2;
+		DfaState* ns = (DfaState*)realloc(c->states, (size_t)ncap * sizeof(DfaState));
+		if (!ns)
+			return DFA_NOMEM;
+		c->states = ns;
+		int* nn = (int*)realloc(c->next, (size_t)ncap * (size_t)c->nclasses * sizeof(int));
+		if (!nn)
+			return DFA_NOMEM;
+		c->next = nn;
+		c->states_cap = ncap;
+	}
+	if (c->pool_len + n > c->pool_cap)
+	{
+		int ncap = c->pool_cap * 2;
+		while (ncap < c->pool_len + n)
+			ncap *= 2;
+		int* np = (int*)realloc(c->pool, (size_t)ncap * sizeof(int));
+		if (!np)
+			return DFA_NOMEM;
+		c->pool = np;
+		c->pool_cap = ncap;
+	}
+
+	int id = c->nstates++;
+	DfaState* s = &c->states[id];
+	s->first = c->pool_len;
+	s->n = n;
+	s->match = set_has_match(prog, c->set, n);
+	s->hash = h;
+	memcpy(c->pool + c->pool_len, c->set, (size_t)n * sizeof(int));
+	c->pool_len += n;
+	for (int k = 0; k < c->nclasses; k++)
+		c->next[(size_t)id * (size_t)c->nclasses + (size_t)k] = DFA_UNKNOWN;
+	c->table[slot] = id;
+	return id;
+}
+
+static BreDfaCache* dfa_cache_get(const BreProgram* prog, BreScratch* scratch)
+{
+	if (scratch->dfa)
+		return scratch->dfa;
+
+	BreDfaCache* c = (BreDfaCache*)calloc(1, sizeof(BreDfaCache));
+	if (!c)
+		return NULL;
+	size_t n = (size_t)prog->ninsts;
+	compute_byteclasses(prog, c);
+	c->states_cap = 16;
+	c->states = (DfaState*)malloc((size_t)c->states_cap * sizeof(DfaState));
+	c->next = (int*)malloc((size_t)c->states_cap * (size_t)c->nclasses * sizeof(int));
+	c->pool_cap = 256;
+	c->pool = (int*)malloc((size_t)c->pool_cap * sizeof(int));
+	c->table_size = 2 * DFA_MAX_STATES;
+	c->table = (int*)malloc((size_t)c->table_size * sizeof(int));
+	c->seen = (unsigned*)calloc(n, sizeof(unsigned));
+	c->stack = (int*)malloc((2 * n + 1) * sizeof(int));
+	c->seeds = (int*)malloc((n + 1) * sizeof(int));
+	c->set = (int*)malloc((n + 1) * sizeof(int));
+	c->fallback = (int*)malloc((n + 1) * sizeof(int));
+	if (!c->states || !c->next || !c->pool || !c->table || !c->seen || !c->stack || !c->seeds || !c->set ||
+		!c->fallback)
+	{
+		bre_dfa_cache_free(c);
+		return NULL;
+	}
+	for (int i = 0; i < c->table_size; i++)
+		c->table[i] = -1;
+
+	int zero = 0;
+	c->start = intern_state(prog, c, closure(prog, c, &zero, 1, true, false));
+	c->restart = prog->anchored ? -1 : intern_state(prog, c, closure(prog, c, &zero, 1, false, false));
+
+	scratch->dfa = c;
+	return c;
+}
+
+/* Compute and record the transition of state 's' on byte 'b' */
+static int dfa_transition(const BreProgram* prog, BreDfaCache* c, int s, unsigned char b)
+{
+	const DfaState* st = &c->states[s];
+	int nseeds = step_seeds(prog, c, c->pool + st->first, st->n, b);
+	int t = intern_state(prog, c, closure(prog, c, c->seeds, nseeds, false, false));
+	if (t >= 0)
+		c->next[(size_t)s * (size_t)c->nclasses + c->byteclass[b]] = t;
+	return t;
+}
+
+/* Continue from text[pos] with the instruction set in c->set, without
+   caching anything. Used once the state cache is full. */
+static void nfa_fallback(const BreProgram* prog, BreDfaCache* c, int n, const char* text, int pos, int len, DfaReport* r)
+{
+	int* cur = c->fallback;
+	memcpy(cur, c->set, (size_t)n * sizeof(int));
+	for (; pos < len; pos++)
+	{
+		if (report(prog, cur, n, r) || n == 0)
+			return;
+		int nseeds = step_seeds(prog, c, cur, n, (unsigned char)text[pos]);
+		n = closure(prog, c, c->seeds, nseeds, false, false);
+		memcpy(cur, c->set, (size_t)n * sizeof(int));
+	}
+	report_at_end(prog, c, cur, n, len == 0, r);
+}
+
+static BreResult dfa_scan(const BreProgram* prog, BreScratch* scratch, const char* text, int len, DfaReport* r)
+{
+	/* A later first offset enters the automaton past the start of the text */
+	int pos = 0;
+	if (!bre_search_window(prog, len, &pos) || (pos > 0 && prog->anchored) ||
+		!bre_literal_possible(prog, text, len, pos))
+		return BRE_NOMATCH;
+	BreDfaCache* c = dfa_cache_get(prog, scratch);
+	if (!c || c->start < 0 || (!prog->anchored && c->restart < 0))
+		return BRE_ERROR;
+
+	int s = pos > 0 ? c->restart : c->start;
+	for (; pos < len; pos++)
+	{
+		if (c->states[s].match && report(prog, c->pool + c->states[s].first, c->states[s].n, r))
+			return BRE_OK;
+		if (s == c->restart && prog->has_first)
+		{
+			/* Nothing in progress: skip bytes no match can start with */
+			pos = bre_skip_to_first(prog, text, len, pos);
+			if (pos == len)
+				break;
+		}
+		unsigned char b = (unsigned char)text[pos];
+		int t = c->next[(size_t)s * (size_t)c->nclasses + c->byteclass[b]];
+		if (t < 0)
+		{
+			t = dfa_transition(prog, c, s, b);
+			if (t == DFA_NOMEM)
+				return BRE_ERROR;
+			if (t == DFA_FULL)
+			{
+				/* c->set still holds the set the new state would have had */
+				nfa_fallback(prog, c, c->nset, text, pos + 1, len, r);
+				return r->any ? BRE_OK : BRE_NOMATCH;
+			}
+		}
+		s = t;
+		if (c->states[s].n == 0)
+			break; /* dead state: no attempt can still succeed */
+	}
+	const DfaState* st = &c->states[s];
+	if (pos >= len)
+		report_at_end(prog, c, c->pool + st->first, st->n, len == 0, r);
+	return r->any ? BRE_OK : BRE_NOMATCH;
+}
+
+BreResult bre_dfa_search(const BreProgram* prog, BreScratch* scratch, const char* text, int len)
+{
+	DfaReport r = { NULL, 0, false };
+	return dfa_scan(prog, scratch, text, len, &r);
+}
+
+BreResult bre_dfa_search_all(const BreProgram* prog, BreScratch* scratch, const char* text, int len, bool* matched,
+	int nmatched)
+{
+	DfaReport r = { matched, nmatched, false };
+	return dfa_scan(prog, scratch, text, len, &r);
+}
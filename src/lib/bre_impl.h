@@ -0,0 +1,166 @@
+#ifndef BRE_IMPL_H
+#define BRE_IMPL_H
+
+/* Internal representation shared by the BRE compiler and its execution
+ * engines. Not part of the public API; include bre.h instead.
+ */
+
+#include "bre.h"
+#include "litsearch.h"
+#include <ctype.h>
+#include <stdbool.h>
+
+/* Largest backtracker memo bitmap (instructions x text positions) allocated per search */
+#define BRE_MEMO_MAX_BITS ((size_t)1 << 26)
+
+typedef enum
+{
+	BRE_OP_CHAR,     /* match byte 'arg' */
+	BRE_OP_ANY,      /* match any byte */
+	BRE_OP_CLASS,    /* match a byte in bracket expression 'arg' */
+	BRE_OP_BOL,      /* assert start of text */
+	BRE_OP_EOL,      /* assert end of text */
+	BRE_OP_SAVE,     /* store text position in slot 'arg' */
+	BRE_OP_SPLIT,    /* try 'x' first, then 'y' */
+	BRE_OP_JMP,      /* continue at 'x' */
+	BRE_OP_BACKREF,  /* match the text captured by group 'arg' again */
+	BRE_OP_PROGRESS, /* fail unless the position moved since slot 'arg' was saved */
+	BRE_OP_MATCH
+} BreOpcode;
+
+typedef struct
+{
+	unsigned char op;
+	int arg;
+	int x;
+	int y;
+} BreInst;
+
+/* A compiled bracket expression: bit c is set when byte c matches */
+typedef struct
+{
+	unsigned char bits[32];
+} BreClass;
+
+typedef struct BrePikeCache BrePikeCache;
+typedef struct BreDfaCache BreDfaCache;
+
+struct BreProgram
+{
+	BreInst *insts;
+	int ninsts;
+	int ngroups;       /* number of \( \) groups in the pattern */
+	int nslots;        /* capture slots (2 per group, plus the whole match) and loop registers */
+	bool anchored;     /* pattern starts with '^' */
+	bool has_backrefs; /* pattern uses \1-\9 */
+	bool icase;        /* BRE_ICASE: CHAR args and the literal are lower case */
+	bool longest;      /* ERE: the longest match at the leftmost start wins, not the first by priority */
+	BreClass *classes; /* bracket expressions, indexed by CLASS instructions */
+	int nclasses;
+
+	/* Backtracker (patterns with back-references only) */
+	BreLimits limits;
+	int *memo_pc; /* per instruction: row in the memo bitmap, or -1 if not memoizable */
+	int nmemo;    /* number of memoizable instructions */
+
+	/* Prefilters found at compile time */
+	char *literal;           /* text every match contains, or NULL */
+	int literal_len;
+	LitSearch *literal_search; /* 'literal' compiled for the prefilter */
+	bool has_first;          /* 'first' lists every byte a match can start with */
+	unsigned char first[32]; /* bitmap indexed by byte value */
+	int first_byte;          /* the only byte in 'first', or -1 */
+
+	/* Shape of every match, used to limit the start offsets a search tries */
+	int min_len;       /* shortest match */
+	int max_len;       /* longest match, or -1 if unbounded */
+	bool end_anchored; /* every match ends at the end of the text ('$' last) */
+
+	/* Scratch space for the functions that take none, created on first use.
+	   The only part of a program that matching ever writes. */
+	BreScratch *scratch;
+};
+
+/* Mutable matching state, kept apart from the read-only program so that one
+ * program can be shared by threads that each have their own scratch. Every
+ * cache is built for 'prog' on first use and reused by later calls.
+ */
+struct BreScratch
+{
+	const BreProgram *prog;
+	BrePikeCache *pike; /* Pike VM thread lists */
+	BreDfaCache *dfa;   /* lazily built DFA states */
+	int *slots;         /* prog->nslots capture slots */
+};
+
+/* Scratch for 'prog', which may be NULL (a set without automaton patterns) */
+BreScratch *bre_scratch_alloc(const BreProgram *prog);
+
+/* prog->scratch, created on first use; NULL on allocation failure */
+BreScratch *bre_own_scratch(const BreProgram *prog);
+
+/* Is byte 'c' in the 256-bit map 'map'? */
+static inline bool bre_bitmap_has(const unsigned char *map, unsigned char c)
+{
+	return (map[c >> 3] >> (c & 7)) & 1;
+}
+
+/* Does bracket expression 'cls' match 'c'? Case folding is already applied. */
+static inline bool bre_class_contains(const BreProgram *prog, int cls, unsigned char c)
+{
+	return bre_bitmap_has(prog->classes[cls].bits, c);
+}
+
+/* Narrow a search of text[start..len) to the offsets where a match can
+ * begin: none if the rest of the text is shorter than any match, and only the
+ * tail window of max_len bytes when matches must end at the end of the text.
+ * Returns false when no offset is left.
+ */
+static inline bool bre_search_window(const BreProgram *prog, int len, int *start)
+{
+	if (len - *start < prog->min_len)
+		return false;
+	if (prog->end_anchored && prog->max_len >= 0 && len - prog->max_len > *start)
+		*start = len - prog->max_len;
+	return true;
+}
+
+/* Byte as the program compares it with CHAR arguments */
+static inline unsigned char bre_fold(const BreProgram *prog, unsigned char c)
+{
+	return prog->icase ? (unsigned char)tolower(c) : c;
+}
+
+/* Fill prog->first/has_first/first_byte from the instructions */
+void bre_compute_first_bytes(BreProgram *prog);
+
+/* Can a match start at or after 'start'? Checks the required literal. */
+bool bre_literal_possible(const BreProgram *prog, const char *text, int len, int start);
+
+/* First offset >= sp where a match could start, or len when none can */
+int bre_skip_to_first(const BreProgram *prog, const char *text, int len, int sp);
+
+
+/* Engines. Both search text[start..len) for the leftmost match, honouring the
+ * program's anchoring, and fill 'slots' (prog->nslots entries) on BRE_OK.
+ * The backtracker keeps no state between calls and needs no scratch; it
+ * reports its deepest stack in '*peak_depth' if not NULL.
+ */
+BreResult bre_backtrack_search(const BreProgram *prog, const char *text, int len, int start, int *slots,
+                               int *peak_depth);
+BreResult bre_pike_search(const BreProgram *prog, BreScratch *scratch, const char *text, int len, int start,
+                          int *slots);
+void bre_pike_cache_free(BrePikeCache *cache);
+
+/* Yes/no search of text[0..len) using the lazy DFA. The program must not use back-references. */
+BreResult bre_dfa_search(const BreProgram *prog, BreScratch *scratch, const char *text, int len);
+
+/* Scan text[0..len), setting matched[k] for every MATCH instruction with arg k
+ * that is reached. 'matched' must start all false; the scan stops early once
+ * all 'nmatched' entries are set.
+ */
+BreResult bre_dfa_search_all(const BreProgram *prog, BreScratch *scratch, const char *text, int len, bool *matched,
+                             int nmatched);
+void bre_dfa_cache_free(BreDfaCache *cache);
+
+#endif /* BRE_IMPL_H */
@@ -0,0 +1,282 @@
+/* bre_pike.c - Pike VM execution of compiled BRE programs
+ *
+ * Runs every alternative of the program in lock step over the text (a
+ * Thompson NFA simulation with per-thread capture slots).  Each instruction
+ * holds at most one thread per text position, so matching costs
+ * O(program size x text length) however the pattern nests its repetitions.
+ * Threads are kept in priority order, which reproduces the leftmost, greedy
+ * submatches of the backtracking executor.  For an ERE the threads of the
+ * matching start go on after a match, and the longest one wins as POSIX asks.
+ * Back-references are not supported here; programs that use them go to the
+ * backtracker.
+ */
+
+#include "bre_impl.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+	int* pcs;   /* instruction of each thread, highest priority first */
+	int* slots; /* nslots capture slots per thread */
+	int n;
+} PikeList;
+
+typedef struct
+{
+	int pc;  /* instruction to follow, or -1 for a slot restore */
+	int arg; /* slot index for restores */
+	int old; /* previous slot value for restores */
+} PikeFrame;
+
+struct BrePikeCache
+{
+	PikeList lists[2];
+	unsigned* seen;    /* seen[pc] == gen once pc is on the list being built */
+	unsigned gen;
+	PikeFrame* stack;  /* pending branches of an epsilon closure */
+	int stack_cap;
+	int* cur;          /* slots of the thread being followed */
+};
+
+void bre_pike_cache_free(BrePikeCache* cache)
+{
+	if (!cache)
+		return;
+	for (int i = 0; i < 2; i++)
+	{
+		free(cache->lists[i].pcs);
+		free(cache->lists[i].slots);
+	}
+	free(cache->seen);
+	free(cache->stack);
+	free(cache->cur);
+	free(cache);
+}
+
+static BrePikeCache* pike_cache_get(const BreProgram* prog, BreScratch* scratch)
+{
+	if (scratch->pike)
+		return scratch->pike;
+
+	BrePikeCache* c = (BrePikeCache*)calloc(1, sizeof(BrePikeCache));
+	if (!c)
+		return NULL;
+	size_t n = (size_t)prog->ninsts;
+	size_t ns = (size_t)prog->nslots;
+	bool ok = true;
+	for (int i = 0; i < 2; i++)
+	{
+		c->lists[i].pcs = (int*)malloc(n * sizeof(int));
+		c->lists[i].slots = (int*)malloc(n * ns * sizeof(int));
+		ok = ok && c->lists[i].pcs && c->lists[i].slots;
+	}
+	c->seen = (unsigned*)calloc(n, sizeof(unsigned));
+	c->cur = (int*)malloc(ns * sizeof(int));
+	c->stack_cap = 64;
+	c->stack = (PikeFrame*)malloc((size_t)c->stack_cap * sizeof(PikeFrame));
+	if (!ok || !c->seen || !c->cur || !c->stack)
+	{
+		bre_pike_cache_free(c);
+		return NULL;
+	}
+
+	scratch->pike = c;
+	return c;
+}
+
+static bool pike_push(BrePikeCache* c, int* top, int pc, int arg, int old)
+{
+	if (*top == c->stack_cap)
+	{
+		int ncap = c->stack_cap * 2;
+		PikeFrame* ns = (PikeFrame*)realloc(c->stack, (size_t)ncap * sizeof(PikeFrame));
+		if (!ns)
+			return false;
+		c->stack = ns;
+		c->stack_cap = ncap;
+	}
+	c->stack[*top].pc = pc;
+	c->stack[*top].arg = arg;
+	c->stack[*top].old = old;
+	(*top)++;
+	return true;
+}
+
+/* Follow the epsilon closure of 'pc0' at text position 'sp', starting from
+   the slots in c->cur, and append every consuming or MATCH instruction
+   reached to 'list' in priority order. c->cur is restored on return. */
+static bool pike_add(const BreProgram* prog, BrePikeCache* c, PikeList* list, int pc0, int sp, int len)
+{
+	const BreInst* insts = prog->insts;
+	int ns = prog->nslots;
+	int top = 0;
+
+	if (!pike_push(c, &top, pc0, 0, 0))
+		return false;
+	while (top > 0)
+	{
+		PikeFrame f = c->stack[--top];
+		if (f.pc < 0)
+		{
+			c->cur[f.arg] = f.old;
+			continue;
+		}
+		int pc = f.pc;
+		for (;;)
+		{
+			if (c->seen[pc] == c->gen)
+				break;
+			c->seen[pc] = c->gen;
+
+			const BreInst* in = &insts[pc];
+			bool follow = true;
+			switch ((BreOpcode)in->op)
+			{
+			case BRE_OP_JMP:
+				pc = in->x;
+				continue;
+			case BRE_OP_SPLIT:
+				if (!pike_push(c, &top, in->y, 0, 0))
+					return false;
+				pc = in->x;
+				continue;
+			case BRE_OP_SAVE:
+				if (!pike_push(c, &top, -1, in->arg, c->cur[in->arg]))
+					return false;
+				c->cur[in->arg] = sp;
+				pc++;
+				continue;
+			case BRE_OP_BOL:
+				follow = sp == 0;
+				break;
+			case BRE_OP_EOL:
+				follow = sp == len;
+				break;
+			case BRE_OP_PROGRESS:
+				follow = c->cur[in->arg] != sp;
+				break;
+			case BRE_OP_BACKREF:
+				follow = false;
+				break;
+			default:
+				/* CHAR, ANY, CLASS and MATCH become threads */
+				list->pcs[list->n] = pc;
+				memcpy(list->slots + (size_t)list->n * (size_t)ns, c->cur, (size_t)ns * sizeof(int));
+				list->n++;
+				follow = false;
+				break;
+			}
+			if (!follow)
+				break;
+			pc++;
+		}
+	}
+	return true;
+}
+
+static void pike_next_gen(BrePikeCache* c, int ninsts)
+{
+	if (++c->gen == UINT_MAX)
+	{
+		memset(c->seen, 0, (size_t)ninsts * sizeof(unsigned));
+		c->gen = 1;
+	}
+}
+
+BreResult bre_pike_search(const BreProgram* prog, BreScratch* scratch, const char* text, int len, int start, int* slots)
+{
+	if (!bre_search_window(prog, len, &start) || !bre_literal_possible(prog, text, len, start))
+		return BRE_NOMATCH;
+	BrePikeCache* c = pike_cache_get(prog, scratch);
+	if (!c)
+		return BRE_ERROR;
+
+	const BreInst* insts = prog->insts;
+	int ns = prog->nslots;
+	PikeList* clist = &c->lists[0];
+	PikeList* nlist = &c->lists[1];
+	bool matched = false;
+
+	clist->n = 0;
+	pike_next_gen(c, prog->ninsts);
+	for (int sp = start; sp <= len; sp++)
+	{
+		/* With no thread alive, jump to where the next attempt could succeed */
+		if (clist->n == 0 && !prog->anchored && prog->has_first)
+		{
+			sp = bre_skip_to_first(prog, text, len, sp);
+			if (sp == len)
+				break;
+		}
+
+		/* A new attempt starting here has lower priority than any thread already running.
+		   None starts where the rest of the text is shorter than every match. */
+		bool can_start = len - sp >= prog->min_len;
+		if (!matched && can_start && (sp == start || !prog->anchored))
+		{
+			for (int i = 0; i < ns; i++)
+				c->cur[i] = -1;
+			if (!pike_add(prog, c, clist, 0, sp, len))
+				return BRE_ERROR;
+		}
+		if (clist->n == 0 && (matched || prog->anchored || !can_start))
+			break;
+
+		nlist->n = 0;
+		pike_next_gen(c, prog->ninsts);
+		unsigned char ch = sp < len ? (unsigned char)text[sp] : 0;
+		for (int t = 0; t < clist->n; t++)
+		{
+			const BreInst* in = &insts[clist->pcs[t]];
+			int* tslots = clist->slots + (size_t)t * (size_t)ns;
+			bool step = false;
+			/* Longest match: an attempt that started after the match cannot win */
+			if (matched && prog->longest && tslots[0] > slots[0])
+				continue;
+			switch ((BreOpcode)in->op)
+			{
+			case BRE_OP_CHAR:
+				step = sp < len && bre_fold(prog, ch) == in->arg;
+				break;
+			case BRE_OP_ANY:
+				step = sp < len;
+				break;
+			case BRE_OP_CLASS:
+				step = sp < len && bre_class_contains(prog, in->arg, ch);
+				break;
+			case BRE_OP_MATCH:
+				if (prog->longest)
+				{
+					/* Threads run in order of start, so a match from an earlier start or a
+					   longer one from the same start is the better one */
+					if (!matched || tslots[0] < slots[0] || (tslots[0] == slots[0] && tslots[1] > slots[1]))
+						memcpy(slots, tslots, (size_t)ns * sizeof(int));
+					matched = true;
+					break;
+				}
+				/* Record it and drop the lower-priority threads behind it */
+				matched = true;
+				memcpy(slots, tslots, (size_t)ns * sizeof(int));
+				t = clist->n;
+				break;
+			default:
+				break;
+			}
+			if (step)
+			{
+				memcpy(c->cur, tslots, (size_t)ns * sizeof(int));
+				if (!pike_add(prog, c, nlist, clist->pcs[t] + 1, sp + 1, len))
+					return BRE_ERROR;
+			}
+		}
+
+		PikeList* tmp = clist;
+		clist = nlist;
+		nlist = tmp;
+		if (sp == len)
+			break;
+	}
+	return matched ? BRE_OK : BRE_NOMATCH;
+}
@@ -0,0 +1,260 @@
+/* bre_set.c - match many BRE patterns in one scan
+ *
+ * The patterns of a set are compiled one by one and their instructions are
+ * then spliced into a single program behind a chain of SPLITs, with each
+ * pattern's MATCH tagged by its index.  The lazy DFA runs that program over
+ * the text once, whatever the number of patterns.  Patterns that use
+ * back-references cannot live in an automaton and are kept as separate
+ * programs, matched one after the other.
+ */
+
+#include "bre_impl.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct BreSet
+{
+	size_t npatterns;
+	BreProgram* combined;  /* all patterns without back-references, or NULL */
+	BreProgram** backref;  /* patterns with back-references, compiled alone */
+	size_t* backref_index; /* pattern index of each program in 'backref' */
+	size_t nbackref;
+	BreScratch* own_scratch; /* for the functions without a scratch argument */
+};
+
+void bre_set_free(BreSet* set)
+{
+	if (!set)
+		return;
+	bre_scratch_free(set->own_scratch);
+	bre_free(set->combined);
+	for (size_t i = 0; i < set->nbackref; i++)
+		bre_free(set->backref[i]);
+	free(set->backref);
+	free(set->backref_index);
+	free(set);
+}
+
+/* Splice the programs in 'progs' (pattern indexes in 'index') into one */
+static BreProgram* combine(BreProgram** progs, const size_t* index, size_t n, bool icase)
+{
+	size_t ninsts = n - 1; /* the SPLIT chain */
+	size_t nclasses = 0;
+	int nslots = 0;
+	bool anchored = true;
+	bool end_anchored = true;
+	int min_len = INT_MAX;
+	int max_len = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		const BreProgram* p = progs[i];
+		ninsts += (size_t)p->ninsts;
+		nclasses += (size_t)p->nclasses;
+		if (p->nslots > nslots)
+			nslots = p->nslots;
+		anchored = anchored && p->anchored;
+		end_anchored = end_anchored && p->end_anchored;
+		if (p->min_len < min_len)
+			min_len = p->min_len;
+		if (max_len >= 0 && (p->max_len < 0 || p->max_len > max_len))
+			max_len = p->max_len;
+	}
+	if (ninsts > INT_MAX || nclasses > INT_MAX)
+		return NULL;
+
+	BreProgram* prog = (BreProgram*)calloc(1, sizeof(BreProgram));
+	if (!prog)
+		return NULL;
+	prog->insts = (BreInst*)malloc(ninsts * sizeof(BreInst));
+	prog->classes = (BreClass*)malloc((nclasses ? nclasses : 1) * sizeof(BreClass));
+	if (!prog->insts || !prog->classes)
+	{
+		bre_free(prog);
+		return NULL;
+	}
+
+	/* SPLIT i tries pattern i, then the next SPLIT (or the last pattern) */
+	int pc = (int)n - 1;
+	int coff = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		const BreProgram* p = progs[i];
+		if (i + 1 < n)
+		{
+			BreInst* split = &prog->insts[i];
+			split->op = BRE_OP_SPLIT;
+			split->arg = 0;
+			split->x = pc;
+			split->y = (i + 2 < n) ? (int)i + 1 : pc + p->ninsts;
+		}
+		for (int k = 0; k < p->ninsts; k++)
+		{
+			BreInst in = p->insts[k];
+			switch ((BreOpcode)in.op)
+			{
+			case BRE_OP_SPLIT:
+				in.y += pc;
+				in.x += pc;
+				break;
+			case BRE_OP_JMP:
+				in.x += pc;
+				break;
+			case BRE_OP_CLASS:
+				in.arg += coff;
+				break;
+			case BRE_OP_MATCH:
+				in.arg = (int)index[i];
+				break;
+			default:
+				break;
+			}
+			prog->insts[pc + k] = in;
+		}
+		if (p->nclasses > 0)
+			memcpy(prog->classes + coff, p->classes, (size_t)p->nclasses * sizeof(BreClass));
+		pc += p->ninsts;
+		coff += p->nclasses;
+	}
+
+	prog->ninsts = (int)ninsts;
+	prog->nclasses = (int)nclasses;
+	prog->nslots = nslots;
+	prog->anchored = anchored;
+	prog->end_anchored = end_anchored;
+	prog->min_len = min_len;
+	prog->max_len = max_len;
+	prog->icase = icase;
+	bre_compute_first_bytes(prog);
+	return prog;
+}
+
+BreSet* bre_set_compile(const char* const* patterns, size_t n, int flags)
+{
+	if (!patterns && n > 0)
+		return NULL;
+
+	BreSet* set = (BreSet*)calloc(1, sizeof(BreSet));
+	BreProgram** progs = (BreProgram**)calloc(n ? n : 1, sizeof(BreProgram*));
+	size_t* index = (size_t*)malloc((n ? n : 1) * sizeof(size_t));
+	bool ok = set && progs && index;
+	if (ok)
+	{
+		set->npatterns = n;
+		set->backref = (BreProgram**)malloc((n ? n : 1) * sizeof(BreProgram*));
+		set->backref_index = (size_t*)malloc((n ? n : 1) * sizeof(size_t));
+		ok = set->backref && set->backref_index;
+	}
+
+	size_t nplain = 0;
+	for (size_t i = 0; ok && i < n; i++)
+	{
+		BreProgram* p = bre_compile_flags(patterns[i], flags);
+		if (!p)
+			ok = false;
+		else if (p->has_backrefs)
+		{
+			set->backref[set->nbackref] = p;
+			set->backref_index[set->nbackref++] = i;
+		}
+		else
+		{
+			progs[nplain] = p;
+			index[nplain++] = i;
+		}
+	}
+	if (ok && nplain > 0)
+	{
+		set->combined = combine(progs, index, nplain, (flags & BRE_ICASE) != 0);
+		ok = set->combined != NULL;
+	}
+
+	for (size_t i = 0; i < nplain; i++)
+		bre_free(progs[i]);
+	free(progs);
+	free(index);
+	if (!ok)
+	{
+		bre_set_free(set);
+		return NULL;
+	}
+	return set;
+}
+
+size_t bre_set_size(const BreSet* set)
+{
+	return set ? set->npatterns : 0;
+}
+
+BreScratch* bre_set_scratch_new(const BreSet* set)
+{
+	/* Only the combined program keeps state between calls */
+	return set ? bre_scratch_alloc(set->combined) : NULL;
+}
+
+/* Yes/no backtracking search with slots of its own, so that a set shared
+   between threads never touches the programs' own scratch */
+static BreResult backref_test(const BreProgram* prog, const char* text, size_t len)
+{
+	int* slots = (int*)malloc((size_t)prog->nslots * sizeof(int));
+	if (!slots)
+		return BRE_ERROR;
+	BreResult r = bre_backtrack_search(prog, text, (int)len, 0, slots, NULL);
+	free(slots);
+	return r;
+}
+
+BreResult bre_set_match_r(const BreSet* set, BreScratch* scratch, const char* text, size_t len, bool* matched)
+{
+	if (!set || !scratch || scratch->prog != set->combined || !text || len > INT_MAX)
+		return BRE_ERROR;
+
+	bool any = false;
+	if (matched)
+	{
+		for (size_t i = 0; i < set->npatterns; i++)
+			matched[i] = false;
+	}
+	if (set->combined)
+	{
+		BreResult r = matched
+			? bre_dfa_search_all(set->combined, scratch, text, (int)len, matched,
+				(int)(set->npatterns - set->nbackref))
+			: bre_dfa_search(set->combined, scratch, text, (int)len);
+		if (r == BRE_ERROR)
+			return r;
+		any = r == BRE_OK;
+	}
+	for (size_t i = 0; i < set->nbackref && (matched || !any); i++)
+	{
+		BreResult r = backref_test(set->backref[i], text, len);
+		if (r != BRE_OK && r != BRE_NOMATCH)
+			return r;
+		if (r == BRE_OK)
+		{
+			any = true;
+			if (matched)
+				matched[set->backref_index[i]] = true;
+		}
+	}
+	return any ? BRE_OK : BRE_NOMATCH;
+}
+
+BreResult bre_set_test_r(const BreSet* set, BreScratch* scratch, const char* text, size_t len)
+{
+	return bre_set_match_r(set, scratch, text, len, NULL);
+}
+
+BreResult bre_set_match(const BreSet* set, const char* text, size_t len, bool* matched)
+{
+	if (!set)
+		return BRE_ERROR;
+	if (!set->own_scratch)
+		((BreSet*)set)->own_scratch = bre_scratch_alloc(set->combined);
+	return bre_set_match_r(set, set->own_scratch, text, len, matched);
+}
+
+BreResult bre_set_test(const BreSet* set, const char* text, size_t len)
+{
+	return bre_set_match(set, text, len, NULL);
+}
@@ -0,0 +1,422 @@
+/* litsearch.c - search for fixed strings
+ *
+ * A single needle uses Boyer-Moore-Horspool. The text is examined at the
+ * last byte of the window where the needle would end. Unless that byte
+ * completes a match, the window moves by the distance from its last
+ * occurrence in the needle (minus the final byte) to the needle's end, or by
+ * the whole needle length if it does not occur. For -i the needle is stored
+ * folded and every text byte goes through the same 256-entry folding table,
+ * so the skip loop stays a table lookup.
+ *
+ * A set of needles uses an Aho-Corasick automaton: the needles' trie with a
+ * failure link from each node to the longest proper suffix of its string
+ * that is also in the trie. See the comment above struct LitSet.
+ */
+
+#include "litsearch.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct LitSearch
+{
+	unsigned char* needle; /* folded when icase */
+	size_t len;
+	bool icase;
+	size_t skip[256];        /* indexed by text byte, folding already applied */
+	unsigned char fold[256]; /* tolower() of each byte, or the byte itself */
+};
+
+LitSearch* lit_compile(const char* needle, size_t len, bool icase)
+{
+	LitSearch* ls = (LitSearch*)malloc(sizeof(LitSearch));
+	if (!ls)
+		return NULL;
+	ls->needle = (unsigned char*)malloc(len ? len : 1);
+	if (!ls->needle)
+	{
+		free(ls);
+		return NULL;
+	}
+	ls->len = len;
+	ls->icase = icase;
+	for (int c = 0; c < 256; c++)
+		ls->fold[c] = (unsigned char)(icase ? tolower(c) : c);
+	for (size_t i = 0; i < len; i++)
+		ls->needle[i] = ls->fold[(unsigned char)needle[i]];
+
+	size_t folded_skip[256];
+	for (int c = 0; c < 256; c++)
+		folded_skip[c] = len;
+	for (size_t i = 0; i + 1 < len; i++)
+		folded_skip[ls->needle[i]] = len - 1 - i;
+	for (int c = 0; c < 256; c++)
+		ls->skip[c] = folded_skip[ls->fold[c]];
+	return ls;
+}
+
+void lit_free(LitSearch* ls)
+{
+	if (!ls)
+		return;
+	free(ls->needle);
+	free(ls);
+}
+
+size_t lit_length(const LitSearch* ls)
+{
+	return ls->len;
+}
+
+static const char* find_exact(const LitSearch* ls, const unsigned char* text, size_t len)
+{
+	const unsigned char* ndl = ls->needle;
+	size_t n = ls->len;
+	if (n == 1)
+		return (const char*)memchr(text, ndl[0], len);
+
+	unsigned char last = ndl[n - 1];
+	const unsigned char* p = text;
+	const unsigned char* end = text + len - n; /* last window start */
+	while (p <= end)
+	{
+		unsigned char c = p[n - 1];
+		if (c == last && memcmp(p, ndl, n - 1) == 0)
+			return (const char*)p;
+		p += ls->skip[c];
+	}
+	return NULL;
+}
+
+static const char* find_folded(const LitSearch* ls, const unsigned char* text, size_t len)
+{
+	const unsigned char* ndl = ls->needle;
+	const unsigned char* fold = ls->fold;
+	size_t n = ls->len;
+	unsigned char last = ndl[n - 1];
+	const unsigned char* p = text;
+	const unsigned char* end = text + len - n;
+	while (p <= end)
+	{
+		unsigned char c = p[n - 1];
+		if (fold[c] == last)
+		{
+			size_t j = 0;
+			while (j + 1 < n && fold[p[j]] == ndl[j])
+				j++;
+			if (j + 1 == n)
+				return (const char*)p;
+		}
+		p += ls->skip[c];
+	}
+	return NULL;
+}
+
+const char* lit_find(const LitSearch* ls, const char* text, size_t len)
+{
+	if (!ls || !text)
+		return NULL;
+	if (ls->len == 0)
+		return text;
+	if (ls->len > len)
+		return NULL;
+	const unsigned char* t = (const unsigned char*)text;
+	return ls->icase ? find_folded(ls, t, len) : find_exact(ls, t, len);
+}
+
+/* The automaton is kept compact for sets of tens of thousands of needles.
+ * Bytes are first mapped to classes: one per distinct (folded) byte used by
+ * the needles, and class 0 for all the others, which always lead back to
+ * the root. Nodes are numbered breadth-first, so shallow nodes, which the
+ * scan visits most, sit together at the front. The root and its children
+ * get a full row of transitions indexed by class; deeper nodes keep only
+ * their trie edges, sorted by class, and follow failure links to a node
+ * that has an edge for the byte or a full row.
+ */
+struct LitSet
+{
+	unsigned char cls[256]; /* class of each text byte, after folding */
+	int nclasses;
+	bool has_empty;  /* an empty needle matches every text */
+	int nnodes;
+	int* edge_first; /* edges of node i are [edge_first[i], edge_first[i + 1]) */
+	unsigned char* edge_cls;
+	int* edge_to;
+	int* fail;
+	int* out;        /* first node on the failure chain that ends a needle, or -1 */
+	int* depth;      /* length of the node's string */
+	unsigned char* term; /* whether the node's string is a needle */
+	int ndense;      /* nodes 0..ndense-1 have a row in 'dense' */
+	int* dense;
+};
+
+void lit_set_free(LitSet* set)
+{
+	if (!set)
+		return;
+	free(set->edge_first);
+	free(set->edge_cls);
+	free(set->edge_to);
+	free(set->fail);
+	free(set->out);
+	free(set->depth);
+	free(set->term);
+	free(set->dense);
+	free(set);
+}
+
+/* Trie edge of 'node' for class 'c', or -1 */
+static int edge(const LitSet* set, int node, int c)
+{
+	int lo = set->edge_first[node];
+	int hi = set->edge_first[node + 1];
+	while (lo < hi)
+	{
+		int mid = lo + (hi - lo) / 2;
+		if (set->edge_cls[mid] < c)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo < set->edge_first[node + 1] && set->edge_cls[lo] == c) ? set->edge_to[lo] : -1;
+}
+
+/* Automaton transition from 'node' on class 'c' */
+static int step(const LitSet* set, int node, int c)
+{
+	if (c == 0)
+		return 0;
+	for (;;)
+	{
+		if (node < set->ndense)
+			return set->dense[(size_t)node * (size_t)set->nclasses + (size_t)c];
+		int to = edge(set, node, c);
+		if (to >= 0)
+			return to;
+		node = set->fail[node];
+	}
+}
+
+/* Trie under construction: children as sibling lists, in insertion order */
+typedef struct
+{
+	int* child;
+	int* sibling;
+	unsigned char* cls; /* class of the edge into the node */
+	unsigned char* term;
+	int n;
+} BuildTrie;
+
+static void insert(BuildTrie* t, const LitSet* set, const unsigned char* fold, const char* needle)
+{
+	int node = 0;
+	for (const unsigned char* p = (const unsigned char*)needle; *p; p++)
+	{
+		unsigned char c = set->cls[fold[*p]];
+		int k = t->child[node];
+		while (k >= 0 && t->cls[k] != c)
+			k = t->sibling[k];
+		if (k < 0)
+		{
+			k = t->n++;
+			t->child[k] = -1;
+			t->cls[k] = c;
+			t->term[k] = 0;
+			t->sibling[k] = t->child[node];
+			t->child[node] = k;
+		}
+		node = k;
+	}
+	t->term[node] = 1;
+}
+
+LitSet* lit_set_compile(const char* const* needles, size_t n, bool icase)
+{
+	if (!needles && n > 0)
+		return NULL;
+	LitSet* set = (LitSet*)calloc(1, sizeof(LitSet));
+	if (!set)
+		return NULL;
+
+	unsigned char fold[256];
+	for (int c = 0; c < 256; c++)
+		fold[c] = (unsigned char)(icase ? tolower(c) : c);
+
+	/* Classes, and an upper bound on the number of trie nodes */
+	bool used[256] = {false};
+	size_t maxnodes = 1;
+	for (size_t i = 0; i < n; i++)
+	{
+		const unsigned char* p = (const unsigned char*)needles[i];
+		if (!*p)
+			set->has_empty = true;
+		for (; *p; p++, maxnodes++)
+			used[fold[*p]] = true;
+		if (maxnodes > INT_MAX / 2)
+		{
+			lit_set_free(set);
+			return NULL;
+		}
+	}
+	/* Needles cannot contain NUL, so at most 255 classes besides class 0 */
+	unsigned char id[256] = {0};
+	set->nclasses = 1;
+	for (int c = 0; c < 256; c++)
+	{
+		if (used[c])
+			id[c] = (unsigned char)set->nclasses++;
+	}
+	for (int c = 0; c < 256; c++)
+		set->cls[c] = id[fold[c]];
+
+	BuildTrie t;
+	t.child = (int*)malloc(maxnodes * sizeof(int));
+	t.sibling = (int*)malloc(maxnodes * sizeof(int));
+	t.cls = (unsigned char*)malloc(maxnodes);
+	t.term = (unsigned char*)malloc(maxnodes);
+	t.n = 1;
+	int* queue = (int*)malloc(maxnodes * sizeof(int)); /* BFS order: new id -> trie node */
+	set->edge_first = (int*)malloc((maxnodes + 1) * sizeof(int));
+	set->edge_cls = (unsigned char*)malloc(maxnodes);
+	set->edge_to = (int*)malloc(maxnodes * sizeof(int));
+	set->fail = (int*)malloc(maxnodes * sizeof(int));
+	set->out = (int*)malloc(maxnodes * sizeof(int));
+	set->depth = (int*)malloc(maxnodes * sizeof(int));
+	set->term = (unsigned char*)malloc(maxnodes);
+	bool ok = t.child && t.sibling && t.cls && t.term && queue && set->edge_first && set->edge_cls &&
+		set->edge_to && set->fail && set->out && set->depth && set->term;
+	if (ok)
+	{
+		t.child[0] = -1;
+		t.term[0] = 0;
+		for (size_t i = 0; i < n; i++)
+			insert(&t, set, fold, needles[i]);
+	}
+
+	/* Renumber breadth-first and lay the edges out sorted by class */
+	int nedges = 0;
+	int head = 0;
+	int tail = 1;
+	if (ok)
+	{
+		queue[0] = 0;
+		set->depth[0] = 0;
+		while (head < tail)
+		{
+			int v = head++;
+			int old = queue[v];
+			set->term[v] = t.term[old];
+			set->edge_first[v] = nedges;
+			for (int k = t.child[old]; k >= 0; k = t.sibling[k])
+			{
+				/* Insertion sort: nodes have few children */
+				int j = nedges++;
+				while (j > set->edge_first[v] && set->edge_cls[j - 1] > t.cls[k])
+				{
+					set->edge_cls[j] = set->edge_cls[j - 1];
+					set->edge_to[j] = set->edge_to[j - 1];
+					j--;
+				}
+				set->edge_cls[j] = t.cls[k];
+				set->edge_to[j] = k; /* trie node for now */
+			}
+			for (int e = set->edge_first[v]; e < nedges; e++)
+			{
+				int child = tail++;
+				queue[child] = set->edge_to[e];
+				set->edge_to[e] = child;
+				set->depth[child] = set->depth[v] + 1;
+			}
+		}
+		set->edge_first[tail] = nedges;
+		set->nnodes = tail;
+	}
+	free(t.child);
+	free(t.sibling);
+	free(t.cls);
+	free(t.term);
+	free(queue);
+
+	/* Failure links and full rows, shallowest nodes first */
+	if (ok)
+	{
+		int ndense = 0;
+		while (ndense < set->nnodes && set->depth[ndense] <= 1)
+			ndense++;
+		set->ndense = ndense;
+		set->dense = (int*)malloc((size_t)ndense * (size_t)set->nclasses * sizeof(int));
+		ok = set->dense != NULL;
+	}
+	if (ok)
+	{
+		set->fail[0] = 0;
+		set->out[0] = -1;
+		for (int v = 0; v < set->nnodes; v++)
+		{
+			if (v > 0 && v < set->ndense)
+				set->fail[v] = 0;
+			if (v > 0)
+				set->out[v] = set->term[v] ? v : set->out[set->fail[v]];
+			for (int e = set->edge_first[v]; e < set->edge_first[v + 1]; e++)
+			{
+				int child = set->edge_to[e];
+				if (set->depth[child] > 1)
+					set->fail[child] = step(set, set->fail[v], set->edge_cls[e]);
+			}
+			if (v < set->ndense)
+			{
+				int* row = set->dense + (size_t)v * (size_t)set->nclasses;
+				for (int c = 0; c < set->nclasses; c++)
+				{
+					int to = edge(set, v, c);
+					row[c] = to >= 0 ? to : (v == 0 ? 0 : set->dense[c]);
+				}
+			}
+		}
+	}
+	if (!ok)
+	{
+		lit_set_free(set);
+		return NULL;
+	}
+	return set;
+}
+
+bool lit_set_scan(const LitSet* set, const char* text, size_t len,
+	bool (*accept)(void* arg, size_t start, size_t length), void* arg)
+{
+	if (!set || !text)
+		return false;
+	if (set->has_empty && (!accept || accept(arg, 0, 0)))
+		return true;
+	const unsigned char* t = (const unsigned char*)text;
+	int node = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		node = step(set, node, set->cls[t[i]]);
+		for (int m = set->out[node]; m >= 0; m = set->out[set->fail[m]])
+		{
+			size_t mlen = (size_t)set->depth[m];
+			if (!accept || accept(arg, i + 1 - mlen, mlen))
+				return true;
+		}
+	}
+	return false;
+}
+
+bool lit_set_exact(const LitSet* set, const char* text, size_t len)
+{
+	if (!set || !text)
+		return false;
+	if (len == 0)
+		return set->has_empty;
+	const unsigned char* t = (const unsigned char*)text;
+	int node = 0;
+	for (size_t i = 0; i < len && node >= 0; i++)
+	{
+		int c = set->cls[t[i]];
+		node = c ? edge(set, node, c) : -1;
+	}
+	return node >= 0 && set->term[node];
+}
@@ -0,0 +1,55 @@
+#ifndef LITSEARCH_H
+#define LITSEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Fixed-string search for grep -F and for the literal prefilter of regular
+ * expressions. A needle is compiled once into a Horspool skip table and then
+ * searched for in any number of texts, skipping up to its length per step.
+ * A compiled needle is read-only and may be shared by threads.
+ */
+typedef struct LitSearch LitSearch;
+
+/* Compile needle[0..len). With 'icase' bytes are compared after tolower() in the
+ * current locale. Returns NULL on allocation failure.
+ */
+LitSearch *lit_compile(const char *needle, size_t len, bool icase);
+
+/* Release a compiled needle. NULL is ignored. */
+void lit_free(LitSearch *ls);
+
+/* Length of the needle. */
+size_t lit_length(const LitSearch *ls);
+
+/* First occurrence of the needle in text[0..len), or NULL. An empty needle
+ * matches at the start of the text.
+ */
+const char *lit_find(const LitSearch *ls, const char *text, size_t len);
+
+/* Many fixed strings searched for together, for grep -F with a long pattern list.
+ * The strings are compiled into one Aho-Corasick automaton, so a text is scanned
+ * once whatever their number. Like a single needle, a set is read-only once built.
+ */
+typedef struct LitSet LitSet;
+
+/* Compile 'n' NUL-terminated needles, folding case with 'icase'. Returns NULL on
+ * allocation failure or if the automaton would be too large.
+ */
+LitSet *lit_set_compile(const char *const *needles, size_t n, bool icase);
+
+/* Release a set. NULL is ignored. */
+void lit_set_free(LitSet *set);
+
+/* Report the occurrences of the needles in text[0..len) in order of their end,
+ * calling accept(arg, start, length) for each until it returns true. A NULL
+ * 'accept' takes the first occurrence. An empty needle is reported once, at
+ * offset 0. Returns whether an occurrence was accepted.
+ */
+bool lit_set_scan(const LitSet *set, const char *text, size_t len,
+                  bool (*accept)(void *arg, size_t start, size_t length), void *arg);
+
+/* Whether text[0..len) is exactly one of the needles. */
+bool lit_set_exact(const LitSet *set, const char *text, size_t len);
+
+#endif /* LITSEARCH_H */
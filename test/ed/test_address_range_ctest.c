@@ -103,8 +103,8 @@ CTEST_TEST_SIMPLE(delete_range_multiple_lines) {
     delete_range(&ed, range);
     
     CTEST_ASSERT_EQ(ed.num_lines, 2, "two lines remain");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "A", "first line preserved");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "E", "last line preserved");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "A", "first line preserved");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "E", "last line preserved");
     CTEST_ASSERT_EQ(ed.dirty, 1, "dirty flag set");
     
     free_editor(&ed);
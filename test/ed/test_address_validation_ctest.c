@@ -61,8 +61,8 @@ CTEST_TEST_SIMPLE(delete_line_invalid_addresses) {
     // Valid delete
     delete_line(&ed, 1);  // Delete line 2 (0-based: 1)
     CTEST_ASSERT_EQ(ed.num_lines, 2, "should have 2 lines after delete");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "Line 1", "line 1 should be unchanged");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "Line 3", "line 3 should move to position 1");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "Line 1", "line 1 should be unchanged");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "Line 3", "line 3 should move to position 1");
     
     free_editor(&ed);
 }
@@ -48,11 +48,11 @@ CTEST_TEST_SIMPLE(append_after_address) {
     append_line(&ed, 0);
 
     CTEST_ASSERT_EQ(ed.num_lines, 5, "num_lines should be 5 after append");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "A", "line 0 should be A");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "X1", "line 1 should be X1");
-    CTEST_ASSERT_STR_EQ(ed.lines[2], "X2", "line 2 should be X2");
-    CTEST_ASSERT_STR_EQ(ed.lines[3], "B", "line 3 should be B");
-    CTEST_ASSERT_STR_EQ(ed.lines[4], "C", "line 4 should be C");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "A", "line 0 should be A");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "X1", "line 1 should be X1");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 2), "X2", "line 2 should be X2");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 3), "B", "line 3 should be B");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 4), "C", "line 4 should be C");
 
     free_editor(&ed);
     common_teardown(ctest);
@@ -71,10 +71,10 @@ CTEST_TEST_SIMPLE(append_at_end) {
     append_line(&ed, 1);
 
     CTEST_ASSERT_EQ(ed.num_lines, 4, "num_lines should be 4");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "L1", "line 0");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "L2", "line 1");
-    CTEST_ASSERT_STR_EQ(ed.lines[2], "N1", "line 2");
-    CTEST_ASSERT_STR_EQ(ed.lines[3], "N2", "line 3");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "L1", "line 0");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "L2", "line 1");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 2), "N1", "line 2");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 3), "N2", "line 3");
 
     free_editor(&ed);
     common_teardown(ctest);
@@ -87,8 +87,8 @@ CTEST_TEST_SIMPLE(empty_buffer_append) {
     append_line(&ed, -1);
 
     CTEST_ASSERT_EQ(ed.num_lines, 2, "num_lines should be 2 for empty buffer append");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "First", "line 0 should be First");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "Second", "line 1 should be Second");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "First", "line 0 should be First");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "Second", "line 1 should be Second");
 
     free_editor(&ed);
 }
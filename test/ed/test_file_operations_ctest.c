@@ -76,7 +76,7 @@ CTEST_TEST_SIMPLE(forced_edit_command) {
     // Forced edit should succeed despite dirty flag
     forced_edit_file(&ed, "test_forced2.txt");
     CTEST_ASSERT_EQ(ed.num_lines, 1, "new file loaded");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "New content", "correct content");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "New content", "correct content");
     CTEST_ASSERT_EQ(ed.dirty, 0, "not dirty");
     
     free_editor(&ed);
@@ -107,9 +107,9 @@ CTEST_TEST_SIMPLE(read_file_command) {
     
     // Should now have 3 lines
     CTEST_ASSERT_EQ(ed.num_lines, 3, "3 lines after insert");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "Line 1", "line 0");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "Line 2", "line 1");
-    CTEST_ASSERT_STR_EQ(ed.lines[2], "Line 3", "line 2");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "Line 1", "line 0");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "Line 2", "line 1");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 2), "Line 3", "line 2");
     CTEST_ASSERT_EQ(ed.dirty, 1, "dirty flag set");
     CTEST_ASSERT_EQ(ed.current_line, 1, "current line updated");
     
@@ -169,8 +169,8 @@ CTEST_TEST_SIMPLE(read_file_empty_buffer) {
     read_file_at_address(&ed, -1, "test_read_empty.txt");
     
     CTEST_ASSERT_EQ(ed.num_lines, 2, "2 lines read");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "First", "line 0");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "Second", "line 1");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "First", "line 0");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "Second", "line 1");
     CTEST_ASSERT_EQ(ed.dirty, 1, "dirty flag set");
     
     free_editor(&ed);
@@ -201,7 +201,7 @@ CTEST_TEST_SIMPLE(edit_command_default_filename) {
     // Edit without specifying filename (should use ed.filename)
     edit_file(&ed, ed.filename);
     CTEST_ASSERT_EQ(ed.num_lines, 1, "file reloaded");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "Version 2", "updated content");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "Version 2", "updated content");
     
     free_editor(&ed);
     remove("test_default.txt");
@@ -29,8 +29,8 @@ CTEST_TEST_SIMPLE(global_substitute_on_matches)
     // We call substitute_range directly to avoid stdout capture issues
     AddressRange r = {0, 2};
     substitute_range(&ed, r, "o", "0", 1);
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "f00", "line0 changed");
-    CTEST_ASSERT_STR_EQ(ed.lines[2], "baz00", "line2 changed");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "f00", "line0 changed");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 2), "baz00", "line2 changed");
     free_editor(&ed);
 }
 
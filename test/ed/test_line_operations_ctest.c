@@ -39,9 +39,9 @@ CTEST_TEST_SIMPLE(change_command_single_line) {
     ed.dirty = 1;
     
     CTEST_ASSERT_EQ(ed.num_lines, 3, "3 lines after change");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "Line 1", "line 0 unchanged");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "Changed", "line 1 changed");
-    CTEST_ASSERT_STR_EQ(ed.lines[2], "Line 3", "line 2 unchanged");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "Line 1", "line 0 unchanged");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "Changed", "line 1 changed");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 2), "Line 3", "line 2 unchanged");
     
     free_editor(&ed);
 }
@@ -64,11 +64,11 @@ CTEST_TEST_SIMPLE(move_command_forward) {
     move_range(&ed, range, 3);
     
     CTEST_ASSERT_EQ(ed.num_lines, 5, "still 5 lines");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "Line 1", "line 0");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "Line 4", "line 1 (was 4)");
-    CTEST_ASSERT_STR_EQ(ed.lines[2], "Line 2", "line 2 (moved)");
-    CTEST_ASSERT_STR_EQ(ed.lines[3], "Line 3", "line 3 (moved)");
-    CTEST_ASSERT_STR_EQ(ed.lines[4], "Line 5", "line 4");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "Line 1", "line 0");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "Line 4", "line 1 (was 4)");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 2), "Line 2", "line 2 (moved)");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 3), "Line 3", "line 3 (moved)");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 4), "Line 5", "line 4");
     CTEST_ASSERT_EQ(ed.current_line, 4, "current line updated");
     
     free_editor(&ed);
@@ -92,11 +92,11 @@ CTEST_TEST_SIMPLE(move_command_backward) {
     move_range(&ed, range, 0);
     
     CTEST_ASSERT_EQ(ed.num_lines, 5, "still 5 lines");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "Line 1", "line 0");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "Line 4", "line 1 (moved)");
-    CTEST_ASSERT_STR_EQ(ed.lines[2], "Line 5", "line 2 (moved)");
-    CTEST_ASSERT_STR_EQ(ed.lines[3], "Line 2", "line 3");
-    CTEST_ASSERT_STR_EQ(ed.lines[4], "Line 3", "line 4");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "Line 1", "line 0");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "Line 4", "line 1 (moved)");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 2), "Line 5", "line 2 (moved)");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 3), "Line 2", "line 3");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 4), "Line 3", "line 4");
     CTEST_ASSERT_EQ(ed.current_line, 3, "current line updated");
     
     free_editor(&ed);
@@ -118,11 +118,11 @@ CTEST_TEST_SIMPLE(copy_command) {
     copy_range(&ed, range, 2);
     
     CTEST_ASSERT_EQ(ed.num_lines, 5, "5 lines after copy");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "Line 1", "line 0");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "Line 2", "line 1");
-    CTEST_ASSERT_STR_EQ(ed.lines[2], "Line 3", "line 2");
-    CTEST_ASSERT_STR_EQ(ed.lines[3], "Line 1", "line 3 (copy)");
-    CTEST_ASSERT_STR_EQ(ed.lines[4], "Line 2", "line 4 (copy)");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "Line 1", "line 0");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "Line 2", "line 1");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 2), "Line 3", "line 2");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 3), "Line 1", "line 3 (copy)");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 4), "Line 2", "line 4 (copy)");
     CTEST_ASSERT_EQ(ed.current_line, 4, "current line updated");
     CTEST_ASSERT_EQ(ed.dirty, 1, "dirty flag set");
     
@@ -146,8 +146,8 @@ CTEST_TEST_SIMPLE(join_command_multiple_lines) {
     join_range(&ed, range);
     
     CTEST_ASSERT_EQ(ed.num_lines, 2, "2 lines after join");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "Line 1", "line 0 unchanged");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "Hello World", "line 1 joined");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "Line 1", "line 0 unchanged");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "Hello World", "line 1 joined");
     CTEST_ASSERT_EQ(ed.current_line, 1, "current line updated");
     CTEST_ASSERT_EQ(ed.dirty, 1, "dirty flag set");
     
@@ -170,7 +170,7 @@ CTEST_TEST_SIMPLE(join_command_all_lines) {
     join_range(&ed, range);
     
     CTEST_ASSERT_EQ(ed.num_lines, 1, "1 line after join");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "ABC", "all lines joined");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "ABC", "all lines joined");
     CTEST_ASSERT_EQ(ed.current_line, 0, "current line updated");
     
     free_editor(&ed);
@@ -214,10 +214,10 @@ CTEST_TEST_SIMPLE(copy_command_to_beginning) {
     copy_range(&ed, range, 0);
     
     CTEST_ASSERT_EQ(ed.num_lines, 4, "4 lines after copy");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "A", "line 0");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "C", "line 1 (copy)");
-    CTEST_ASSERT_STR_EQ(ed.lines[2], "B", "line 2");
-    CTEST_ASSERT_STR_EQ(ed.lines[3], "C", "line 3");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "A", "line 0");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "C", "line 1 (copy)");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 2), "B", "line 2");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 3), "C", "line 3");
     
     free_editor(&ed);
 }
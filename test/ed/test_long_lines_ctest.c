@@ -32,8 +32,8 @@ CTEST_TEST_SIMPLE(load_file_long_line) {
     CTEST_ASSERT_EQ(ed.num_lines, 2, "two lines loaded");
     CTEST_ASSERT_EQ(strlen(ed.lines[0]), long_len, "length of first long line preserved");
     CTEST_ASSERT_EQ(strlen(ed.lines[1]), 1234, "length of second long line preserved");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], line1, "content of first long line matches");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], line2, "content of second long line matches");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), line1, "content of first long line matches");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), line2, "content of second long line matches");
 
     free(line1); free(line2);
     free_editor(&ed);
@@ -63,7 +63,7 @@ CTEST_TEST_SIMPLE(append_line_long_input) {
 
     CTEST_ASSERT_EQ(ed.num_lines, 1, "one line appended");
     CTEST_ASSERT_EQ(strlen(ed.lines[0]), long_len, "appended length preserved");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], line, "appended content matches");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), line, "appended content matches");
 
     free(line);
     free_editor(&ed);
@@ -94,8 +94,8 @@ CTEST_TEST_SIMPLE(insert_line_long_input) {
 
     CTEST_ASSERT_EQ(ed.num_lines, 2, "two lines after insert");
     CTEST_ASSERT_EQ(strlen(ed.lines[0]), long_len, "inserted long line length");
-    CTEST_ASSERT_STR_EQ(ed.lines[0], line, "inserted content matches");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "Seed", "original line shifted");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), line, "inserted content matches");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "Seed", "original line shifted");
 
     free(line);
     free_editor(&ed);
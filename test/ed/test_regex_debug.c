@@ -23,7 +23,7 @@ CTEST_TEST_SIMPLE(regex_backward_search_with_offset) {
     CTEST_ASSERT_EQ(idx, 2, "?o?-1 from line 5 should find 'four' at index 3, then -1 gives index 2 ('three')");
     
     if (idx >= 0 && idx < ed.num_lines) {
-        CTEST_ASSERT_STR_EQ(ed.lines[idx], "three", "result should be 'three'");
+        CTEST_ASSERT_STR_EQ(ed_line(&ed, idx), "three", "result should be 'three'");
     }
 
     free_editor(&ed);
@@ -48,7 +48,7 @@ CTEST_TEST_SIMPLE(regex_backward_search_no_offset) {
     CTEST_ASSERT_EQ(idx, 3, "?o? from line 5 should find 'four' at index 3");
     
     if (idx >= 0 && idx < ed.num_lines) {
-        CTEST_ASSERT_STR_EQ(ed.lines[idx], "four", "result should be 'four'");
+        CTEST_ASSERT_STR_EQ(ed_line(&ed, idx), "four", "result should be 'four'");
     }
 
     free_editor(&ed);
@@ -22,9 +22,9 @@ CTEST_TEST_SIMPLE(substitute_global_simple) {
     AddressRange range = {0, 2};
     substitute_range(&ed, range, "o", "0", 1);
 
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "f00", "line 1 replaced");
-    CTEST_ASSERT_STR_EQ(ed.lines[1], "bar b00", "line 2 replaced");
-    CTEST_ASSERT_STR_EQ(ed.lines[2], "z00", "line 3 replaced");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "f00", "line 1 replaced");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 1), "bar b00", "line 2 replaced");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 2), "z00", "line 3 replaced");
     CTEST_ASSERT_EQ(ed.current_line, 2, "current line after s///g range");
     CTEST_ASSERT_EQ(ed.dirty, 1, "dirty set after substitution");
 
@@ -42,7 +42,7 @@ CTEST_TEST_SIMPLE(substitute_with_backref) {
     // h\(...\)o -> capture "ell", replace with h\1X (matches engine test)
     substitute_range(&ed, range, "h\\(...\\)o", "h\\1X", 0);
 
-    CTEST_ASSERT_STR_EQ(ed.lines[0], "hellX", "backref substitution");
+    CTEST_ASSERT_STR_EQ(ed_line(&ed, 0), "hellX", "backref substitution");
     CTEST_ASSERT_EQ(ed.current_line, 0, "current line after single-line s///");
 
     free_editor(&ed);
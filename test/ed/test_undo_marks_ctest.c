@@ -5,32 +5,117 @@
 
 static char* dup_cstr(const char* s){size_t n=strlen(s)+1;char* p=(char*)malloc(n);memcpy(p,s,n);return p;}
 
-CTEST_TEST_SIMPLE(undo_after_delete_range) {
-    Editor ed; init_editor(&ed);
-    ed.lines=(char**)malloc(3*sizeof(char*));
-    ed.lines[0]=dup_cstr("A"); ed.lines[1]=dup_cstr("B"); ed.lines[2]=dup_cstr("C");
-    ed.num_lines=3; ed.current_line=2;
+// Buffer holding the given lines, with nothing to undo yet
+static void load_lines(Editor* ed, const char* const* text, int n){
+    init_editor(ed);
+    for(int i=0;i<n;i++){ char* line=dup_cstr(text[i]); ed_insert_lines(ed, i, &line, 1); }
+    ed->current_line=n-1;
+}
+
+static bool same_lines(const Editor* ed, const char* const* text, int n){
+    if(ed->num_lines!=n) return false;
+    for(int i=0;i<n;i++) if(strcmp(ed_line(ed,i),text[i])!=0) return false;
+    return true;
+}
+
+static const char* const ABCDE[]={"A","B","C","D","E"};
+
+CTEST(undo_after_delete_range) {
+    Editor ed; load_lines(&ed, ABCDE, 3);
     AddressRange r={0,1};
     delete_range(&ed, r);
-    CTEST_ASSERT_EQ(ed.num_lines, 1, "after delete");
-    // Undo
-    // call 'u' via execute_command is static; simulate by calling undo path: not exposed. So use write_then_read? Instead, call prepare: we can't.
-    // We'll directly check that undo snapshot exists and restore by calling 'append_line' trick not possible.
-    // Minimal: verify delete_range prepared undo by calling free_editor (ensures no crash). Skip invoking u here.
-    CTEST_ASSERT_EQ(ed.undo_valid, 1, "undo snapshot available");
+    CTEST_ASSERT_EQ(ctest, ed.num_lines, 1, "after delete");
+    CTEST_ASSERT_EQ(ctest, ed.undo_valid, 1, "undo step available");
+    CTEST_ASSERT_EQ(ctest, ed_undo(&ed), 1, "u");
+    CTEST_ASSERT_TRUE(ctest, same_lines(&ed, ABCDE, 3), "lines restored");
+    CTEST_ASSERT_EQ(ctest, ed.current_line, 2, "current line restored");
     free_editor(&ed);
 }
 
-CTEST_TEST_SIMPLE(mark_set_and_resolve) {
+CTEST(undo_each_command_in_turn) {
+    // 1d, 2d, u, u gives back the file
+    Editor ed; load_lines(&ed, ABCDE, 5);
+    delete_line(&ed, 0);
+    delete_line(&ed, 1);
+    static const char* const after_2d[]={"B","D","E"};
+    CTEST_ASSERT_TRUE(ctest, same_lines(&ed, after_2d, 3), "1d then 2d");
+    CTEST_ASSERT_EQ(ctest, ed_undo(&ed), 1, "first u");
+    static const char* const after_u[]={"B","C","D","E"};
+    CTEST_ASSERT_TRUE(ctest, same_lines(&ed, after_u, 4), "first u reverts 2d only");
+    CTEST_ASSERT_EQ(ctest, ed_undo(&ed), 1, "second u");
+    CTEST_ASSERT_TRUE(ctest, same_lines(&ed, ABCDE, 5), "second u reverts 1d");
+    CTEST_ASSERT_EQ(ctest, ed_undo(&ed), 0, "nothing left to undo");
+    CTEST_ASSERT_EQ(ctest, ed.undo_valid, 0, "undo_valid cleared");
+    free_editor(&ed);
+}
+
+CTEST(undo_substitute_and_join) {
+    Editor ed; load_lines(&ed, ABCDE, 5);
+    AddressRange all={0,4};
+    substitute_range(&ed, all, "[ACE]", "x", 0);
+    AddressRange two={1,2};
+    join_range(&ed, two);
+    static const char* const changed[]={"x","Bx","D","x"};
+    CTEST_ASSERT_TRUE(ctest, same_lines(&ed, changed, 4), "s then j");
+    ed_undo(&ed);
+    ed_undo(&ed);
+    CTEST_ASSERT_TRUE(ctest, same_lines(&ed, ABCDE, 5), "both undone");
+    free_editor(&ed);
+}
+
+CTEST(mark_survives_delete_and_undo) {
+    Editor ed; load_lines(&ed, ABCDE, 5);
+    ed.marks['a'-'a']=2;
+    AddressRange r={1,3};
+    delete_range(&ed, r);
+    CTEST_ASSERT_EQ(ctest, ed.marks['a'-'a'], -1, "mark on a deleted line is unset");
+    ed_undo(&ed);
+    CTEST_ASSERT_EQ(ctest, ed.marks['a'-'a'], 2, "mark restored by u");
+    CTEST_ASSERT_EQ(ctest, parse_address(&ed, "'a"), 2, "'a resolves again");
+    CTEST_ASSERT_STR_EQ(ctest, ed_line(&ed, 2), "C", "marked line back");
+    free_editor(&ed);
+}
+
+CTEST(oldest_steps_dropped_over_memory_limit) {
+    // Two deletes that each hold more than half the limit, then a small one
+    enum { LINE = 64*1024 };
+    int half=(int)(UNDO_MEMORY_LIMIT/2/LINE)+16;
     Editor ed; init_editor(&ed);
-    ed.lines=(char**)malloc(2*sizeof(char*));
-    ed.lines[0]=dup_cstr("X"); ed.lines[1]=dup_cstr("Y");
-    ed.num_lines=2; ed.current_line=2;
+    char* big=(char*)malloc(LINE);
+    memset(big,'x',LINE-1); big[LINE-1]='\0';
+    for(int i=0;i<2*half;i++){ char* line=dup_cstr(big); ed_insert_lines(&ed, i, &line, 1); }
+    char* last=dup_cstr("last");
+    ed_insert_lines(&ed, 2*half, &last, 1);
+    free(big);
+    AddressRange first={0,half-1};
+    delete_range(&ed, first);
+    delete_range(&ed, first);
+    delete_line(&ed, 0);
+    CTEST_ASSERT_EQ(ctest, ed.num_lines, 0, "all deleted");
+    CTEST_ASSERT_EQ(ctest, ed_undo(&ed), 1, "small delete undone");
+    CTEST_ASSERT_EQ(ctest, ed_undo(&ed), 1, "second large delete undone");
+    CTEST_ASSERT_EQ(ctest, ed.num_lines, half+1, "lines of the second delete back");
+    CTEST_ASSERT_EQ(ctest, ed_undo(&ed), 0, "first large delete was forgotten");
+    free_editor(&ed);
+}
+
+CTEST(mark_set_and_resolve) {
+    Editor ed; load_lines(&ed, ABCDE, 2);
     ed.marks['q'-'a']=1;
     int idx = parse_address(&ed, "'q");
-    CTEST_ASSERT_EQ(idx, 1, "'q resolved");
+    CTEST_ASSERT_EQ(ctest, idx, 1, "'q resolved");
     free_editor(&ed);
 }
 
-int main(void){ ctest_run_all(); return 0; }
-
+int main(void){
+    CTestEntry* suite[]={
+        &ctest_entry_undo_after_delete_range,
+        &ctest_entry_undo_each_command_in_turn,
+        &ctest_entry_undo_substitute_and_join,
+        &ctest_entry_mark_survives_delete_and_undo,
+        &ctest_entry_oldest_steps_dropped_over_memory_limit,
+        &ctest_entry_mark_set_and_resolve,
+        NULL
+    };
+    return ctest_run_suite(suite);
+}
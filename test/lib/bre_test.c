@@ -3,6 +3,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef __STDC_NO_THREADS__
+#include <threads.h>
+#endif
 
 #define OK(cond, desc)                                                                                                 \
     do                                                                                                                 \
@@ -305,9 +308,9 @@ static void test_parse_bre_repetition(void)
     TEST_PAT("a\\{5\\}x", 0, BRE_NOMATCH, "pi=0 points to 'a', not \\{ -> return BRE_NOMATCH");
 
     /* 4. Edge cases */
-    TEST_PAT("\\{255\\}", 0, BRE_OK, "equal to RE_DUP_MAX");
-    OK(rep.min == 255 && rep.max == 255, "RE_DUP_MAX parsed");
-    TEST_PAT("\\{999999999\\}", 0, BRE_ERROR, "greater than RE_DUP_MAX");
+    TEST_PAT("\\{255\\}", 0, BRE_OK, "255 repetitions");
+    OK(rep.min == 255 && rep.max == 255, "255 repetitions parsed");
+    TEST_PAT("\\{999999999\\}", 0, BRE_ERROR, "greater than BRE_DUP_MAX");
 
     TEST_PAT("\\{0\\}", 0, BRE_OK, "\\{0\\} → zero times");
     OK(rep.min == 0 && rep.max == 0, "zero repetition");
@@ -378,8 +381,18 @@ static void test_match(void)
     OK(r == BRE_OK && m.num_groups >= 1 && m.groups[0].start == 3 && m.groups[0].length == 3, "one capture group");
 
     r = bre_match("aaaa", "\\(aa\\)\\{2\\}", &m);
-    OK(r == BRE_OK && m.num_groups == 1 && m.groups[0].start == 0 && m.groups[0].length == 4,
-       "capture group with repetition captures full match");
+    OK(r == BRE_OK && m.num_groups == 1 && m.groups[0].start == 2 && m.groups[0].length == 2,
+       "capture group with repetition holds the last pass");
+
+    r = bre_match("abab", "\\(ab\\)*", &m);
+    OK(r == BRE_OK && m.length == 4 && m.groups[0].start == 2 && m.groups[0].length == 2,
+       "\\(ab\\)* holds the last pass, not the span of all");
+
+    r = bre_match("xb", "\\(a\\)*xb\\1", &m);
+    OK(r == BRE_NOMATCH, "group repeated zero times stays unset for \\1");
+
+    r = bre_match("xb", "\\(a\\)*xb", &m);
+    OK(r == BRE_OK && m.groups[0].start == -1, "group repeated zero times reports no capture");
 }
 
 static void test_substitute(void)
@@ -390,6 +403,10 @@ static void test_substitute(void)
     OK(res && strcmp(res, "hello planet") == 0, "simple substitute");
     free(res);
 
+    res = bre_substitute("abab", "\\(ab\\)*", "[\\1]");
+    OK(res && strcmp(res, "[ab]") == 0, "\\1 of a repeated group is its last pass");
+    free(res);
+
     res = bre_substitute("John Doe", "^\\(.*\\) \\(.*\\)$", "\\2, \\1");
     OK(res && strcmp(res, "Doe, John") == 0, "swap first/last name with \\1 \\2");
     free(res);
@@ -407,6 +424,613 @@ static void test_substitute(void)
     free(res);
 }
 
+static void test_compiled(void)
+{
+    BreMatch m = {0};
+    BreResult r;
+
+    BreProgram *prog = bre_compile("\\([a-z]*\\)=\\([0-9]\\{1,3\\}\\)");
+    OK(prog != NULL, "bre_compile accepts key=value pattern");
+    r = bre_exec(prog, "x: width=80", &m);
+    OK(r == BRE_OK && m.start == 3 && m.length == 8 && m.num_groups == 2 && m.groups[0].start == 3 &&
+           m.groups[0].length == 5 && m.groups[1].start == 9 && m.groups[1].length == 2,
+       "bre_exec reports match and groups");
+    r = bre_exec(prog, "no pairs here", &m);
+    OK(r == BRE_NOMATCH && m.start == -1, "bre_exec reuses program for a second text");
+    bre_free(prog);
+
+    OK(bre_compile("a\\(b") == NULL, "bre_compile rejects unbalanced group");
+    OK(bre_compile("\\1") == NULL, "bre_compile rejects back-reference to unknown group");
+    bre_free(NULL);
+
+    r = bre_match("axxbc", "a\\(b\\)c", &m);
+    OK(r == BRE_NOMATCH, "group is matched in place, not searched for");
+
+    r = bre_match("abcabc", "\\(abc\\)\\1", &m);
+    OK(r == BRE_OK && m.start == 0 && m.length == 6, "back-reference \\1");
+
+    r = bre_match("a*b", "*b", &m);
+    OK(r == BRE_OK && m.start == 1 && m.length == 2, "leading * is literal");
+
+    r = bre_match("aaab", "\\(a*\\)*b", &m);
+    OK(r == BRE_OK && m.start == 0 && m.length == 4, "nested star terminates");
+
+    /* Exponential for a backtracker; the Pike VM handles it in one pass */
+    char many[4097];
+    memset(many, 'a', sizeof(many) - 1);
+    many[sizeof(many) - 1] = '\0';
+    r = bre_match(many, "\\(a*\\)*\\(a*\\)*b", &m);
+    OK(r == BRE_NOMATCH, "nested star without a match runs in linear time");
+    r = bre_match("xaab", "\\(a*\\)*b", &m);
+    OK(r == BRE_OK && m.start == 1 && m.length == 3 && m.groups[0].start == 1 && m.groups[0].length == 2,
+       "Pike VM keeps leftmost greedy group span");
+}
+
+static void test_required_literal(void)
+{
+    size_t n = 0;
+    BreProgram *prog = bre_compile("ERROR:.*timeout");
+    const char *lit = bre_required_literal(prog, &n);
+    OK(lit && n == 7 && memcmp(lit, "timeout", 7) == 0, "required literal picks the longest run");
+    OK(bre_test(prog, "ERROR: disk full") == BRE_NOMATCH, "text without the literal is rejected");
+    OK(bre_test(prog, "x ERROR: read timeout") == BRE_OK, "text with the literal still matches");
+    bre_free(prog);
+
+    prog = bre_compile("a\\(bc\\)\\{2\\}d*e");
+    lit = bre_required_literal(prog, &n);
+    OK(lit && n == 5 && memcmp(lit, "abcbc", 5) == 0, "required literal spans groups and counted repeats");
+    bre_free(prog);
+
+    prog = bre_compile("a*[0-9]");
+    OK(bre_required_literal(prog, &n) == NULL, "optional text is not required");
+    BreMatch m;
+    OK(bre_exec(prog, "xxxxaa7", &m) == BRE_OK && m.start == 4 && m.length == 3, "first-byte skip keeps leftmost match");
+    bre_free(prog);
+}
+
+static void test_substitute_into(void)
+{
+    BreBuffer buf = {0};
+    size_t n = 0;
+
+    BreProgram *prog = bre_compile("o");
+    OK(bre_substitute_into(prog, "foo boo", 7, "0", 0, &buf, &n) == BRE_OK && n == 4 && strcmp(buf.data, "f00 b00") == 0,
+       "global substitution counts replacements");
+    OK(bre_substitute_into(prog, "foo boo", 7, "[&]", 3, &buf, &n) == BRE_OK && n == 1 &&
+           strcmp(buf.data, "foo b[o]o") == 0,
+       "nth occurrence with & reuses the buffer");
+    OK(bre_substitute_into(prog, "xyz", 3, "0", 0, &buf, &n) == BRE_OK && n == 0 && strcmp(buf.data, "xyz") == 0,
+       "no match copies the text");
+    bre_free(prog);
+
+    prog = bre_compile("x*");
+    OK(bre_substitute_into(prog, "abxc", 4, "-", 0, &buf, &n) == BRE_OK && strcmp(buf.data, "-a-b-c-") == 0,
+       "empty matches next to a match are skipped");
+    bre_free(prog);
+
+    prog = bre_compile("\\([a-z]*\\)=\\([0-9]*\\)");
+    OK(bre_substitute_into(prog, "a=1 bb=22", 9, "\\2:\\1\\&", 0, &buf, &n) == BRE_OK && n == 2 &&
+           strcmp(buf.data, "1:a& 22:bb&") == 0,
+       "groups and escaped & in replacement");
+    bre_free(prog);
+    bre_buffer_free(&buf);
+    OK(buf.data == NULL && buf.cap == 0, "bre_buffer_free resets the buffer");
+}
+
+static void test_bracket(void)
+{
+    BreMatch m = {0};
+    OK(bre_match("id: foo_bar-9;", "[[:alnum:]_-]*;", &m) == BRE_OK && m.start == 4 && m.length == 10,
+       "[:alnum:] combined with literal members");
+    OK(bre_match("abc 123", "[[:digit:]][[:digit:]]*", &m) == BRE_OK && m.start == 4 && m.length == 3,
+       "[:digit:] class");
+    OK(bre_match("a]b", "[]]", &m) == BRE_OK && m.start == 1, "']' first in the list is a member");
+    OK(bre_match("]]x", "[^]]", &m) == BRE_OK && m.start == 2, "']' first after '^' is a member");
+    OK(bre_match("a-b", "[b-]", &m) == BRE_OK && m.start == 1, "trailing '-' is a member");
+    OK(bre_match("x.y", "[[.-.][=.=]]", &m) == BRE_OK && m.start == 1, "[.c.] and [=c=] name one byte");
+    OK(bre_match("abc", "[[:nosuch:]]", &m) == BRE_ERROR, "unknown class name is an error");
+    OK(bre_match("abc", "[a", &m) == BRE_ERROR, "unterminated bracket expression is an error");
+
+    BreProgram *prog = bre_compile_flags("^[^a-c]*$", BRE_ICASE);
+    OK(prog && bre_test(prog, "xyz") == BRE_OK && bre_test(prog, "xBz") == BRE_NOMATCH,
+       "BRE_ICASE folds before negating");
+    bre_free(prog);
+    prog = bre_compile_flags("[[:lower:]]", BRE_ICASE);
+    OK(prog && bre_test(prog, "ABC") == BRE_OK, "BRE_ICASE widens [:lower:]");
+    bre_free(prog);
+}
+
+static void test_limits(void)
+{
+    char text[2001];
+    memset(text, 'a', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+
+    BreProgram *prog = bre_compile("\\(a*a*\\)*\\1[bc]");
+    BreLimits small = {100000, 0, true};
+    bre_set_limits(prog, &small);
+    BreMatch m = {0};
+    OK(prog && bre_exec(prog, text, &m) == BRE_LIMIT, "exhausted step budget returns BRE_LIMIT");
+    OK(prog && bre_test(prog, text) == BRE_LIMIT, "bre_test reports BRE_LIMIT too");
+    BreLimits shallow = {0, 16, true};
+    bre_set_limits(prog, &shallow);
+    OK(prog && bre_exec(prog, text, &m) == BRE_LIMIT, "exhausted depth budget returns BRE_LIMIT");
+    bre_set_limits(prog, NULL);
+    OK(prog && bre_exec(prog, "aab", &m) == BRE_OK && m.start == 0 && m.length == 3, "default limits allow small inputs");
+    bre_free(prog);
+
+    /* The tail after the back-reference is memoized: polynomial blow-up without it */
+    memcpy(text, "xx", 2);
+    prog = bre_compile("\\(.\\)\\1.*a.*a.*a.*b");
+    OK(prog && bre_exec(prog, text, &m) == BRE_NOMATCH, "memoization keeps a failing search within budget");
+    BreLimits nomemo = {1000000, 0, false};
+    bre_set_limits(prog, &nomemo);
+    OK(prog && bre_exec(prog, text, &m) == BRE_LIMIT, "the same search exceeds the budget without memoization");
+    bre_free(prog);
+
+    /* Patterns without back-references ignore the budget */
+    prog = bre_compile("\\(a*\\)*b");
+    bre_set_limits(prog, &small);
+    OK(prog && bre_exec(prog, text + 2, &m) == BRE_NOMATCH, "linear-time patterns are not limited");
+    bre_free(prog);
+
+    OK(bre_match(text, "\\(x\\)\\1\\(a*a*\\)*\\2c", &m) == BRE_LIMIT, "bre_match returns BRE_LIMIT with default limits");
+}
+
+static void test_scratch(void)
+{
+    BreProgram *prog = bre_compile("a\\(b*\\)c");
+    BreProgram *other = bre_compile("x");
+    BreScratch *scratch = bre_scratch_new(prog);
+    BreMatch m = {0};
+    OK(scratch && bre_match_at_r(prog, scratch, "xxabbc", 6, 0, &m) == BRE_OK && m.start == 2 && m.length == 4 &&
+           m.groups[0].start == 3 && m.groups[0].length == 2,
+       "bre_match_at_r with the program's scratch");
+    OK(bre_test_n_r(prog, scratch, "ac", 2) == BRE_OK && bre_test_n_r(prog, scratch, "ab", 2) == BRE_NOMATCH,
+       "bre_test_n_r reuses the scratch");
+    OK(bre_match_at_r(other, scratch, "x", 1, 0, &m) == BRE_ERROR, "scratch of another program is rejected");
+    BreBuffer buf = {0};
+    size_t n = 0;
+    OK(bre_substitute_into_r(prog, scratch, "abc abbc", 8, "[\\1]", 0, &buf, &n) == BRE_OK && n == 2 &&
+           strcmp(buf.data, "[b] [bb]") == 0,
+       "bre_substitute_into_r");
+    bre_buffer_free(&buf);
+    bre_scratch_free(scratch);
+    bre_free(other);
+    bre_free(prog);
+    OK(bre_scratch_new(NULL) == NULL, "bre_scratch_new(NULL)");
+}
+
+#ifndef __STDC_NO_THREADS__
+/* Several threads share one program and one set, each with its own scratch */
+#define THREAD_LINES 2000
+
+typedef struct
+{
+    const BreProgram *prog;
+    const BreProgram *backref;
+    const BreSet *set;
+    const char **lines;
+    size_t hits[3];
+    bool ok;
+} ThreadJob;
+
+static int thread_main(void *arg)
+{
+    ThreadJob *job = arg;
+    BreScratch *ps = bre_scratch_new(job->prog);
+    BreScratch *bs = bre_scratch_new(job->backref);
+    BreScratch *ss = bre_set_scratch_new(job->set);
+    job->ok = ps && bs && ss;
+    for (int round = 0; job->ok && round < 5; round++)
+    {
+        job->hits[0] = job->hits[1] = job->hits[2] = 0;
+        for (int i = 0; i < THREAD_LINES; i++)
+        {
+            size_t len = strlen(job->lines[i]);
+            BreMatch m;
+            job->hits[0] += bre_match_at_r(job->prog, ps, job->lines[i], len, 0, &m) == BRE_OK;
+            job->hits[1] += bre_test_n_r(job->backref, bs, job->lines[i], len) == BRE_OK;
+            job->hits[2] += bre_set_test_r(job->set, ss, job->lines[i], len) == BRE_OK;
+        }
+    }
+    bre_scratch_free(ps);
+    bre_scratch_free(bs);
+    bre_scratch_free(ss);
+    return 0;
+}
+
+static void test_threads(void)
+{
+    static char storage[THREAD_LINES][48];
+    const char *lines[THREAD_LINES];
+    for (int i = 0; i < THREAD_LINES; i++)
+    {
+        snprintf(storage[i], sizeof storage[i], "%s %d id%d%d", (i % 3) ? "INFO" : "ERROR", i, i % 7, i % 7);
+        lines[i] = storage[i];
+    }
+    const char *pats[] = {"^ERROR [0-9]*5 ", "id\\([0-9]\\)\\1$"};
+    BreProgram *prog = bre_compile("^ERROR [0-9]*[05] ");
+    BreProgram *backref = bre_compile("id\\([0-6]\\)\\1$");
+    BreSet *set = bre_set_compile(pats, 2, 0);
+
+    ThreadJob expected = {prog, backref, set, lines, {0}, false};
+    thread_main(&expected);
+
+    enum { NTHREADS = 4 };
+    ThreadJob jobs[NTHREADS];
+    thrd_t threads[NTHREADS];
+    bool started = true;
+    for (int t = 0; t < NTHREADS; t++)
+    {
+        jobs[t] = expected;
+        started = thrd_create(&threads[t], thread_main, &jobs[t]) == thrd_success && started;
+    }
+    bool same = started;
+    for (int t = 0; t < NTHREADS && started; t++)
+    {
+        thrd_join(threads[t], NULL);
+        same = same && jobs[t].ok && memcmp(jobs[t].hits, expected.hits, sizeof expected.hits) == 0;
+    }
+    OK(expected.ok && expected.hits[0] == 134 && expected.hits[1] == THREAD_LINES && expected.hits[2] == THREAD_LINES,
+       "single-threaded reference counts");
+    OK(same, "threads sharing a program and a set agree with the reference");
+
+    bre_set_free(set);
+    bre_free(backref);
+    bre_free(prog);
+}
+#endif
+
+static void test_ere(void)
+{
+    BreMatch m = {0};
+    BreProgram *prog = ere_compile("foo|bar|baz");
+    OK(prog && bre_exec(prog, "xx baz", &m) == BRE_OK && m.start == 3 && m.length == 3, "ERE alternation");
+    OK(prog && bre_test(prog, "ba") == BRE_NOMATCH, "ERE alternation needs a whole alternative");
+    bre_free(prog);
+
+    prog = ere_compile("a(b|cd)+e?");
+    OK(prog && bre_exec(prog, "xabcdbe", &m) == BRE_OK && m.start == 1 && m.length == 6 && m.num_groups == 1 &&
+           m.groups[0].start == 5 && m.groups[0].length == 1,
+       "ERE groups with + and ?");
+    bre_free(prog);
+
+    prog = ere_compile("^(ab|c){2,3}$");
+    OK(prog && bre_test(prog, "abcab") == BRE_OK && bre_test(prog, "ab") == BRE_NOMATCH &&
+           bre_test(prog, "cccc") == BRE_NOMATCH,
+       "ERE interval on a group");
+    bre_free(prog);
+
+    prog = ere_compile("^a|b$");
+    OK(prog && bre_test(prog, "ab") == BRE_OK && bre_test(prog, "xa") == BRE_NOMATCH &&
+           bre_test(prog, "bx") == BRE_NOMATCH,
+       "ERE anchors bind to their alternative");
+    bre_free(prog);
+
+    prog = ere_compile("a\\|b\\(c\\)+");
+    OK(prog && bre_exec(prog, "a|b(c))", &m) == BRE_OK && m.start == 0 && m.length == 7,
+       "escaped ERE operators are literal");
+    bre_free(prog);
+
+    prog = ere_compile("^(a*)\\1x|*y");
+    OK(prog && bre_test(prog, "aaax") == BRE_NOMATCH && bre_test(prog, "aaaax") == BRE_OK &&
+           bre_test(prog, "*y") == BRE_OK,
+       "ERE back-reference and leading '*'");
+    bre_free(prog);
+
+    prog = ere_compile("a|ab");
+    OK(prog && bre_exec(prog, "xab", &m) == BRE_OK && m.start == 1 && m.length == 2,
+       "ERE alternation takes the longest match");
+    bre_free(prog);
+
+    prog = ere_compile("b|abc|ab");
+    OK(prog && bre_exec(prog, "zabcd", &m) == BRE_OK && m.start == 1 && m.length == 3,
+       "ERE match is leftmost before longest");
+    bre_free(prog);
+
+    prog = ere_compile("(a|ab)(c|bcd)(d*)");
+    OK(prog && bre_exec(prog, "abcd", &m) == BRE_OK && m.start == 0 && m.length == 4 &&
+           m.groups[0].length == 1 && m.groups[1].length == 3,
+       "ERE groups come from the first alternative of the longest match");
+    bre_free(prog);
+
+    prog = ere_compile("(a|ab)\\1");
+    OK(prog && bre_exec(prog, "ababx", &m) == BRE_OK && m.start == 0 && m.length == 4 &&
+           m.groups[0].length == 2,
+       "ERE with a back-reference takes the longest match");
+    bre_free(prog);
+
+    prog = bre_compile("a|b+");
+    OK(prog && bre_test(prog, "xa|b+") == BRE_OK && bre_test(prog, "a") == BRE_NOMATCH,
+       "'|' and '+' stay literal in a BRE");
+    bre_free(prog);
+
+    const char *bad[] = {"a(b", "a)b", "(", "a{2", "a{3,1}", "a{x}", "a\\"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        BreProgram *p = ere_compile(bad[i]);
+        OK(p == NULL, "ere_compile rejects an invalid ERE");
+        bre_free(p);
+    }
+
+    prog = bre_compile_flags("A(X|Y)", BRE_EXTENDED | BRE_ICASE | BRE_WHOLE);
+    OK(prog && bre_test(prog, "ay") == BRE_OK && bre_test(prog, "ayz") == BRE_NOMATCH &&
+           bre_test(prog, "zay") == BRE_NOMATCH,
+       "BRE_EXTENDED with BRE_ICASE and BRE_WHOLE");
+    bre_free(prog);
+
+    prog = bre_compile_flags("a$", BRE_WHOLE);
+    OK(prog && bre_test(prog, "a") == BRE_OK && bre_test(prog, "ba") == BRE_NOMATCH, "BRE_WHOLE with a BRE");
+    bre_free(prog);
+
+    const char *pats[] = {"disk (full|error)", "time(d )?out"};
+    bool hit[2];
+    BreSet *set = bre_set_compile(pats, 2, BRE_EXTENDED);
+    OK(set && bre_set_match(set, "disk error, timed out", 21, hit) == BRE_OK && hit[0] && hit[1],
+       "bre_set_compile with BRE_EXTENDED");
+    bre_set_free(set);
+}
+
+static void test_match_shape(void)
+{
+    /* Matches that must end at the end of the line are only looked for in its tail */
+    char line[4096];
+    memset(line, 'x', sizeof line);
+    memcpy(line + 100, "2024-03", 7);
+    memcpy(line + sizeof line - 7, "2025-12", 7);
+    BreMatch m = {0};
+    BreProgram *prog = bre_compile("[0-9]\\{4\\}-[0-9]\\{2\\}$");
+    OK(prog && bre_match_at(prog, line, sizeof line, 0, &m) == BRE_OK && m.start == (int)sizeof line - 7 &&
+           m.length == 7,
+       "fixed-length end-anchored match in the tail window");
+    OK(prog && bre_test_n(prog, line, sizeof line - 1) == BRE_NOMATCH, "tail window without a match");
+    OK(prog && bre_match_at(prog, line, 107, 0, &m) == BRE_OK && m.start == 100, "tail window of a shorter text");
+    OK(prog && bre_match_at(prog, line, 107, 101, &m) == BRE_NOMATCH, "start past the only candidate");
+    bre_free(prog);
+
+    prog = ere_compile("(ab|cde|f)$");
+    OK(prog && bre_exec(prog, "cdeab", &m) == BRE_OK && m.start == 3 && bre_exec(prog, "abcde", &m) == BRE_OK &&
+           m.start == 2 && bre_test(prog, "fx") == BRE_NOMATCH,
+       "end-anchored alternatives of different lengths");
+    bre_free(prog);
+
+    prog = bre_compile("^ab$");
+    OK(prog && bre_test(prog, "ab") == BRE_OK && bre_test(prog, "aab") == BRE_NOMATCH, "anchored at both ends");
+    bre_free(prog);
+
+    prog = bre_compile("\\(a*\\)b\\1$");
+    OK(prog && bre_exec(prog, "xxaaabaa", &m) == BRE_OK && m.start == 3 && m.length == 5,
+       "end-anchored back-reference of unbounded length");
+    bre_free(prog);
+
+    /* Texts shorter than every match are rejected before any search */
+    prog = bre_compile("a.c\\{2,\\}");
+    OK(prog && bre_test(prog, "abc") == BRE_NOMATCH && bre_test(prog, "abcc") == BRE_OK, "shortest match length");
+    OK(prog && bre_match_at(prog, "xxabcc", 6, 3, &m) == BRE_NOMATCH && bre_match_at(prog, "xxabcc", 6, 2, &m) == BRE_OK,
+       "shortest match length from a start offset");
+    bre_free(prog);
+}
+
+static void test_large_counts(void)
+{
+    /* The interpreter keeps every occurrence's length to give them back one by one */
+    {
+        enum { REPS = 300 };
+        char text[2 * REPS + 2];
+        for (int i = 0; i < REPS; i++)
+            memcpy(text + 2 * i, "ab", 2);
+        text[2 * REPS] = 'c';
+        text[2 * REPS + 1] = '\0';
+        const char *pat = "\\(ab\\)\\{1,400\\}abc";
+        int pend = (int)strlen(pat);
+        int gend = find_group_end_test(pat, 0, pend);
+        BreRepetition rep = {0};
+        BreResult pr = parse_bre_repetition(pat, gend + 2, pend, &rep);
+        MatchContext ctx = {.base = text, .text = text, .ti = 0, .pat = pat, .pi = 0, .pend = pend};
+        BreMatch m = {0};
+        int total = -1;
+        BreResult r = (pr == BRE_OK) ? match_group_with_quantifier(&ctx, &m, 2, gend, 0, gend + 2, &rep, &total) : pr;
+        OK(r == BRE_OK && total == 2 * REPS + 1 && m.groups[0].length == 2 * (REPS - 1),
+           "match_group_with_quantifier gives back a group past 256 occurrences");
+    }
+
+    enum { N = 100000 };
+    char *text = malloc(N + 1);
+    if (!text)
+    {
+        OK(0, "out of memory");
+        return;
+    }
+    memset(text, 'x', N);
+    text[N] = '\0';
+    BreMatch m = {0};
+
+    BreProgram *prog = bre_compile(".\\{1,50000\\}");
+    OK(prog && bre_match_at(prog, text, N, 0, &m) == BRE_OK && m.start == 0 && m.length == 50000,
+       "\\{1,50000\\} on a long line");
+    bre_free(prog);
+
+    memset(text + N - 40000, '7', 40000);
+    prog = bre_compile("[0-9]\\{40000\\}$");
+    OK(prog && bre_test_n(prog, text, N) == BRE_OK && bre_match_at(prog, text, N, 0, &m) == BRE_OK &&
+           m.start == N - 40000,
+       "\\{40000\\} at the end of a long line");
+    OK(prog && bre_test_n(prog, text, N - 1) == BRE_NOMATCH, "\\{40000\\} one byte short");
+    bre_free(prog);
+
+    for (int i = 0; i < N; i += 2)
+        memcpy(text + i, "ab", 2);
+    prog = bre_compile("^\\(ab\\)\\{20000\\}");
+    OK(prog && bre_match_at(prog, text, N, 0, &m) == BRE_OK && m.length == 40000 && m.groups[0].start == 39998 &&
+           m.groups[0].length == 2,
+       "repeated group with a large count");
+    bre_free(prog);
+
+    prog = bre_compile("\\(ab\\)\\1\\{1,30000\\}");
+    OK(prog && bre_match_at(prog, text, N, 0, &m) == BRE_OK && m.length == 60002,
+       "repeated back-reference with a large count");
+    bre_free(prog);
+    free(text);
+
+    prog = ere_compile("a{65535}");
+    OK(prog != NULL, "BRE_DUP_MAX is accepted");
+    bre_free(prog);
+    prog = ere_compile("a{65536}");
+    OK(prog == NULL, "counts above BRE_DUP_MAX are rejected");
+    prog = bre_compile("\\(.\\{1000\\}\\)\\{1000\\}");
+    OK(prog == NULL, "expansion beyond the program size limit is rejected");
+    bre_free(prog);
+}
+
+static void test_icase(void)
+{
+    BreMatch m = {0};
+    BreProgram *prog = bre_compile_flags("err[A-C]r:\\(x\\)\\1", BRE_ICASE);
+    OK(prog && bre_exec(prog, "a ERRbR:Xx", &m) == BRE_OK && m.start == 2 && m.length == 8,
+       "BRE_ICASE folds literals, classes and back-references");
+    OK(prog && bre_test(prog, "ERRbR:Xy") == BRE_NOMATCH, "BRE_ICASE still requires the back-reference");
+    size_t n = 0;
+    const char *lit = bre_required_literal(prog, &n);
+    OK(lit && n == 3 && memcmp(lit, "err", 3) == 0, "BRE_ICASE literal is lower case");
+    bre_free(prog);
+
+    prog = bre_compile_flags("^[a-h]ello$", BRE_ICASE);
+    OK(prog && bre_test(prog, "HELLO") == BRE_OK, "BRE_ICASE with a bracket range");
+    bre_free(prog);
+
+    prog = bre_compile("Hello");
+    OK(prog && bre_test(prog, "hello") == BRE_NOMATCH, "case matters without BRE_ICASE");
+    bre_free(prog);
+
+    const char *pats[] = {"alpha", "BETA"};
+    BreSet *set = bre_set_compile(pats, 2, BRE_ICASE);
+    OK(set && bre_set_test(set, "xx Beta", 7) == BRE_OK && bre_set_test(set, "gamma", 5) == BRE_NOMATCH,
+       "bre_set_compile with BRE_ICASE");
+    bre_set_free(set);
+}
+
+static void test_set(void)
+{
+    const char *pats[] = {"^ERROR", "time[o]ut$", "\\(ab\\)\\1", "disk.*full"};
+    bool hit[4];
+    BreSet *set = bre_set_compile(pats, 4, 0);
+    OK(set && bre_set_size(set) == 4, "bre_set_compile builds a set");
+    OK(bre_set_match(set, "ERROR: disk is full", 19, hit) == BRE_OK && hit[0] && !hit[1] && !hit[2] && hit[3],
+       "bre_set_match reports each matching pattern");
+    OK(bre_set_match(set, "xababx timeout", 14, hit) == BRE_OK && !hit[0] && hit[1] && hit[2] && !hit[3],
+       "bre_set_match mixes automaton and back-reference patterns");
+    OK(bre_set_test(set, "warning: ERROR", 14) == BRE_NOMATCH, "bre_set_test with no pattern matching");
+    OK(bre_set_test(set, "full disk, disk full", 20) == BRE_OK, "bre_set_test with one pattern matching");
+    bre_set_free(set);
+
+    const char *bad[] = {"ok", "a\\(b"};
+    OK(bre_set_compile(bad, 2, 0) == NULL, "bre_set_compile rejects an invalid pattern");
+}
+
+static void test_cache(void)
+{
+    BreCacheStats st;
+    BreCache *cache = bre_cache_new(2);
+    const BreProgram *a = bre_cache_get(cache, "a*b", 0);
+    const BreProgram *a2 = bre_cache_get(cache, "a*b", 0);
+    bre_cache_stats(cache, &st);
+    OK(a && a == a2 && st.hits == 1 && st.misses == 1 && st.entries == 1, "bre_cache_get compiles a pattern once");
+    OK(bre_test(a, "xaab") == BRE_OK, "cached program matches");
+    const BreProgram *ai = bre_cache_get(cache, "a*b", BRE_ICASE);
+    OK(ai && ai != a && bre_test(ai, "AB") == BRE_OK, "flags are part of the cache key");
+    bre_cache_release(cache, a);
+    bre_cache_release(cache, a2);
+    bre_cache_release(cache, ai);
+
+    OK(bre_cache_get(cache, "a\\(", 0) == NULL, "bre_cache_get rejects an invalid pattern");
+    bre_cache_stats(cache, &st);
+    OK(st.entries == 2 && st.misses == 3, "an invalid pattern is not cached");
+
+    /* "a*b" is the least recently used and goes first */
+    const BreProgram *c = bre_cache_get(cache, "c", 0);
+    bre_cache_release(cache, c);
+    ai = bre_cache_get(cache, "a*b", BRE_ICASE);
+    bre_cache_release(cache, ai);
+    bre_cache_stats(cache, &st);
+    OK(st.hits == 2 && st.evictions == 1 && st.entries == 2, "bre_cache_get evicts the least recently used entry");
+
+    /* Held programs survive past the capacity until released */
+    const BreProgram *held[3];
+    held[0] = bre_cache_get(cache, "x", 0);
+    held[1] = bre_cache_get(cache, "y", 0);
+    held[2] = bre_cache_get(cache, "z", 0);
+    bre_cache_stats(cache, &st);
+    OK(st.entries == 3 && bre_test(held[0], "x") == BRE_OK && bre_test(held[1], "y") == BRE_OK,
+       "held programs are not evicted");
+    for (int i = 0; i < 3; i++)
+        bre_cache_release(cache, held[i]);
+    bre_cache_stats(cache, &st);
+    OK(st.entries == 2, "released programs beyond the capacity are evicted");
+    bre_cache_free(cache);
+}
+
+static void test_match_at(void)
+{
+    BreMatch m = {0};
+    const char text[] = "k1=v1\0k2=v2";
+    size_t len = sizeof(text) - 1;
+
+    BreProgram *prog = bre_compile("k\\([0-9]\\)=");
+    OK(bre_match_at(prog, text, len, 1, &m) == BRE_OK && m.start == 6 && m.length == 3 && m.groups[0].start == 7,
+       "bre_match_at searches past an embedded NUL with absolute offsets");
+    int count = 0;
+    size_t at = 0;
+    while (bre_match_at(prog, text, len, at, &m) == BRE_OK)
+    {
+        count++;
+        at = (size_t)(m.start + m.length);
+    }
+    OK(count == 2, "bre_match_at iterates all matches in one pass");
+    OK(bre_match_at(prog, text, len, len + 1, &m) == BRE_ERROR, "bre_match_at rejects start past the end");
+    bre_free(prog);
+
+    prog = bre_compile("^k");
+    OK(bre_match_at(prog, text, len, 1, &m) == BRE_NOMATCH, "^ does not match at the start offset");
+    OK(bre_test_n(prog, text + 6, 3) == BRE_OK, "bre_test_n on a slice");
+    bre_free(prog);
+
+    prog = bre_compile("v1$");
+    OK(bre_test_n(prog, "v1\n", 2) == BRE_OK && bre_test_n(prog, "v1\n", 3) == BRE_NOMATCH, "$ honours the given length");
+    bre_free(prog);
+
+    OK(bre_match_n("ab\0cd", 5, "c", &m) == BRE_OK && m.start == 3, "bre_match_n with embedded NUL");
+}
+
+static void test_bre_test(void)
+{
+    BreProgram *prog = bre_compile("^[a-z]*=[0-9]\\{2\\}$");
+    OK(prog && bre_test(prog, "width=80") == BRE_OK, "bre_test accepts matching line");
+    OK(prog && bre_test(prog, "width=800") == BRE_NOMATCH, "bre_test honours $");
+    OK(prog && bre_test(prog, "x width=80") == BRE_NOMATCH, "bre_test honours ^");
+    bre_free(prog);
+
+    prog = bre_compile("$");
+    OK(prog && bre_test(prog, "abc") == BRE_OK && bre_test(prog, "") == BRE_OK, "bre_test empty match at end");
+    bre_free(prog);
+
+    prog = bre_compile("\\(ab\\)\\1");
+    OK(prog && bre_test(prog, "xxabab") == BRE_OK && bre_test(prog, "abba") == BRE_NOMATCH,
+       "bre_test with back-reference");
+    bre_free(prog);
+
+    /* Enough distinct states to overflow the DFA cache */
+    prog = bre_compile("a.\\{12\\}$");
+    char text[8192 + 14];
+    for (int i = 0; i < 8192; i++)
+        text[i] = (i * 7919 % 13) < 6 ? 'a' : 'b';
+    memcpy(text + 8192, "abbbbbbbbbbbb", 14);
+    OK(prog && bre_test(prog, text) == BRE_OK, "bre_test after the state cache fills");
+    text[8192] = 'b';
+    OK(prog && bre_test(prog, text) == BRE_NOMATCH, "bre_test rejects after the state cache fills");
+    bre_free(prog);
+}
+
 int main(void)
 {
     printf("1..%d\n", 49); /* Original plan retained (legacy); counts include all OK() calls */
@@ -414,6 +1038,23 @@ int main(void)
     test_internal_groups();
     test_match();
     test_substitute();
+    test_compiled();
+    test_bre_test();
+    test_required_literal();
+    test_match_at();
+    test_substitute_into();
+    test_set();
+    test_cache();
+    test_icase();
+    test_bracket();
+    test_limits();
+    test_scratch();
+    test_ere();
+    test_match_shape();
+    test_large_counts();
+#ifndef __STDC_NO_THREADS__
+    test_threads();
+#endif
     test_parse_bre_repetition();
 
 #if 0
@@ -0,0 +1,213 @@
+/* litsearch_test.c - TAP tests for the fixed-string searcher */
+#include "litsearch.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OK(cond, desc)                                                                                                 \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        tests++;                                                                                                       \
+        if (cond)                                                                                                      \
+        {                                                                                                              \
+            printf("ok %d - %s\n", tests, (desc));                                                                     \
+        }                                                                                                              \
+        else                                                                                                           \
+        {                                                                                                              \
+            printf("not ok %d - %s\n", tests, (desc));                                                                 \
+            failed = 1;                                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+static int tests = 0;
+static int failed = 0;
+
+/* Offset of the first match of 'needle' in text, or -1 */
+static long find(const char *needle, const char *text, size_t len, bool icase)
+{
+    LitSearch *ls = lit_compile(needle, strlen(needle), icase);
+    const char *hit = lit_find(ls, text, len);
+    lit_free(ls);
+    return hit ? (long)(hit - text) : -1;
+}
+
+/* Reference search: the nested loop grep -F used before */
+static long naive_find(const char *ndl, size_t nlen, const char *hay, size_t hlen, bool icase)
+{
+    for (size_t i = 0; i + nlen <= hlen; i++)
+    {
+        size_t j = 0;
+        while (j < nlen && (icase ? tolower((unsigned char)hay[i + j]) == tolower((unsigned char)ndl[j])
+                                  : hay[i + j] == ndl[j]))
+            j++;
+        if (j == nlen)
+            return (long)i;
+    }
+    return -1;
+}
+
+static void test_exact(void)
+{
+    const char *text = "the cat sat on the mat";
+    size_t len = strlen(text);
+    OK(find("the", text, len, false) == 0, "match at the start");
+    OK(find("mat", text, len, false) == 19, "match at the end");
+    OK(find("sat on", text, len, false) == 8, "match in the middle");
+    OK(find("dog", text, len, false) == -1, "no match");
+    OK(find("s", text, len, false) == 8, "single byte needle");
+    OK(find("", text, len, false) == 0, "empty needle matches at the start");
+    OK(find("the cat sat on the mat!", text, len, false) == -1, "needle longer than the text");
+    OK(find("mat", text, len - 1, false) == -1, "search stops at the given length");
+    OK(find("c", "ab\0c", 4, false) == 3, "text may contain NUL bytes");
+    OK(find("aab", "aaaaaab", 7, false) == 4, "overlapping prefix");
+}
+
+static void test_icase(void)
+{
+    const char *text = "Connection RESET by Peer";
+    size_t len = strlen(text);
+    OK(find("reset", text, len, true) == 11, "-i match of an upper-case word");
+    OK(find("PEER", text, len, true) == 20, "-i match with an upper-case needle");
+    OK(find("reset", text, len, false) == -1, "case matters without -i");
+    OK(find("C", text, len, true) == 0, "-i single byte needle");
+}
+
+static void test_random(void)
+{
+    srand(7);
+    int bad = 0;
+    for (int it = 0; it < 20000; it++)
+    {
+        char hay[64];
+        char ndl[8];
+        size_t hlen = (size_t)(rand() % 64);
+        size_t nlen = 1 + (size_t)(rand() % 7);
+        for (size_t i = 0; i < hlen; i++)
+            hay[i] = "abAB"[rand() % 4];
+        for (size_t i = 0; i < nlen; i++)
+            ndl[i] = "abAB"[rand() % 4];
+        bool icase = (it & 1) != 0;
+        LitSearch *ls = lit_compile(ndl, nlen, icase);
+        const char *hit = lit_find(ls, hay, hlen);
+        long got = hit ? (long)(hit - hay) : -1;
+        if (got != naive_find(ndl, nlen, hay, hlen, icase))
+            bad++;
+        lit_free(ls);
+    }
+    OK(bad == 0, "agrees with a naive search on random texts");
+}
+
+typedef struct
+{
+    size_t count;
+    size_t starts[16];
+    size_t lens[16];
+} Found;
+
+/* Collects every occurrence */
+static bool collect(void *arg, size_t start, size_t length)
+{
+    Found *f = arg;
+    if (f->count < 16)
+    {
+        f->starts[f->count] = start;
+        f->lens[f->count] = length;
+    }
+    f->count++;
+    return false;
+}
+
+static void test_set(void)
+{
+    const char *needles[] = {"he", "she", "his", "hers"};
+    LitSet *set = lit_set_compile(needles, 4, false);
+    Found f = {0};
+    OK(set && !lit_set_scan(set, "ushers", 6, collect, &f), "lit_set_scan visits every occurrence");
+    OK(f.count == 3 && f.starts[0] == 1 && f.lens[0] == 3 && f.starts[1] == 2 && f.lens[1] == 2 && f.starts[2] == 2 &&
+           f.lens[2] == 4,
+       "occurrences are reported by end, including overlapping ones");
+    OK(lit_set_scan(set, "this", 4, NULL, NULL), "lit_set_scan finds a needle");
+    OK(!lit_set_scan(set, "ash", 3, NULL, NULL), "lit_set_scan without a needle");
+    OK(lit_set_exact(set, "hers", 4) && !lit_set_exact(set, "her", 3) && !lit_set_exact(set, "shes", 4),
+       "lit_set_exact matches whole needles only");
+    lit_set_free(set);
+
+    const char *mixed[] = {"Error", "WARN", ""};
+    set = lit_set_compile(mixed, 2, true);
+    OK(set && lit_set_scan(set, "an ERROR here", 13, NULL, NULL) && lit_set_scan(set, "warned", 6, NULL, NULL),
+       "lit_set_scan with -i");
+    OK(lit_set_exact(set, "error", 5) && !lit_set_scan(set, "fine", 4, NULL, NULL), "lit_set_exact with -i");
+    lit_set_free(set);
+    set = lit_set_compile(mixed, 3, false);
+    OK(set && lit_set_scan(set, "x", 1, NULL, NULL) && lit_set_exact(set, "", 0), "an empty needle matches any text");
+    lit_set_free(set);
+}
+
+static void test_set_random(void)
+{
+    srand(11);
+    int bad = 0;
+    for (int it = 0; it < 3000; it++)
+    {
+        char buf[8][6];
+        const char *needles[8];
+        size_t n = 1 + (size_t)(rand() % 8);
+        for (size_t k = 0; k < n; k++)
+        {
+            size_t len = 1 + (size_t)(rand() % 5);
+            for (size_t i = 0; i < len; i++)
+                buf[k][i] = "abcA"[rand() % 4];
+            buf[k][len] = '\0';
+            needles[k] = buf[k];
+        }
+        char hay[40];
+        size_t hlen = (size_t)(rand() % 40);
+        for (size_t i = 0; i < hlen; i++)
+            hay[i] = "abcAx"[rand() % 5];
+        bool icase = (it & 1) != 0;
+
+        /* Every occurrence of every needle, counted both ways */
+        size_t expect = 0;
+        bool exact = false;
+        for (size_t k = 0; k < n; k++)
+        {
+            size_t nlen = strlen(needles[k]);
+            for (size_t i = 0; i + nlen <= hlen; i++)
+                expect += naive_find(needles[k], nlen, hay + i, nlen, icase) == 0;
+            exact = exact || (nlen == hlen && naive_find(needles[k], nlen, hay, hlen, icase) == 0);
+        }
+        /* Duplicate needles are one node of the automaton */
+        for (size_t k = 0; k < n; k++)
+        {
+            for (size_t j = 0; j < k; j++)
+            {
+                size_t nlen = strlen(needles[k]);
+                if (strlen(needles[j]) == nlen && naive_find(needles[j], nlen, needles[k], nlen, icase) == 0)
+                {
+                    for (size_t i = 0; i + nlen <= hlen; i++)
+                        expect -= naive_find(needles[k], nlen, hay + i, nlen, icase) == 0;
+                    break;
+                }
+            }
+        }
+        LitSet *set = lit_set_compile(needles, n, icase);
+        Found f = {0};
+        lit_set_scan(set, hay, hlen, collect, &f);
+        if (f.count != expect || lit_set_exact(set, hay, hlen) != exact)
+            bad++;
+        lit_set_free(set);
+    }
+    OK(bad == 0, "lit_set agrees with a naive search on random texts");
+}
+
+int main(void)
+{
+    test_exact();
+    test_icase();
+    test_random();
+    test_set();
+    test_set_random();
+    printf("1..%d\n", tests);
+    return failed ? 1 : 0;
+}